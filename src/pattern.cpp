@@ -0,0 +1,1077 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <unordered_map>
+
+#include "pattern.h"
+
+namespace utils
+{
+	namespace
+	{
+		using byte_set = std::array<uint64_t, 4>;
+
+		bool set_has(const byte_set& s, uint8_t c) { return (s[c >> 6] >> (c & 63)) & 1; }
+		void set_add(byte_set& s, uint8_t c) { s[c >> 6] |= 1ULL << (c & 63); }
+
+		void set_add_range(byte_set& s, uint8_t from, uint8_t to)
+		{
+			for (auto c = uint32_t(from); c <= to; ++c) set_add(s, uint8_t(c));
+		}
+
+		void set_merge(byte_set& s, const byte_set& o)
+		{
+			for (auto i = 0; i < 4; ++i) s[i] |= o[i];
+		}
+
+		byte_set set_escape(char c)
+		{
+			byte_set r{};
+			switch (c | 0x20)
+			{
+				case 'd':
+				{
+					set_add_range(r, '0', '9');
+					break;
+				}
+				case 'w':
+				{
+					set_add_range(r, '0', '9');
+					set_add_range(r, 'a', 'z');
+					set_add_range(r, 'A', 'Z');
+					set_add(r, '_');
+					break;
+				}
+				case 's':
+				{
+					set_add_range(r, '\t', '\r');
+					set_add(r, ' ');
+					break;
+				}
+			}
+			if (c < 'a')
+			{
+				for (auto& i : r) i = ~i;
+			}
+			return r;
+		}
+
+		// Thrown while compiling if pattern is outside of supported subset, or too large to expand
+		struct unsupported { };
+
+		constexpr uint32_t repeat_inf = UINT32_MAX;
+		constexpr uint32_t repeat_limit = 1024;
+		constexpr size_t nfa_states_limit = 16384;
+		constexpr size_t dfa_states_limit = 4096;
+
+		// NFA states visited during subset construction: large alternations can stay under the states limit and still take
+		// seconds to expand, past this they are simulated instead
+		constexpr size_t dfa_work_limit = 1 << 22;
+
+		enum class node_kind : uint8_t
+		{
+			empty,
+			set,
+			cat,
+			alt,
+			repeat,
+			begin,
+			end,
+		};
+
+		struct node
+		{
+			node_kind kind{};
+			uint32_t arg{};
+			uint32_t min{}, max{};
+			std::vector<uint32_t> kids{};
+		};
+
+		// Recursive descent over ECMAScript syntax, only what filters actually use
+		struct parser
+		{
+			const char* p{};
+			const char* e{};
+			bool icase{};
+			std::vector<node> nodes{};
+			std::vector<byte_set> sets{};
+			std::map<byte_set, uint32_t> sets_known{};
+
+			uint32_t add(node&& n)
+			{
+				nodes.push_back(std::move(n));
+				return uint32_t(nodes.size() - 1);
+			}
+
+			uint32_t add_set(byte_set s)
+			{
+				if (icase) fold(s);
+				auto f = sets_known.find(s);
+				if (f == sets_known.end())
+				{
+					f = sets_known.emplace(s, uint32_t(sets.size())).first;
+					sets.push_back(s);
+				}
+				return add({node_kind::set, f->second});
+			}
+
+			// Same ASCII-only case folding std::regex does with icase in "C" locale
+			static void fold(byte_set& s)
+			{
+				for (auto c = 'a'; c <= 'z'; ++c)
+				{
+					if (set_has(s, c) || set_has(s, c - 0x20))
+					{
+						set_add(s, c);
+						set_add(s, c - 0x20);
+					}
+				}
+			}
+
+			uint32_t add_char(char c)
+			{
+				byte_set s{};
+				set_add(s, uint8_t(c));
+				return add_set(s);
+			}
+
+			uint32_t parse()
+			{
+				const auto r = parse_alt();
+				if (p != e) throw unsupported{};
+				return r;
+			}
+
+			uint32_t parse_alt()
+			{
+				std::vector<uint32_t> items{parse_seq()};
+				while (p != e && *p == '|')
+				{
+					++p;
+					items.push_back(parse_seq());
+				}
+				return items.size() == 1 ? items[0] : add({node_kind::alt, 0, 0, 0, std::move(items)});
+			}
+
+			uint32_t parse_seq()
+			{
+				std::vector<uint32_t> items;
+				while (p != e && *p != '|' && *p != ')')
+				{
+					items.push_back(parse_quantifier(parse_atom()));
+				}
+				return items.size() == 1 ? items[0] : add({node_kind::cat, 0, 0, 0, std::move(items)});
+			}
+
+			uint32_t parse_number()
+			{
+				if (p == e || *p < '0' || *p > '9') throw unsupported{};
+				uint32_t r{};
+				for (; p != e && *p >= '0' && *p <= '9'; ++p)
+				{
+					r = r * 10 + (*p - '0');
+					if (r > repeat_limit) throw unsupported{};
+				}
+				return r;
+			}
+
+			uint32_t parse_quantifier(uint32_t atom)
+			{
+				if (p == e) return atom;
+				uint32_t min, max;
+				switch (*p)
+				{
+					case '*': min = 0, max = repeat_inf, ++p; break;
+					case '+': min = 1, max = repeat_inf, ++p; break;
+					case '?': min = 0, max = 1, ++p; break;
+					case '{':
+					{
+						++p;
+						min = max = parse_number();
+						if (p != e && *p == ',')
+						{
+							++p;
+							max = p != e && *p == '}' ? repeat_inf : parse_number();
+						}
+						if (p == e || *p != '}' || min > max) throw unsupported{};
+						++p;
+						break;
+					}
+					default: return atom;
+				}
+
+				// Lazy quantifiers can only change which match is found, not whether there is one
+				if (p != e && *p == '?') ++p;
+				if (nodes[atom].kind == node_kind::begin || nodes[atom].kind == node_kind::end) throw unsupported{};
+				return add({node_kind::repeat, 0, min, max, {atom}});
+			}
+
+			// Returns -1 for \d, \w, \s and their negations (stored in set), character code otherwise
+			int parse_escape(byte_set& set)
+			{
+				if (p == e) throw unsupported{};
+				const auto c = *p++;
+				switch (c)
+				{
+					case 'd': case 'D': case 'w': case 'W': case 's': case 'S':
+					{
+						set = set_escape(c);
+						return -1;
+					}
+					case 't': return '\t';
+					case 'n': return '\n';
+					case 'r': return '\r';
+					case 'f': return '\f';
+					case 'v': return '\v';
+					case 'x':
+					{
+						int h, l;
+						if (e - p < 2 || (h = hex_value(p[0])) < 0 || (l = hex_value(p[1])) < 0) throw unsupported{};
+						p += 2;
+						return (h << 4) | l;
+					}
+					default:
+					{
+						// Backreferences, \b, \c, \u and such are left to std::regex
+						if ((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')) throw unsupported{};
+						return uint8_t(c);
+					}
+				}
+			}
+
+			static int hex_value(char c)
+			{
+				if (c >= '0' && c <= '9') return c - '0';
+				if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') return (c | 0x20) - 'a' + 10;
+				return -1;
+			}
+
+			int parse_class_atom(byte_set& set)
+			{
+				if (p == e) throw unsupported{};
+				const auto c = *p++;
+				if (c == '\\')
+				{
+					if (p != e && *p == 'b') throw unsupported{};
+					return parse_escape(set);
+				}
+				if (c == '[' && p != e && (*p == ':' || *p == '=' || *p == '.')) throw unsupported{};
+				return uint8_t(c);
+			}
+
+			uint32_t parse_class()
+			{
+				byte_set r{};
+				const auto negate = p != e && *p == '^';
+				if (negate) ++p;
+				if (p != e && *p == ']') throw unsupported{};
+				for (;;)
+				{
+					if (p == e) throw unsupported{};
+					if (*p == ']')
+					{
+						++p;
+						break;
+					}
+
+					byte_set escaped{};
+					const auto from = parse_class_atom(escaped);
+					if (from < 0)
+					{
+						if (p != e && *p == '-' && e - p > 1 && p[1] != ']') throw unsupported{};
+						set_merge(r, escaped);
+					}
+					else if (p != e && *p == '-' && e - p > 1 && p[1] != ']')
+					{
+						++p;
+						const auto to = parse_class_atom(escaped);
+						if (to < from) throw unsupported{};
+						set_add_range(r, uint8_t(from), uint8_t(to));
+					}
+					else
+					{
+						set_add(r, uint8_t(from));
+					}
+				}
+
+				// Folding happens before negation, so [^a] rejects "A" as well
+				if (negate)
+				{
+					if (icase) fold(r);
+					for (auto& i : r) i = ~i;
+				}
+				return add_set(r);
+			}
+
+			// Longest run of plain characters every match has to contain, lowercase, used for prefiltering
+			std::string required_literal(uint32_t root) const
+			{
+				std::string best, run;
+				collect_literal(root, best, run);
+				return run.size() > best.size() ? run : best;
+			}
+
+			void collect_literal(uint32_t index, std::string& best, std::string& run) const
+			{
+				const auto& n = nodes[index];
+				if (n.kind == node_kind::cat)
+				{
+					for (auto i : n.kids) collect_literal(i, best, run);
+					return;
+				}
+
+				if (n.kind == node_kind::set)
+				{
+					const auto& s = sets[n.arg];
+					const auto count = std::popcount(s[0]) + std::popcount(s[1]) + std::popcount(s[2]) + std::popcount(s[3]);
+					auto c = 0U;
+					while (!set_has(s, uint8_t(c))) ++c;
+					const auto upper = c >= 'A' && c <= 'Z';
+					if (count == 1 || (count == 2 && upper && set_has(s, uint8_t(c | 0x20))))
+					{
+						run.push_back(char(upper ? c | 0x20 : c));
+						return;
+					}
+				}
+				if (run.size() > best.size()) best = std::move(run);
+				run.clear();
+			}
+
+			uint32_t parse_atom()
+			{
+				const auto c = *p++;
+				switch (c)
+				{
+					case '(':
+					{
+						if (p != e && *p == '?')
+						{
+							if (e - p < 2 || p[1] != ':') throw unsupported{};
+							p += 2;
+						}
+						const auto r = parse_alt();
+						if (p == e || *p != ')') throw unsupported{};
+						++p;
+						return r;
+					}
+					case '[':
+					{
+						return parse_class();
+					}
+					case '.':
+					{
+						byte_set s;
+						s.fill(~0ULL);
+						s[0] &= ~(1ULL << '\n' | 1ULL << '\r');
+						return add_set(s);
+					}
+					case '^':
+					{
+						return add({node_kind::begin});
+					}
+					case '$':
+					{
+						return add({node_kind::end});
+					}
+					case '\\':
+					{
+						byte_set s{};
+						const auto r = parse_escape(s);
+						return r < 0 ? add_set(s) : add_char(char(r));
+					}
+					case '*': case '+': case '?': case '{': case '}': case ']':
+					{
+						throw unsupported{};
+					}
+					default:
+					{
+						return add_char(c);
+					}
+				}
+			}
+		};
+
+		enum class state_kind : uint8_t
+		{
+			set,
+			split,
+			begin,
+			end,
+			match,
+		};
+
+		struct nfa_state
+		{
+			state_kind kind{};
+			uint32_t arg{};
+			uint32_t out{}, out1{};
+		};
+
+		enum dfa_flags : uint8_t
+		{
+			dfa_accept = 1,
+			dfa_end_accept = 2,
+			dfa_dead = 4,
+		};
+	}
+
+	struct pattern::impl
+	{
+		std::vector<nfa_state> states;
+		std::vector<byte_set> sets;
+		uint32_t start{};
+
+		// Bytes behaving identically for every set share a class, DFA transitions are per class
+		std::array<uint8_t, 256> classes{};
+		uint32_t classes_count{};
+		std::vector<uint32_t> transitions;
+		std::vector<uint8_t> flags;
+		bool dfa{};
+		bool empty_match{};
+
+		// NFA simulation for patterns with too many DFA states
+		std::vector<uint32_t> initial;
+		std::vector<uint32_t> restart;
+
+		bool automaton{};
+		std::regex fallback;
+		std::string literal;
+
+		struct marks
+		{
+			std::vector<uint32_t> gen;
+			uint32_t current{};
+
+			marks() = default;
+			explicit marks(size_t size) : gen(size) { }
+
+			// Grows for patterns with more states, generations left by other patterns are all older than current one
+			void reserve(size_t size)
+			{
+				if (gen.size() < size) gen.resize(size);
+			}
+
+			void next()
+			{
+				if (++current == 0)
+				{
+					std::fill(gen.begin(), gen.end(), 0U);
+					current = 1;
+				}
+			}
+
+			bool visit(uint32_t s) { return gen[s] == current ? false : (gen[s] = current, true); }
+		};
+
+		// Buffers of NFA simulation, kept per thread and shared by all patterns so that searching does not allocate
+		struct scratch
+		{
+			marks m;
+			std::vector<uint32_t> current;
+			std::vector<uint32_t> next;
+			std::vector<uint32_t> tail;
+		};
+
+		static scratch& thread_scratch(size_t states)
+		{
+			thread_local scratch ret;
+			ret.m.reserve(states);
+			return ret;
+		}
+
+		uint32_t emit_state(nfa_state s)
+		{
+			if (states.size() >= nfa_states_limit) throw unsupported{};
+			states.push_back(s);
+			return uint32_t(states.size() - 1);
+		}
+
+		// Thompson construction backwards: builds fragment for node continuing into next, returns its entry
+		uint32_t emit(const std::vector<node>& nodes, uint32_t index, uint32_t next)
+		{
+			const auto& n = nodes[index];
+			switch (n.kind)
+			{
+				case node_kind::empty: return next;
+				case node_kind::set: return emit_state({state_kind::set, n.arg, next});
+				case node_kind::begin: return emit_state({state_kind::begin, 0, next});
+				case node_kind::end: return emit_state({state_kind::end, 0, next});
+				case node_kind::cat:
+				{
+					for (auto i = n.kids.rbegin(); i != n.kids.rend(); ++i) next = emit(nodes, *i, next);
+					return next;
+				}
+				case node_kind::alt:
+				{
+					auto r = emit(nodes, n.kids.back(), next);
+					for (auto i = n.kids.rbegin() + 1; i != n.kids.rend(); ++i)
+					{
+						const auto entry = emit(nodes, *i, next);
+						r = emit_state({state_kind::split, 0, entry, r});
+					}
+					return r;
+				}
+				case node_kind::repeat:
+				{
+					auto r = next;
+					if (n.max == repeat_inf)
+					{
+						r = emit_state({state_kind::split, 0, 0, next});
+						const auto body = emit(nodes, n.kids[0], r);
+						states[r].out = body;
+					}
+					else
+					{
+						for (auto i = n.min; i < n.max; ++i)
+						{
+							const auto body = emit(nodes, n.kids[0], r);
+							r = emit_state({state_kind::split, 0, body, next});
+						}
+					}
+					for (auto i = 0U; i < n.min; ++i) r = emit(nodes, n.kids[0], r);
+					return r;
+				}
+			}
+			return next;
+		}
+
+		// Adds states reachable without consuming input: only set, match and unresolved end states are kept
+		void closure(std::vector<uint32_t>& dst, marks& m, uint32_t from, bool at_begin, bool at_end) const
+		{
+			uint32_t stack[64];
+			std::vector<uint32_t> overflow;
+			auto size = 0U;
+			stack[size++] = from;
+			while (size || !overflow.empty())
+			{
+				uint32_t s;
+				if (!overflow.empty())
+				{
+					s = overflow.back();
+					overflow.pop_back();
+				}
+				else
+				{
+					s = stack[--size];
+				}
+
+				while (m.visit(s))
+				{
+					const auto& i = states[s];
+					if (i.kind == state_kind::split)
+					{
+						if (size < std::size(stack)) stack[size++] = i.out1;
+						else overflow.push_back(i.out1);
+						s = i.out;
+					}
+					else if ((i.kind == state_kind::begin && at_begin) || (i.kind == state_kind::end && at_end))
+					{
+						s = i.out;
+					}
+					else
+					{
+						if (i.kind != state_kind::begin) dst.push_back(s);
+						break;
+					}
+				}
+			}
+		}
+
+		void step(const std::vector<uint32_t>& from, uint8_t c, marks& m, std::vector<uint32_t>& dst) const
+		{
+			m.next();
+			dst.clear();
+			for (auto s : restart)
+			{
+				m.visit(s);
+				dst.push_back(s);
+			}
+			for (auto s : from)
+			{
+				const auto& i = states[s];
+				if (i.kind == state_kind::set && set_has(sets[i.arg], c))
+				{
+					closure(dst, m, i.out, false, false);
+				}
+			}
+		}
+
+		uint8_t flags_of(const std::vector<uint32_t>& set, marks& m, std::vector<uint32_t>& tail) const
+		{
+			uint8_t r = set.empty() ? dfa_dead : 0;
+			tail.clear();
+			m.next();
+			for (auto s : set)
+			{
+				if (states[s].kind == state_kind::match) return dfa_accept;
+				if (states[s].kind == state_kind::end) closure(tail, m, states[s].out, false, true);
+			}
+			for (auto s : tail)
+			{
+				if (states[s].kind == state_kind::match) return r | dfa_end_accept;
+			}
+			return r;
+		}
+
+		void build(const str_view& value, bool icase)
+		{
+			parser p{value.begin(), value.end(), icase};
+			const auto root = p.parse();
+			literal = p.required_literal(root);
+			sets = std::move(p.sets);
+
+			const auto match = emit_state({state_kind::match});
+			start = emit(p.nodes, root, match);
+
+			auto count = 1U;
+			for (const auto& s : sets)
+			{
+				std::array<int, 512> remap;
+				remap.fill(-1);
+				auto next = 0U;
+				for (auto c = 0U; c < 256; ++c)
+				{
+					auto& r = remap[classes[c] * 2 + set_has(s, uint8_t(c))];
+					if (r < 0) r = int(next++);
+					classes[c] = uint8_t(r);
+				}
+				count = next;
+			}
+			classes_count = count;
+
+			marks m(states.size());
+			m.next();
+			closure(restart, m, start, false, false);
+			m.next();
+			closure(initial, m, start, true, false);
+			std::vector<uint32_t> empty_set;
+			m.next();
+			closure(empty_set, m, start, true, true);
+			empty_match = std::any_of(empty_set.begin(), empty_set.end(), [&](uint32_t s) { return states[s].kind == state_kind::match; });
+			dfa = build_dfa(m);
+		}
+
+		// Subset construction done eagerly, so searching never mutates anything
+		bool build_dfa(marks& m)
+		{
+			std::array<uint8_t, 256> representatives{};
+			for (auto c = 256U; c-- > 0;) representatives[classes[c]] = uint8_t(c);
+
+			std::map<std::vector<uint32_t>, uint32_t> known;
+			std::vector<const std::vector<uint32_t>*> pending;
+			const auto intern = [&](std::vector<uint32_t> set)
+			{
+				std::sort(set.begin(), set.end());
+				auto r = known.emplace(std::move(set), uint32_t(pending.size()));
+				if (r.second) pending.push_back(&r.first->first);
+				return r.first->second;
+			};
+
+			intern(initial);
+			std::vector<uint32_t> next, tail;
+			auto work = 0ULL;
+			for (auto i = 0U; i < pending.size(); ++i)
+			{
+				if (pending.size() > dfa_states_limit || work > dfa_work_limit)
+				{
+					transitions.clear();
+					flags.clear();
+					return false;
+				}
+
+				const auto& set = *pending[i];
+				flags.push_back(flags_of(set, m, tail));
+				transitions.resize(transitions.size() + classes_count, i);
+				if (flags.back() & (dfa_accept | dfa_dead)) continue;
+				for (auto k = 0U; k < classes_count; ++k)
+				{
+					step(set, representatives[k], m, next);
+					transitions[i * classes_count + k] = intern(next);
+					work += set.size() + next.size();
+				}
+			}
+			return true;
+		}
+
+		bool search_dfa(const str_view& s) const
+		{
+			auto state = 0U;
+			if (flags[0] & dfa_accept) return true;
+			for (auto c : s)
+			{
+				state = transitions[state * classes_count + classes[uint8_t(c)]];
+				const auto f = flags[state];
+				if (f & dfa_accept) return true;
+				if (f & dfa_dead) return false;
+			}
+			return flags[state] & dfa_end_accept;
+		}
+
+		bool search_nfa(const str_view& s) const
+		{
+			auto& t = thread_scratch(states.size());
+			t.current = initial;
+			for (auto c : s)
+			{
+				if (flags_of(t.current, t.m, t.tail) & (dfa_accept | dfa_dead)) return !t.current.empty();
+				step(t.current, uint8_t(c), t.m, t.next);
+				std::swap(t.current, t.next);
+			}
+			return flags_of(t.current, t.m, t.tail) & (dfa_accept | dfa_end_accept);
+		}
+
+		bool search(const str_view& s) const
+		{
+			if (!automaton) return std::regex_search(s.begin(), s.end(), fallback);
+			if (s.empty()) return empty_match;
+			return dfa ? search_dfa(s) : search_nfa(s);
+		}
+	};
+
+	namespace
+	{
+		// Compiled patterns by flags and text. Holds weak references only, expired entries are swept once map doubles.
+		struct compiled_cache
+		{
+			std::mutex mutex;
+			std::unordered_map<std::string, std::weak_ptr<const pattern::impl>> entries;
+			size_t sweep_at = 64;
+			uint64_t hits{};
+			uint64_t misses{};
+			int64_t compile_time{};
+		};
+
+		compiled_cache& get_compiled_cache()
+		{
+			static compiled_cache ret;
+			return ret;
+		}
+	}
+
+	pattern pattern::compile(const str_view& value, bool icase)
+	{
+		pattern ret;
+		if (value.empty()) return ret;
+
+		auto key = value.str();
+		key.push_back(icase ? 'i' : '-');
+		auto& cache = get_compiled_cache();
+		{
+			std::unique_lock lock(cache.mutex);
+			const auto f = cache.entries.find(key);
+			if (f != cache.entries.end() && (ret.impl_ = f->second.lock()))
+			{
+				++cache.hits;
+				return ret;
+			}
+		}
+
+		// Compiled without holding the lock, two threads racing for the same pattern just do the work twice
+		const auto time_start = perf_counter_now();
+		const auto r = std::make_shared<impl>();
+		try
+		{
+			r->build(value, icase);
+			r->automaton = true;
+		}
+		catch (const unsupported&)
+		{
+			// Invalid patterns end up here as well, and std::regex reports them properly
+			auto flags = std::regex_constants::ECMAScript | std::regex_constants::optimize | std::regex_constants::nosubs;
+			if (icase) flags |= std::regex_constants::icase;
+			r->fallback = std::regex{value.str(), flags};
+		}
+		ret.impl_ = r;
+
+		std::unique_lock lock(cache.mutex);
+		++cache.misses;
+		cache.compile_time += perf_counter_now() - time_start;
+		cache.entries[std::move(key)] = r;
+		if (cache.entries.size() >= cache.sweep_at)
+		{
+			std::erase_if(cache.entries, [](const auto& i) { return i.second.expired(); });
+			cache.sweep_at = std::max(size_t(64), cache.entries.size() * 2);
+		}
+		return ret;
+	}
+
+	pattern::cache_stats pattern::stats()
+	{
+		auto& cache = get_compiled_cache();
+		std::unique_lock lock(cache.mutex);
+		return {cache.hits, cache.misses, uint64_t(cache.compile_time * 1000000 / perf_counter_frequency()), cache.entries.size()};
+	}
+
+	bool pattern::search(const str_view& s) const
+	{
+		return !impl_ || impl_->search(s);
+	}
+
+	bool pattern::compiled() const noexcept
+	{
+		return impl_ && impl_->automaton;
+	}
+
+	struct pattern_set::impl
+	{
+		std::vector<pattern> patterns;
+
+		// Patterns without a usable literal are always candidates
+		mask unconditional;
+
+		// Aho-Corasick goto function with failure links resolved, over classes of lowercase bytes
+		std::array<uint8_t, 256> classes{};
+		uint32_t classes_count{};
+		std::vector<uint32_t> transitions;
+		std::vector<std::vector<uint32_t>> outputs;
+
+		void build()
+		{
+			const auto words = (patterns.size() + 63) / 64;
+			unconditional.assign(words, 0);
+
+			std::vector<const std::string*> literals(patterns.size());
+			for (auto i = 0U; i < patterns.size(); ++i)
+			{
+				const auto& p = patterns[i].impl_;
+				if (!p || p->literal.empty()) unconditional[i >> 6] |= 1ULL << (i & 63);
+				else literals[i] = &p->literal;
+			}
+
+			classes_count = 1;
+			for (auto l : literals)
+			{
+				if (!l) continue;
+				for (auto c : *l)
+				{
+					if (!classes[uint8_t(c)]) classes[uint8_t(c)] = uint8_t(classes_count++);
+				}
+			}
+			for (auto c = 'A'; c <= 'Z'; ++c) classes[uint8_t(c)] = classes[uint8_t(c | 0x20)];
+
+			// Trie first, missing transitions are 0 until failure links fill them in
+			transitions.assign(classes_count, 0);
+			outputs.emplace_back();
+			for (auto i = 0U; i < literals.size(); ++i)
+			{
+				if (!literals[i]) continue;
+				auto state = 0U;
+				for (auto c : *literals[i])
+				{
+					auto& next = transitions[state * classes_count + classes[uint8_t(c)]];
+					if (!next)
+					{
+						next = uint32_t(outputs.size());
+						outputs.emplace_back();
+						transitions.resize(transitions.size() + classes_count, 0);
+					}
+					state = transitions[state * classes_count + classes[uint8_t(c)]];
+				}
+				outputs[state].push_back(i);
+			}
+
+			std::vector<uint32_t> fail(outputs.size()), queue;
+			for (auto k = 1U; k < classes_count; ++k)
+			{
+				if (transitions[k]) queue.push_back(transitions[k]);
+			}
+			for (auto q = 0U; q < queue.size(); ++q)
+			{
+				const auto state = queue[q];
+				const auto& inherited = outputs[fail[state]];
+				outputs[state].insert(outputs[state].end(), inherited.begin(), inherited.end());
+				for (auto k = 1U; k < classes_count; ++k)
+				{
+					auto& next = transitions[state * classes_count + k];
+					const auto fallback = transitions[fail[state] * classes_count + k];
+					if (next)
+					{
+						fail[next] = fallback;
+						queue.push_back(next);
+					}
+					else
+					{
+						next = fallback;
+					}
+				}
+			}
+		}
+
+		void search(const str_view& s, mask& dst) const
+		{
+			dst = unconditional;
+			if (outputs.size() > 1)
+			{
+				auto state = 0U;
+				for (auto c : s)
+				{
+					state = transitions[state * classes_count + classes[uint8_t(c)]];
+					for (auto i : outputs[state]) dst[i >> 6] |= 1ULL << (i & 63);
+				}
+			}
+
+			for (auto w = 0U; w < dst.size(); ++w)
+			{
+				for (auto bits = dst[w]; bits; bits &= bits - 1)
+				{
+					const auto i = w * 64 + std::countr_zero(bits);
+					if (!patterns[i].search(s)) dst[w] &= ~(1ULL << (i & 63));
+				}
+			}
+		}
+	};
+
+	pattern_set::pattern_set(std::vector<pattern> patterns)
+	{
+		if (patterns.empty()) return;
+		const auto r = std::make_shared<impl>();
+		r->patterns = std::move(patterns);
+		r->build();
+		impl_ = r;
+	}
+
+	size_t pattern_set::size() const noexcept
+	{
+		return impl_ ? impl_->patterns.size() : 0;
+	}
+
+	void pattern_set::search(const str_view& s, mask& dst) const
+	{
+		if (impl_) impl_->search(s, dst);
+		else dst.clear();
+	}
+
+	bool url_verdict_cache::lookup(const key& k, url_verdict::part part, url_verdict& dst) noexcept
+	{
+		auto& e = entries_[k.hash % entries_.size()];
+		const auto seq = e.seq.load(std::memory_order_acquire);
+		if (!(seq & 1) && e.hash.load(std::memory_order_relaxed) == k.hash && e.generation.load(std::memory_order_relaxed) == k.generation)
+		{
+			url_verdict r;
+			r.known = e.known.load(std::memory_order_relaxed);
+			r.blocked = e.blocked.load(std::memory_order_relaxed);
+			r.headers_mask = e.headers_mask.load(std::memory_order_relaxed);
+			r.css_mask = e.css_mask.load(std::memory_order_relaxed);
+			r.js_mask = e.js_mask.load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (e.seq.load(std::memory_order_relaxed) == seq && (r.known & part))
+			{
+				dst = r;
+				hits.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	void url_verdict_cache::store(const key& k, url_verdict::part part, const url_verdict& v) noexcept
+	{
+		auto& e = entries_[k.hash % entries_.size()];
+		auto seq = e.seq.load(std::memory_order_relaxed);
+		if ((seq & 1) || !e.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) return;
+		std::atomic_thread_fence(std::memory_order_release);
+
+		auto known = uint8_t(part);
+		if (e.hash.load(std::memory_order_relaxed) == k.hash && e.generation.load(std::memory_order_relaxed) == k.generation)
+		{
+			known |= e.known.load(std::memory_order_relaxed);
+		}
+		else
+		{
+			e.hash.store(k.hash, std::memory_order_relaxed);
+			e.generation.store(k.generation, std::memory_order_relaxed);
+		}
+		e.known.store(known, std::memory_order_relaxed);
+		switch (part)
+		{
+			case url_verdict::filter: e.blocked.store(v.blocked, std::memory_order_relaxed); break;
+			case url_verdict::headers: e.headers_mask.store(v.headers_mask, std::memory_order_relaxed); break;
+			case url_verdict::css: e.css_mask.store(v.css_mask, std::memory_order_relaxed); break;
+			case url_verdict::js: e.js_mask.store(v.js_mask, std::memory_order_relaxed); break;
+		}
+		e.seq.store(seq + 2, std::memory_order_release);
+	}
+
+	static bool any_matched(const pattern_set::mask& m)
+	{
+		return std::any_of(m.begin(), m.end(), [](uint64_t v) { return v != 0; });
+	}
+
+	std::string injection_payloads::assemble(const std::string& color_scheme, const entries& css, const pattern_set::mask& css_matched,
+		const entries& js, const pattern_set::mask& js_matched)
+	{
+		auto size = color_scheme.size();
+		if (any_matched(css_matched))
+		{
+			size += std::char_traits<char>::length("<style></style>");
+			for (auto i = 0U; i < css.size(); ++i)
+			{
+				if (pattern_set::test(css_matched, i)) size += css[i].second.size();
+			}
+		}
+		if (any_matched(js_matched))
+		{
+			size += std::char_traits<char>::length("<script></script>");
+			for (auto i = 0U; i < js.size(); ++i)
+			{
+				if (pattern_set::test(js_matched, i)) size += js[i].second.size() + 1;
+			}
+		}
+
+		std::string ret;
+		ret.reserve(size);
+		ret = color_scheme;
+		if (any_matched(css_matched))
+		{
+			ret += "<style>";
+			for (auto i = 0U; i < css.size(); ++i)
+			{
+				if (pattern_set::test(css_matched, i)) ret += css[i].second;
+			}
+			ret += "</style>";
+		}
+		if (any_matched(js_matched))
+		{
+			ret += "<script>";
+			for (auto i = 0U; i < js.size(); ++i)
+			{
+				if (!pattern_set::test(js_matched, i)) continue;
+				ret += js[i].second;
+				ret.push_back(';');
+			}
+			ret += "</script>";
+		}
+		return ret;
+	}
+
+	std::shared_ptr<const std::string> injection_payloads::get(uint32_t generation, const std::string& color_scheme, const entries& css,
+		const pattern_set::mask& css_matched, const entries& js, const pattern_set::mask& js_matched)
+	{
+		if (color_scheme.empty() && !any_matched(css_matched) && !any_matched(js_matched)) return nullptr;
+		if (css_matched.size() > 1 || js_matched.size() > 1)
+		{
+			return std::make_shared<const std::string>(assemble(color_scheme, css, css_matched, js, js_matched));
+		}
+
+		const slot key{generation, css_matched.empty() ? 0ULL : css_matched[0], js_matched.empty() ? 0ULL : js_matched[0], {}};
+		{
+			std::unique_lock lock(mutex_);
+			for (const auto& e : slots_)
+			{
+				if (e.payload && e.generation == key.generation && e.css_mask == key.css_mask && e.js_mask == key.js_mask) return e.payload;
+			}
+		}
+
+		// Assembling outside of lock: two threads racing for the same combination would both store it, which is harmless
+		auto ret = std::make_shared<const std::string>(assemble(color_scheme, css, css_matched, js, js_matched));
+		std::unique_lock lock(mutex_);
+		auto& s = slots_[next_++ % slots_.size()];
+		s = key;
+		s.payload = ret;
+		return ret;
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+namespace utils
+{
+	// Compiled URL pattern: ECMAScript syntax subset (literals, classes, groups, alternation, quantifiers, ^ and $)
+	// is turned into a Thompson NFA and then into a DFA over byte classes, so matching is linear and does not
+	// backtrack. Patterns using anything else (backreferences, lookarounds, \b and such) fall back to std::regex.
+	// Compiled instance is immutable and can be searched from any thread.
+	struct pattern
+	{
+		// Default pattern is empty and matches everything
+		pattern() = default;
+
+		// Throws std::regex_error if pattern is invalid. Compiled patterns are shared process-wide: compiling the same text
+		// with the same flags again returns existing instance for as long as anything still holds it.
+		static pattern compile(const str_view& value, bool icase = true);
+
+		struct cache_stats
+		{
+			uint64_t hits;
+			uint64_t misses;
+			uint64_t compile_time_us;
+			uint64_t entries;
+		};
+
+		static cache_stats stats();
+
+		bool empty() const noexcept { return !impl_; }
+		bool search(const str_view& s) const;
+
+		// True if pattern was turned into an automaton, false if it uses std::regex
+		bool compiled() const noexcept;
+
+		// True if both refer to the same compiled instance
+		bool same_instance(const pattern& other) const noexcept { return impl_ == other.impl_; }
+
+		struct impl;
+
+	private:
+		friend struct pattern_set;
+		std::shared_ptr<const impl> impl_;
+	};
+
+	// Patterns matched together in a single pass: Aho-Corasick automaton over literals each pattern requires
+	// finds candidates, and only those run their own automaton. Immutable, like pattern itself.
+	struct pattern_set
+	{
+		using mask = std::vector<uint64_t>;
+
+		pattern_set() = default;
+		explicit pattern_set(std::vector<pattern> patterns);
+
+		size_t size() const noexcept;
+		bool empty() const noexcept { return size() == 0; }
+
+		// Sets bit N of dst if pattern N matches, dst is resized as needed
+		void search(const str_view& s, mask& dst) const;
+
+		static bool test(const mask& m, size_t index) noexcept { return (m[index >> 6] >> (index & 63)) & 1; }
+
+		struct impl;
+
+	private:
+		std::shared_ptr<const impl> impl_;
+	};
+
+	// Outcome of URL rules for a single URL. Parts are filled independently, as different callbacks need different ones
+	struct url_verdict
+	{
+		enum part : uint8_t
+		{
+			filter = 1,
+			headers = 2,
+			css = 4,
+			js = 8,
+		};
+
+		uint8_t known{};
+		bool blocked{};
+		uint64_t headers_mask{};
+		uint64_t css_mask{};
+		uint64_t js_mask{};
+	};
+
+	// Fixed-size direct-mapped cache of URL verdicts keyed by URL hash. Entries are tagged with configuration generation,
+	// so bumping it invalidates everything at once. Each entry is guarded by a sequence counter: readers treat a copy
+	// torn by concurrent write as a miss, writers skip storing if entry is being written by another thread.
+	struct url_verdict_cache
+	{
+		struct key
+		{
+			uint64_t hash;
+			uint32_t generation;
+		};
+
+		bool lookup(const key& k, url_verdict::part part, url_verdict& dst) noexcept;
+
+		// Stores given part of verdict, keeping other parts already known for the same URL
+		void store(const key& k, url_verdict::part part, const url_verdict& v) noexcept;
+
+		std::atomic<uint64_t> hits{};
+		std::atomic<uint64_t> misses{};
+
+	private:
+		struct entry
+		{
+			std::atomic<uint32_t> seq;
+			std::atomic<uint32_t> generation;
+			std::atomic<uint64_t> hash;
+			std::atomic<uint8_t> known;
+			std::atomic<bool> blocked;
+			std::atomic<uint64_t> headers_mask;
+			std::atomic<uint64_t> css_mask;
+			std::atomic<uint64_t> js_mask;
+		};
+
+		std::array<entry, 256> entries_{};
+	};
+
+	// Payloads for html_injector assembled from code of matched injection rules: color scheme, then CSS rules in `<style>`
+	// and JS rules in `<script>`, with tags left out if no rule of their set matched. Combinations of up to 64 rules per set
+	// are memoized by rules generation and masks in a few slots, so all responses injecting the same thing share a buffer,
+	// larger ones are assembled each time.
+	struct injection_payloads : noncopyable
+	{
+		using entries = std::vector<std::pair<pattern, std::string>>;
+
+		// Null if there is nothing to inject
+		std::shared_ptr<const std::string> get(uint32_t generation, const std::string& color_scheme, const entries& css,
+			const pattern_set::mask& css_matched, const entries& js, const pattern_set::mask& js_matched);
+
+		static std::string assemble(const std::string& color_scheme, const entries& css, const pattern_set::mask& css_matched,
+			const entries& js, const pattern_set::mask& js_matched);
+
+	private:
+		struct slot
+		{
+			uint32_t generation{};
+			uint64_t css_mask{};
+			uint64_t js_mask{};
+			std::shared_ptr<const std::string> payload;
+		};
+
+		std::mutex mutex_;
+		std::array<slot, 8> slots_;
+		uint32_t next_{};
+	};
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -18,3 +20,6 @@
 #include <Shlwapi.h>
 #include <windows.h>
 
+#else
+#include "platform_posix.h"
+#endif
@@ -0,0 +1,149 @@
+#pragma once
+
+// Stand-ins for the few Win32 functions protocol and matching code uses, so that util.cpp and pattern.cpp can be built and
+// tested on Linux. Named file mappings are backed by POSIX shared memory and can be opened from other processes as well.
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define __pragma(x)
+
+typedef void* HANDLE;
+typedef void* LPVOID;
+typedef uint32_t DWORD;
+typedef int BOOL;
+
+union LARGE_INTEGER
+{
+	int64_t QuadPart;
+};
+
+#define FALSE 0
+#define INVALID_HANDLE_VALUE ((HANDLE)(intptr_t)-1)
+#define PAGE_READWRITE 0x04
+#define FILE_MAP_WRITE 0x02
+#define FILE_MAP_READ 0x04
+
+inline int _strnicmp(const char* a, const char* b, size_t n) { return strncasecmp(a, b, n); }
+inline int _wcsnicmp(const wchar_t* a, const wchar_t* b, size_t n) { return wcsncasecmp(a, b, n); }
+inline int vsprintf_s(char* buffer, size_t size, const char* format, va_list args) { return vsnprintf(buffer, size, format, args); }
+inline void OutputDebugStringA(const char* msg) { fputs(msg, stderr); }
+inline DWORD GetLastError() { return DWORD(errno); }
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER* ret)
+{
+	timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ret->QuadPart = int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+	return 1;
+}
+
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER* ret)
+{
+	ret->QuadPart = 1000000000LL;
+	return 1;
+}
+
+// Only ASCII names and values are expected here
+inline DWORD GetEnvironmentVariableW(const wchar_t* key, wchar_t* buffer, DWORD size)
+{
+	std::string name;
+	for (; *key; ++key) name.push_back(char(*key));
+	const auto value = getenv(name.c_str());
+	if (!value) return 0;
+	const auto length = strlen(value);
+	if (length >= size) return DWORD(length + 1);
+	for (auto i = 0ULL; i <= length; ++i) buffer[i] = wchar_t(uint8_t(value[i]));
+	return DWORD(length);
+}
+
+struct posix_mapping
+{
+	int fd;
+	std::string name;
+	bool created;
+
+	// Windows drops a named mapping with its last handle, here the name goes away once its creator closes it
+	static std::string shm_name(const wchar_t* name)
+	{
+		std::string ret{"/"};
+		for (; *name; ++name) ret.push_back(*name == L'/' || *name == L'\\' || *name > 0x7f ? '_' : char(*name));
+		return ret;
+	}
+
+	// MapViewOfFile() callers do not keep the size, munmap() needs it
+	static std::unordered_map<void*, size_t>& views(std::unique_lock<std::mutex>& lock)
+	{
+		static std::mutex mutex;
+		static std::unordered_map<void*, size_t> ret;
+		lock = std::unique_lock(mutex);
+		return ret;
+	}
+};
+
+inline HANDLE CreateFileMappingW(HANDLE, void*, DWORD, DWORD size_high, DWORD size_low, const wchar_t* name)
+{
+	auto name_str = posix_mapping::shm_name(name);
+	const auto fd = shm_open(name_str.c_str(), O_CREAT | O_RDWR, 0600);
+	if (fd < 0) return nullptr;
+	const auto size = off_t(uint64_t(size_high) << 32 | size_low);
+	struct stat st{};
+	if (fstat(fd, &st) != 0 || (st.st_size < size && ftruncate(fd, size) != 0))
+	{
+		close(fd);
+		return nullptr;
+	}
+	return new posix_mapping{fd, std::move(name_str), true};
+}
+
+inline HANDLE OpenFileMappingW(DWORD, BOOL, const wchar_t* name)
+{
+	auto name_str = posix_mapping::shm_name(name);
+	const auto fd = shm_open(name_str.c_str(), O_RDWR, 0600);
+	if (fd < 0) return nullptr;
+	return new posix_mapping{fd, std::move(name_str), false};
+}
+
+inline LPVOID MapViewOfFile(HANDLE handle, DWORD, DWORD, DWORD, size_t size)
+{
+	const auto ret = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, ((posix_mapping*)handle)->fd, 0);
+	if (ret == MAP_FAILED) return nullptr;
+	std::unique_lock<std::mutex> lock;
+	posix_mapping::views(lock)[ret] = size;
+	return ret;
+}
+
+inline BOOL UnmapViewOfFile(LPVOID view)
+{
+	std::unique_lock<std::mutex> lock;
+	auto& views = posix_mapping::views(lock);
+	const auto f = views.find(view);
+	if (f == views.end()) return 0;
+	munmap(view, f->second);
+	views.erase(f);
+	return 1;
+}
+
+inline BOOL CloseHandle(HANDLE handle)
+{
+	const auto mapping = (posix_mapping*)handle;
+	close(mapping->fd);
+	if (mapping->created) shm_unlink(mapping->name.c_str());
+	delete mapping;
+	return 1;
+}
@@ -1,5 +1,9 @@
+#include <bit>
+#include <cmath>
+#include <emmintrin.h>
 #include <cstdarg>
 #include <memory>
+#include <random>
 
 #include "platform.h"
 #include "util.h"
@@ -20,28 +24,6 @@ void __log_message(const char* msg, ...)
 
 namespace utils
 {
-	inline double pow10(int n)
-	{
-		auto ret = 1.0;
-		auto r = 10.0;
-		if (n < 0)
-		{
-			n = -n;
-			r = 0.1;
-		}
-
-		while (n)
-		{
-			if (n & 1)
-			{
-				ret *= r;
-			}
-			r *= r;
-			n >>= 1;
-		}
-		return ret;
-	}
-
 	template<typename T>
 	bool is_digit(T c, int& v)
 	{
@@ -49,114 +31,6 @@ namespace utils
 		return v >= 0 && v <= 9;
 	}
 
-	template<typename T>
-	double parse_gen(const T*& c, const T* ce, double d)
-	{
-		if (!c || c == ce)
-		{
-			return d;
-		}
-
-		auto sign = 1;
-		auto int_part = 0.0;
-		auto frac_part = 0.0;
-		auto has_frac = false;
-		auto has_exp = false;
-
-		// +/- sign
-		if (*c == '-')
-		{
-			++c;
-			sign = -1;
-		}
-		else if (*c == '+')
-		{
-			++c;
-		}
-
-		auto s = c;
-		int v;
-		while (true)
-		{
-			auto h = c == ce ? '\0' : *c;
-			if (is_digit(h, v))
-			{
-				int_part = int_part * 10 + v;
-			}
-			else if (h == '.')
-			{
-				has_frac = true;
-				++c;
-				break;
-			}
-			else if (h == 'e' || h == 'E')
-			{
-				has_exp = true;
-				++c;
-				break;
-			}
-			else
-			{
-				return s == c ? d : sign * int_part;
-			}
-			++c;
-		}
-
-		if (has_frac)
-		{
-			auto frac_exp = 0.1;
-			while (true)
-			{
-				auto h = c == ce ? '\0' : *c;
-				if (is_digit(h, v))
-				{
-					frac_part += frac_exp * v;
-					frac_exp *= 0.1;
-				}
-				else if (h == 'e' || h == 'E')
-				{
-					has_exp = true;
-					++c;
-					break;
-				}
-				else
-				{
-					return sign * (int_part + frac_part);
-				}
-				++c;
-			}
-		}
-
-		// parsing exponent part
-		auto exp_part = 1.0;
-		if (has_exp)
-		{
-			auto exp_sign = 1;
-			auto h = c == ce ? '\0' : *c;
-			if (h == '-')
-			{
-				exp_sign = -1;
-				h = *++c;
-			}
-			else if (h == '+')
-			{
-				h = *++c;
-			}
-
-			auto e = 0;
-			while (is_digit(h, v))
-			{
-				e = e * 10 + v;
-				++c;
-				h = c == ce ? '\0' : *c;
-			}
-
-			exp_part = pow10(exp_sign * e);
-		}
-
-		return sign * (int_part + frac_part) * exp_part;
-	}
-
 	#define HN 16
 	static constexpr uint64_t hextable[] = {
 		HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN, HN,
@@ -249,6 +123,36 @@ namespace utils
 		return c == start ? d : int64_t(ret) * sign;
 	}
 
+	// Exact, rounded to nearest: digits go through std::from_chars, only sign, hex integers and trailing garbage are handled here.
+	// Values out of range of T, like inf and nan, return default
+	template<typename T>
+	T parse_float(const char* c, const char* ce, T d)
+	{
+		if (!c || c == ce) return d;
+
+		auto negative = false;
+		if (*c == '-' || *c == '+')
+		{
+			negative = *c == '-';
+			++c;
+		}
+
+		if (c + 2 < ce && c[0] == '0' && (c[1] == 'x' || c[1] == 'X'))
+		{
+			c += 2;
+			const auto ret = T(parse_gen_hex(c, ce));
+			return negative ? -ret : ret;
+		}
+
+		// Leaves out inf and nan, and a second sign
+		int v;
+		if (c == ce || (!is_digit(*c, v) && *c != '.')) return d;
+
+		T ret;
+		if (std::from_chars(c, ce, ret).ec != std::errc{}) return d;
+		return negative ? -ret : ret;
+	}
+
 	bool char_matches_str(char c, const std::string& cs)
 	{
 		for (const auto i : cs)
@@ -272,26 +176,120 @@ namespace utils
 
 	float str_view::as(float d) const
 	{
-		auto s = data();
-		return float(parse_gen(s, s + size(), d));
+		return parse_float(data(), data() + size(), d);
+	}
+
+	double str_view::as(double d) const
+	{
+		return parse_float(data(), data() + size(), d);
 	}
 
-	size_t str_view::find_first_of(const std::string& cs, const size_t index) const noexcept
+	size_t str_view::find_first_of_set(const char* cs, size_t cs_len, size_t index) const noexcept
 	{
-		for (auto i = index; i < length_; ++i)
+		if (index >= length_ || cs_len == 0) return std::string::npos;
+		if (cs_len == 1) return find_first_of(cs[0], index);
+
+		auto i = index;
+		if (cs_len <= 4)
+		{
+			// Few characters, as with most separators: compare 16 bytes against each of them at once
+			const auto c0 = _mm_set1_epi8(cs[0]);
+			const auto c1 = _mm_set1_epi8(cs[1]);
+			const auto c2 = _mm_set1_epi8(cs[cs_len > 2 ? 2 : 1]);
+			const auto c3 = _mm_set1_epi8(cs[cs_len - 1]);
+			for (; i + 16 <= length_; i += 16)
+			{
+				const auto v = _mm_loadu_si128((const __m128i*)&data_[i]);
+				const auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+					_mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+				if (const auto mask = uint32_t(_mm_movemask_epi8(m)))
+				{
+					return i + std::countr_zero(mask);
+				}
+			}
+		}
+
+		std::array<uint64_t, 4> set{};
+		for (auto j = 0ULL; j < cs_len; ++j)
 		{
-			if (char_matches_str(data_[i], cs)) return i;
+			const auto c = uint8_t(cs[j]);
+			set[c >> 6] |= 1ULL << (c & 63);
+		}
+		for (; i < length_; ++i)
+		{
+			const auto c = uint8_t(data_[i]);
+			if (set[c >> 6] & (1ULL << (c & 63))) return i;
+		}
+		return std::string::npos;
+	}
+
+	size_t str_view::find_last_of_set(const char* cs, size_t cs_len, size_t index) const noexcept
+	{
+		auto i = size_min(index, length_);
+		if (cs_len == 0) return std::string::npos;
+
+		if (cs_len <= 4)
+		{
+			// Same as in find_first_of_set(), going backwards: highest set bit is the last match in a block
+			const auto c0 = _mm_set1_epi8(cs[0]);
+			const auto c1 = _mm_set1_epi8(cs[cs_len > 1 ? 1 : 0]);
+			const auto c2 = _mm_set1_epi8(cs[cs_len > 2 ? 2 : 0]);
+			const auto c3 = _mm_set1_epi8(cs[cs_len - 1]);
+			for (; i >= 16; i -= 16)
+			{
+				const auto v = _mm_loadu_si128((const __m128i*)&data_[i - 16]);
+				const auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, c0), _mm_cmpeq_epi8(v, c1)),
+					_mm_or_si128(_mm_cmpeq_epi8(v, c2), _mm_cmpeq_epi8(v, c3)));
+				if (const auto mask = uint32_t(_mm_movemask_epi8(m)))
+				{
+					return i - 16 + std::bit_width(mask);
+				}
+			}
+		}
+
+		std::array<uint64_t, 4> set{};
+		for (auto j = 0ULL; j < cs_len; ++j)
+		{
+			const auto c = uint8_t(cs[j]);
+			set[c >> 6] |= 1ULL << (c & 63);
+		}
+		for (; i > 0; --i)
+		{
+			const auto c = uint8_t(data_[i - 1]);
+			if (set[c >> 6] & (1ULL << (c & 63))) return i;
 		}
 		return std::string::npos;
 	}
 
 	size_t str_view::find_cstrl(const char* c, size_t c_len, size_t index) const
 	{
-		if (index >= length_) return std::string::npos;
-		if (index + c_len > length_) return std::string::npos;
-		if (index + c_len == length_) return memcmp(&data_[index], c, c_len) == 0;
-		const auto s = std::search(&data_[index], end(), c, c + c_len);
-		return s == end() ? std::string::npos : s - begin();
+		if (index >= length_ || c_len > length_ - index) return std::string::npos;
+		if (c_len == 0) return index;
+		if (c_len == 1) return find_first_of(c[0], index);
+
+		// Candidates are positions where both first and last characters of needle match, 16 at a time, so that neither
+		// frequent first characters nor short URLs cost a call per candidate
+		const auto d = data_;
+		const auto last = length_ - c_len;
+		const auto head = _mm_set1_epi8(c[0]);
+		const auto tail = _mm_set1_epi8(c[c_len - 1]);
+		auto i = index;
+		for (; i + 16 <= last + 1; i += 16)
+		{
+			const auto a = _mm_loadu_si128((const __m128i*)&d[i]);
+			const auto b = _mm_loadu_si128((const __m128i*)&d[i + c_len - 1]);
+			for (auto mask = uint32_t(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, head), _mm_cmpeq_epi8(b, tail)))); mask;
+				mask &= mask - 1)
+			{
+				const auto p = i + std::countr_zero(mask);
+				if (memcmp(&d[p + 1], c + 1, c_len - 2) == 0) return p;
+			}
+		}
+		for (; i <= last; ++i)
+		{
+			if (d[i] == c[0] && d[i + c_len - 1] == c[c_len - 1] && memcmp(&d[i + 1], c + 1, c_len - 2) == 0) return i;
+		}
+		return std::string::npos;
 	}
 
 	size_t str_view::find(const char* c, size_t index) const
@@ -366,39 +364,485 @@ namespace utils
 		return os;
 	}
 
-	std::string utf8_r(const wchar_t* s, size_t len)
+	// Both directions run as a single pass either counting or writing, so computed sizes always match what gets written
+	template<bool Write, typename C>
+	size_t utf8_convert(const C* s, size_t len, char* out) noexcept
 	{
-		std::string result;
-		if (s && len > 0)
+		auto o = 0ULL;
+		for (auto i = 0ULL; i < len;)
 		{
-			result.resize(len);
-			auto r = WideCharToMultiByte(CP_UTF8, 0, s, int(len), result.data(), int(result.size()), nullptr, nullptr);
-			if (r == 0)
+			if constexpr (sizeof(C) == 2)
+			{
+				if (i + 8 <= len)
+				{
+					const auto v = _mm_loadu_si128((const __m128i*)&s[i]);
+					if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(short(0xff80))), _mm_setzero_si128())) == 0xffff)
+					{
+						if constexpr (Write) _mm_storel_epi64((__m128i*)&out[o], _mm_packus_epi16(v, v));
+						i += 8;
+						o += 8;
+						continue;
+					}
+				}
+			}
+
+			auto c = uint32_t(s[i++]);
+			if (c >= 0xd800 && c < 0xe000)
+			{
+				if (c < 0xdc00 && i < len && uint32_t(s[i]) >= 0xdc00 && uint32_t(s[i]) < 0xe000)
+				{
+					c = 0x10000 + ((c - 0xd800) << 10) + (uint32_t(s[i++]) - 0xdc00);
+				}
+				else
+				{
+					c = 0xfffd;
+				}
+			}
+			else if (c > 0x10ffff)
+			{
+				c = 0xfffd;
+			}
+
+			if (c < 0x80)
+			{
+				if constexpr (Write) out[o] = char(c);
+				o += 1;
+			}
+			else if (c < 0x800)
 			{
-				result.resize(WideCharToMultiByte(CP_UTF8, 0, s, int(len), nullptr, 0, nullptr, nullptr));
-				r = WideCharToMultiByte(CP_UTF8, 0, s, int(len), result.data(), int(result.size()), nullptr, nullptr);
+				if constexpr (Write)
+				{
+					out[o] = char(0xc0 | c >> 6);
+					out[o + 1] = char(0x80 | (c & 0x3f));
+				}
+				o += 2;
+			}
+			else if (c < 0x10000)
+			{
+				if constexpr (Write)
+				{
+					out[o] = char(0xe0 | c >> 12);
+					out[o + 1] = char(0x80 | (c >> 6 & 0x3f));
+					out[o + 2] = char(0x80 | (c & 0x3f));
+				}
+				o += 3;
+			}
+			else
+			{
+				if constexpr (Write)
+				{
+					out[o] = char(0xf0 | c >> 18);
+					out[o + 1] = char(0x80 | (c >> 12 & 0x3f));
+					out[o + 2] = char(0x80 | (c >> 6 & 0x3f));
+					out[o + 3] = char(0x80 | (c & 0x3f));
+				}
+				o += 4;
+			}
+		}
+		return o;
+	}
+
+	template<bool Write, typename C>
+	size_t utf16_convert(const char* s, size_t len, C* out) noexcept
+	{
+		const auto u = (const uint8_t*)s;
+		auto o = 0ULL;
+		auto continuation = [&](size_t i) { return i < len && (u[i] & 0xc0) == 0x80; };
+		for (auto i = 0ULL; i < len;)
+		{
+			if constexpr (sizeof(C) == 2)
+			{
+				if (i + 16 <= len)
+				{
+					const auto v = _mm_loadu_si128((const __m128i*)&u[i]);
+					if (_mm_movemask_epi8(v) == 0)
+					{
+						if constexpr (Write)
+						{
+							_mm_storeu_si128((__m128i*)&out[o], _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+							_mm_storeu_si128((__m128i*)&out[o + 8], _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+						}
+						i += 16;
+						o += 16;
+						continue;
+					}
+				}
+			}
+
+			// Malformed sequences are replaced one byte at a time
+			const auto b = u[i];
+			auto c = 0xfffdU;
+			auto n = 1ULL;
+			if (b < 0x80)
+			{
+				c = b;
+			}
+			else if (b >= 0xc2 && b < 0xe0 && continuation(i + 1))
+			{
+				c = (b & 0x1fU) << 6 | (u[i + 1] & 0x3fU);
+				n = 2;
+			}
+			else if (b >= 0xe0 && b < 0xf0 && continuation(i + 1) && continuation(i + 2)
+				&& (b != 0xe0 || u[i + 1] >= 0xa0) && (b != 0xed || u[i + 1] < 0xa0))
+			{
+				c = (b & 0x0fU) << 12 | (u[i + 1] & 0x3fU) << 6 | (u[i + 2] & 0x3fU);
+				n = 3;
+			}
+			else if (b >= 0xf0 && b < 0xf5 && continuation(i + 1) && continuation(i + 2) && continuation(i + 3)
+				&& (b != 0xf0 || u[i + 1] >= 0x90) && (b != 0xf4 || u[i + 1] < 0x90))
+			{
+				c = (b & 0x07U) << 18 | (u[i + 1] & 0x3fU) << 12 | (u[i + 2] & 0x3fU) << 6 | (u[i + 3] & 0x3fU);
+				n = 4;
+			}
+			i += n;
+
+			if (sizeof(C) == 2 && c >= 0x10000)
+			{
+				if constexpr (Write)
+				{
+					out[o] = C(0xd800 + ((c - 0x10000) >> 10));
+					out[o + 1] = C(0xdc00 + ((c - 0x10000) & 0x3ff));
+				}
+				o += 2;
+			}
+			else
+			{
+				if constexpr (Write) out[o] = C(c);
+				o += 1;
 			}
-			result.resize(r);
 		}
+		return o;
+	}
+
+	template<typename C> size_t utf8_size(const C* s, size_t len) noexcept { return utf8_convert<false>(s, len, nullptr); }
+	template<typename C> size_t utf8_write(const C* s, size_t len, char* out) noexcept { return utf8_convert<true>(s, len, out); }
+	template<typename C> size_t utf16_size(const char* s, size_t len) noexcept { return utf16_convert<false>(s, len, (C*)nullptr); }
+	template<typename C> size_t utf16_write(const char* s, size_t len, C* out) noexcept { return utf16_convert<true>(s, len, out); }
+
+	template size_t utf8_size(const char16_t*, size_t) noexcept;
+	template size_t utf8_size(const wchar_t*, size_t) noexcept;
+	template size_t utf8_write(const char16_t*, size_t, char*) noexcept;
+	template size_t utf8_write(const wchar_t*, size_t, char*) noexcept;
+	template size_t utf16_size<char16_t>(const char*, size_t) noexcept;
+	template size_t utf16_size<wchar_t>(const char*, size_t) noexcept;
+	template size_t utf16_write(const char*, size_t, char16_t*) noexcept;
+	template size_t utf16_write(const char*, size_t, wchar_t*) noexcept;
+
+	template<typename C>
+	void utf8_assign(std::string& result, const C* s, size_t len)
+	{
+		result.resize(utf8_size(s, len));
+		utf8_write(s, len, result.data());
+	}
+
+	std::string utf8_r(const wchar_t* s, size_t len)
+	{
+		std::string result;
+		if (s && len > 0) utf8_assign(result, s, len);
 		return result;
 	}
 
+	std::string utf8(const CefString& s)
+	{
+		std::string result;
+		if (s.length() > 0) utf8_assign(result, s.c_str(), s.length());
+		return result;
+	}
+
+	void utf8_assign(std::string& result, const CefString& s)
+	{
+		result.clear();
+		if (s.length() > 0) utf8_assign(result, s.c_str(), s.length());
+	}
+
+	const std::string& utf8_scratch(const CefString& s)
+	{
+		thread_local std::string scratch;
+		utf8_assign(scratch, s);
+		return scratch;
+	}
+
 	std::wstring utf16_r(const char* s, size_t len)
 	{
 		std::wstring result;
 		if (s && len > 0)
 		{
-			result.resize(len);
-			auto r = MultiByteToWideChar(CP_UTF8, 0, s, int(len), result.data(), int(result.size()));
-			if (r == 0)
+			result.resize(utf16_size<wchar_t>(s, len));
+			utf16_write(s, len, result.data());
+		}
+		return result;
+	}
+
+	// Slot epoch is zero while its thread is not reading. Slots sit in cache lines of their own, so readers on different
+	// threads do not write to shared memory.
+	struct alignas(64) rcu_slot
+	{
+		std::atomic<uint64_t> epoch;
+		std::atomic<bool> taken;
+	};
+
+	static rcu_slot rcu_slots[rcu_domain::max_readers];
+	static std::atomic<uint64_t> rcu_epoch{1};
+	static std::atomic<uint32_t> rcu_overflow;
+
+	// Slot is taken by the first read on a thread and given back when thread exits
+	struct rcu_thread
+	{
+		rcu_slot* slot{};
+		uint32_t depth{};
+
+		rcu_thread()
+		{
+			for (auto& s : rcu_slots)
 			{
-				result.resize(MultiByteToWideChar(CP_UTF8, 0, s, int(len), nullptr, 0));
-				r = MultiByteToWideChar(CP_UTF8, 0, s, int(len), result.data(), int(result.size()));
+				if (auto taken = false; s.taken.compare_exchange_strong(taken, true))
+				{
+					slot = &s;
+					break;
+				}
 			}
-			result.resize(r);
 		}
-		return result;
+
+		~rcu_thread()
+		{
+			if (slot) slot->taken.store(false, std::memory_order_release);
+		}
+	};
+
+	static thread_local rcu_thread rcu_current_thread;
+
+	void rcu_domain::enter() noexcept
+	{
+		auto& t = rcu_current_thread;
+		if (t.depth++) return;
+		if (t.slot) t.slot->epoch.store(rcu_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+		else rcu_overflow.fetch_add(1, std::memory_order_seq_cst);
+	}
+
+	void rcu_domain::leave() noexcept
+	{
+		auto& t = rcu_current_thread;
+		if (--t.depth) return;
+		if (t.slot) t.slot->epoch.store(0, std::memory_order_release);
+		else rcu_overflow.fetch_sub(1, std::memory_order_release);
+	}
+
+	uint64_t rcu_domain::advance() noexcept
+	{
+		return rcu_epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+	}
+
+	// Reader that loaded an object before it was replaced stored its epoch before that, and the epoch was older than the
+	// one object got retired with. Readers that started later load the replacement.
+	bool rcu_domain::quiescent(uint64_t retired) noexcept
+	{
+		if (rcu_overflow.load(std::memory_order_seq_cst)) return false;
+		for (const auto& s : rcu_slots)
+		{
+			const auto epoch = s.epoch.load(std::memory_order_seq_cst);
+			if (epoch && epoch < retired) return false;
+		}
+		return true;
+	}
+}
+
+int64_t perf_counter_now()
+{
+	LARGE_INTEGER ret;
+	QueryPerformanceCounter(&ret);
+	return ret.QuadPart;
+}
+
+int64_t perf_counter_frequency()
+{
+	static const auto ret = []
+	{
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		return f.QuadPart;
+	}();
+	return ret;
+}
+
+void latency_histogram::add(double us)
+{
+	const auto v = us < 1. ? 1ULL : uint64_t(us);
+	const auto octave = std::bit_width(v) - 1;
+	const auto quarter = octave < 2 ? 0U : uint32_t(v >> (octave - 2)) & 3U;
+	++buckets[std::min(size_t(octave * 4 + quarter), buckets.size() - 1)];
+	++count;
+}
+
+float latency_histogram::percentile(float p) const
+{
+	if (count == 0) return 0.f;
+	const auto target = uint32_t(std::ceil(float(count) * p));
+	auto seen = 0U;
+	for (auto i = 0U; i < buckets.size(); ++i)
+	{
+		seen += buckets[i];
+		if (seen >= target)
+		{
+			// Upper edge of the bucket
+			const auto octave = i / 4, quarter = i % 4;
+			return octave < 2 ? float(2U << octave) - 1.f : float(1ULL << octave) * (1.f + float(quarter + 1) / 4.f);
+		}
+	}
+	return float(1ULL << (buckets.size() / 4));
+}
+
+bool accsp_frame_index::parse(const char* data, size_t data_size, uint32_t count)
+{
+	base = data;
+	records.clear();
+
+	// Each record takes at least three bytes, so larger counts can only come from a damaged frame
+	if (count > data_size / 3) return false;
+	records.resize(count);
+
+	auto p = 0ULL;
+	for (auto& r : records)
+	{
+		if (p + 3ULL > data_size)
+		{
+			records.clear();
+			return false;
+		}
+		r.key = data[p];
+		r.size = *(const uint16_t*)&data[p + 1];
+		r.offset = uint32_t(p + 3ULL);
+		p += 3ULL + r.size;
+		if (p > data_size)
+		{
+			records.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+char* accsp_frame_writer::reserve(char key, size_t payload_size)
+{
+	if (size + payload_size + 4ULL > capacity || payload_size > UINT16_MAX) return nullptr;
+	data[size] = key;
+	*(uint16_t*)&data[size + 1] = uint16_t(payload_size);
+	const auto ret = &data[size + 3];
+	ret[payload_size] = '\0';
+	size += uint32_t(payload_size) + 3U;
+	++count;
+	return ret;
+}
+
+size_t accsp_response_log::push(const header& h)
+{
+	const auto record_size = sizeof h + h.extent;
+	if (size_ + record_size > data_.size())
+	{
+		data_.resize(std::max({size_ + record_size, data_.size() * 2, size_t(4096)}));
 	}
+	const auto ret = size_;
+	memcpy(&data_[ret], &h, sizeof h);
+	size_ += record_size;
+	return ret;
+}
+
+char* accsp_response_log::append(char key, size_t payload_size, bool overriding, int64_t time)
+{
+	if (overriding)
+	{
+		const auto slot = std::ranges::find(slots_, key, &std::pair<char, size_t>::first);
+		if (slot != slots_.end() && slot->second >= head_)
+		{
+			header h;
+			memcpy(&h, &data_[slot->second], sizeof h);
+			auto target = h.forward ? size_t(h.forward) : slot->second;
+			auto extent = h.extent;
+			if (h.forward) memcpy(&extent, &data_[target + offsetof(header, extent)], sizeof extent);
+			if (payload_size > extent)
+			{
+				target = push({0LL, uint32_t(payload_size), uint32_t(payload_size), 0U, key, true});
+				h.forward = uint32_t(target);
+			}
+			h.size = uint32_t(payload_size);
+			h.time = time;
+			memcpy(&data_[slot->second], &h, sizeof h);
+			return &data_[target + sizeof h];
+		}
+		if (slot != slots_.end()) slot->second = size_;
+		else slots_.emplace_back(key, size_);
+	}
+
+	const auto offset = push({time, uint32_t(payload_size), uint32_t(payload_size), 0U, key, false});
+	++live_;
+	return &data_[offset + sizeof(header)];
+}
+
+void accsp_response_log::consume(const position& position)
+{
+	head_ = position.offset;
+	live_ -= position.records;
+	if (head_ >= size_)
+	{
+		head_ = 0;
+		size_ = 0;
+		live_ = 0;
+		slots_.clear();
+		// Keep buffer between frames unless some huge response has blown it up
+		if (data_.size() > 4 * 1024 * 1024) data_ = {};
+	}
+	else if (head_ >= 64 * 1024 && head_ > size_ - head_)
+	{
+		// Backlog that never fully drains would keep growing otherwise, moving it once consumed part outweighs it keeps
+		// the cost proportional to what was submitted
+		compact();
+	}
+}
+
+void accsp_response_log::compact()
+{
+	memmove(data_.data(), &data_[head_], size_ - head_);
+	size_ -= head_;
+	for (auto pos = 0ULL; pos < size_;)
+	{
+		header h;
+		memcpy(&h, &data_[pos], sizeof h);
+		if (h.forward)
+		{
+			h.forward -= uint32_t(head_);
+			memcpy(&data_[pos], &h, sizeof h);
+		}
+		pos += sizeof h + h.extent;
+	}
+	std::erase_if(slots_, [this](const std::pair<char, size_t>& s) { return s.second < head_; });
+	for (auto& s : slots_)
+	{
+		s.second -= head_;
+	}
+	head_ = 0;
+}
+
+char* accsp_ring_producer::reserve(char key, size_t payload_size)
+{
+	if (payload_size > UINT16_MAX) return nullptr;
+	const auto record_size = 4ULL + payload_size;
+	auto pos = pending % ACCSP_RING_SIZE;
+	const auto skip = ACCSP_RING_SIZE - pos < record_size ? ACCSP_RING_SIZE - pos : 0ULL;
+	if (pending + skip + record_size - consumed() > ACCSP_RING_SIZE) return nullptr;
+	if (skip >= 4)
+	{
+		ring->data[pos] = 0;
+		*(uint16_t*)&ring->data[pos + 1] = uint16_t(skip - 4);
+	}
+	if (skip > 0)
+	{
+		pending += skip;
+		pos = 0;
+	}
+	ring->data[pos] = key;
+	*(uint16_t*)&ring->data[pos + 1] = uint16_t(payload_size);
+	ring->data[pos + 3 + payload_size] = '\0';
+	pending += record_size;
+	return &ring->data[pos + 3];
 }
 
 accsp_mapped::accsp_mapped(const std::wstring& filename, size_t size, bool existing_only) : size(size)
@@ -422,7 +866,7 @@ accsp_mapped::accsp_mapped(const std::wstring& filename, size_t size, bool exist
 	entry = MapViewOfFile(entry_handle, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
 	if (!entry)
 	{
-		throw std::exception("Failed to map a file mapping");
+		throw std::runtime_error("Failed to map a file mapping");
 	}
 }
 
@@ -430,4 +874,256 @@ accsp_mapped::~accsp_mapped()
 {
 	if (entry) UnmapViewOfFile(entry);
 	if (entry_handle && entry_handle != INVALID_HANDLE_VALUE) CloseHandle(entry_handle);
-}
\ No newline at end of file
+}
+
+#define ACCSP_POOL_MIN_BLOCK (64 * 1024)
+#define ACCSP_POOL_MAX_BLOCK (32 * 1024 * 1024)
+#define ACCSP_POOL_MAX_SIZE (64 * 1024 * 1024)
+
+accsp_mapped_pool::block accsp_mapped_pool::acquire(const std::wstring& prefix, size_t size)
+{
+	const auto capacity = std::max(size_t(ACCSP_POOL_MIN_BLOCK), std::bit_ceil(size));
+	for (auto i = free_.begin(); i != free_.end(); ++i)
+	{
+		if (i->mapping->size == capacity)
+		{
+			auto ret = std::move(*i);
+			free_.erase(i);
+			pooled_size_ -= capacity;
+			++hits;
+			return ret;
+		}
+	}
+
+	// Frontend names its own large commands with random keys in the same namespace, so keys here are random as well
+	if (next_key_ == 0) next_key_ = std::random_device{}();
+	next_key_ = next_key_ * 1664525U + 1013904223U;
+
+	block ret;
+	ret.key = int(next_key_ & INT32_MAX);
+	ret.mapping = std::make_unique<accsp_mapped>(prefix + L'_' + std::to_wstring(ret.key), capacity, false);
+	++misses;
+	log_message("Large message pool miss: size=%llu, hits=%llu, misses=%llu", capacity, hits, misses);
+	return ret;
+}
+
+void accsp_mapped_pool::release(block&& item)
+{
+	const auto capacity = item.mapping->size;
+	if (capacity > ACCSP_POOL_MAX_BLOCK) return;
+	while (!free_.empty() && pooled_size_ + capacity > ACCSP_POOL_MAX_SIZE)
+	{
+		pooled_size_ -= free_.front().mapping->size;
+		free_.erase(free_.begin());
+	}
+	pooled_size_ += capacity;
+	free_.push_back(std::move(item));
+}
+
+static bool html_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+// Tags scanner looks for, matched one character at a time. All of them start with `<` and have no other repeating prefix,
+// so on mismatch matching restarts from the current character.
+enum html_marker : uint8_t
+{
+	html_head_close,
+	html_body_open,
+	html_script_open,
+	html_style_open,
+	html_comment_open,
+};
+
+static constexpr const char* html_markers[] = {"</head", "<body", "<script", "<style", "<!--"};
+static constexpr uint8_t html_markers_size[] = {6, 5, 7, 6, 4};
+static constexpr const char* html_raw_text_close[] = {"</script", "</style"};
+
+static char html_lower(char c)
+{
+	return char(c >= 'A' && c <= 'Z' ? c | 0x20 : c);
+}
+
+size_t html_injector::scan(const char* data, size_t size)
+{
+	for (auto i = 0ULL; i < size; ++i)
+	{
+		auto c = data[i];
+		switch (state_)
+		{
+			case state::open_quoted:
+			{
+				if (c == quote_) state_ = state::open_tail;
+				continue;
+			}
+			case state::comment:
+			{
+				// Starts with two dashes matched: `<!-->` and `<!--->` are closed right away
+				if (c == '>' && close_matched_ == 2)
+				{
+					close_matched_ = 0;
+					state_ = state::scan;
+					continue;
+				}
+				if (c != '-')
+				{
+					close_matched_ = 0;
+					const auto next = (const char*)memchr(&data[i], '-', size - i);
+					if (!next) return size;
+					i = next - data;
+				}
+				close_matched_ = std::min(close_matched_ + 1, 2);
+				continue;
+			}
+			case state::raw_text:
+			{
+				const auto close = html_raw_text_close[open_tag_ - html_script_open];
+				if (!close_matched_ && c != '<')
+				{
+					const auto next = (const char*)memchr(&data[i], '<', size - i);
+					if (!next) return size;
+					i = next - data;
+					c = '<';
+				}
+				const auto l = html_lower(c);
+				close_matched_ = l == close[close_matched_] ? close_matched_ + 1 : l == '<';
+				if (!close[close_matched_])
+				{
+					close_matched_ = 0;
+					state_ = state::scan;
+				}
+				continue;
+			}
+			case state::open_tail:
+			case state::head_close_tail:
+			{
+				if (c == '>')
+				{
+					if (state_ == state::open_tail && open_tag_ != html_body_open)
+					{
+						state_ = state::raw_text;
+						continue;
+					}
+					state_ = state::inject;
+					return i + 1;
+				}
+				if (state_ == state::open_tail)
+				{
+					if (c == '"' || c == '\'')
+					{
+						quote_ = c;
+						state_ = state::open_quoted;
+					}
+					continue;
+				}
+				if (html_space(c)) continue;
+				state_ = state::scan;
+			}
+			break;
+			default: break;
+		}
+
+		if (!(matched_[0] | matched_[1] | matched_[2] | matched_[3] | matched_[4]) && c != '<')
+		{
+			const auto next = (const char*)memchr(&data[i], '<', size - i);
+			if (!next) return size;
+			i = next - data;
+			c = '<';
+		}
+
+		// Opening tags need the character after the name to tell `<body>` from `<bodyx>`
+		const auto l = html_lower(c);
+		for (auto k : {html_body_open, html_script_open, html_style_open})
+		{
+			if (matched_[k] != html_markers_size[k] || (l != '>' && l != '/' && !html_space(l))) continue;
+			memset(matched_, 0, sizeof matched_);
+			open_tag_ = k;
+			if (l != '>') state_ = state::open_tail;
+			else if (k != html_body_open) state_ = state::raw_text;
+			else
+			{
+				state_ = state::inject;
+				return i + 1;
+			}
+			break;
+		}
+		if (state_ != state::scan) continue;
+
+		for (auto k = 0U; k < std::size(matched_); ++k)
+		{
+			matched_[k] = matched_[k] < html_markers_size[k] && l == html_markers[k][matched_[k]] ? matched_[k] + 1 : l == '<';
+		}
+		if (matched_[html_head_close] == html_markers_size[html_head_close])
+		{
+			memset(matched_, 0, sizeof matched_);
+			state_ = state::head_close_tail;
+		}
+		else if (matched_[html_comment_open] == html_markers_size[html_comment_open])
+		{
+			memset(matched_, 0, sizeof matched_);
+			close_matched_ = 2;
+			state_ = state::comment;
+		}
+	}
+	return size;
+}
+
+bool html_injector::process(const char* in, size_t in_size, size_t& in_read, char* out, size_t out_size, size_t& out_written)
+{
+	in_read = 0;
+	out_written = 0;
+	if (in_size == 0 && state_ < state::inject && any_input_)
+	{
+		state_ = state::inject;
+	}
+	any_input_ |= in_size > 0;
+
+	for (;;)
+	{
+		if (state_ == state::inject)
+		{
+			const auto left = payload_ ? payload_->size() - payload_pos_ : 0;
+			const auto size = std::min(left, out_size - out_written);
+			if (size) memcpy(&out[out_written], payload_->data() + payload_pos_, size);
+			payload_pos_ += size;
+			out_written += size;
+			if (size < left) return false;
+			state_ = state::done;
+			payload_.reset();
+		}
+
+		const auto size = std::min(in_size - in_read, out_size - out_written);
+		const auto pass = state_ == state::done ? size : scan(&in[in_read], size);
+		memcpy(&out[out_written], &in[in_read], pass);
+		in_read += pass;
+		out_written += pass;
+		if (state_ != state::inject) return in_read == in_size;
+	}
+}
+
+size_t lson_escape_position(const char* data, size_t size)
+{
+	// SSE2 is always there on x64, AVX2 would need runtime dispatch and strings here are rarely long enough to benefit
+	auto i = 0ULL;
+	const auto zero = _mm_setzero_si128();
+	const auto line_break = _mm_set1_epi8('\n');
+	const auto quote = _mm_set1_epi8('"');
+	const auto backslash = _mm_set1_epi8('\\');
+	for (; i + 16 <= size; i += 16)
+	{
+		const auto v = _mm_loadu_si128((const __m128i*)&data[i]);
+		const auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, line_break)),
+			_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)));
+		if (const auto mask = uint32_t(_mm_movemask_epi8(m)))
+		{
+			return i + std::countr_zero(mask);
+		}
+	}
+	for (; i < size; ++i)
+	{
+		const auto c = data[i];
+		if (c == 0 || c == '\n' || c == '"' || c == '\\') return i;
+	}
+	return size;
+}
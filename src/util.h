@@ -2,17 +2,21 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <cassert>
+#include <charconv>
 #include <chrono>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <stdint.h>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include <include/internal/cef_string.h>
 #include <include/internal/cef_time.h>
 
-#include "composition.h"
-
 void __log_message(const char*, ...);
 
 template <typename... Args>
@@ -24,6 +28,9 @@ void __log_nothing(Args&& ...args) {}
 #define log_message(...) __log_nothing(__VA_ARGS__)
 #endif
 
+// XXH3 of given data
+uint64_t hash_code_raw(const void* data, size_t size);
+
 template<class T>
 std::shared_ptr<T> to_com_ptr(T* obj)
 {
@@ -60,7 +67,7 @@ struct accsp_wb_entry
 
 	uint64_t be_alive_time;
 	float zoom_level;
-	uint32_t _pad0;
+	uint32_t be_channel_version;
 
 	uint64_t handle;
 	uint64_t popup_handle;
@@ -81,7 +88,7 @@ struct accsp_wb_entry
     uint8_t needs_next_frame;
 	
 	uint32_t be_flags;
-	uint16_t _pad1;
+	uint16_t fe_channel_version;
 	uint8_t _pad2;
 	uint8_t _pad3;
 	std::array<vec2, 2> touches;
@@ -97,6 +104,27 @@ struct accsp_wb_entry
 
 static_assert(sizeof(accsp_wb_entry) == 112 + 2 * ACCSP_FRAME_SIZE);
 
+#define ACCSP_CHANNEL_VERSION 1
+#define ACCSP_RING_SIZE (256 * 1024)
+
+// Single-producer single-consumer ring of `[key:1][size:2][payload][0]` records in shared memory: payloads are followed by a zero
+// byte not counted in size, same as in accsp_wb_entry frames. Counters only grow and are kept on separate cache lines. Records
+// never wrap: if the rest of the buffer is too short, producer fills it with a padding record (key 0), or leaves it be if even
+// a header with terminator would not fit there, and consumer skips that space.
+struct accsp_ring
+{
+	alignas(64) uint64_t head;
+	alignas(64) uint64_t tail;
+	alignas(64) char data[ACCSP_RING_SIZE];
+};
+
+// Mapped as `<tab prefix>~` if frontend sets accsp_wb_entry::fe_channel_version, backend confirms with be_channel_version
+struct accsp_wb_channel
+{
+	accsp_ring commands;
+	accsp_ring response;
+};
+
 namespace utils
 {
 	template <size_t Size>
@@ -224,6 +252,7 @@ namespace utils
 		int32_t as(int32_t d) const { return int32_t(as(int64_t(d))); } 
 		uint32_t as(uint32_t d) const { return uint32_t(as(uint64_t(d))); } 
 		float as(float d) const;
+		double as(double d) const;
 
 		// Conversion to regular string
 		std::string str() const noexcept
@@ -235,24 +264,23 @@ namespace utils
 		// Common string-like functions
 		size_t find_first_of(char c, const size_t index = 0U) const noexcept
 		{
-			for (auto i = index; i < length_; ++i)
-			{
-				if (data_[i] == c) return i;
-			}
-			return std::string::npos;
+			if (index >= length_) return std::string::npos;
+			const auto f = (const char*)memchr(&data_[index], c, length_ - index);
+			return f ? size_t(f - data_) : std::string::npos;
 		}
 
 		template <std::size_t N>
 		size_t find_first_of(const char (&cs)[N], const size_t index = 0U) const noexcept
 		{
-			for (auto i = index; i < length_; ++i)
-			{
-				if (char_matches(data_[i], cs)) return i;
-			}
-			return std::string::npos;
+			return find_first_of_set(cs, N - 1, index);
 		}
 
-		size_t find_first_of(const std::string& cs, const size_t index = 0U) const noexcept;
+		size_t find_first_of(const std::string& cs, const size_t index = 0U) const noexcept
+		{
+			return find_first_of_set(cs.data(), cs.size(), index);
+		}
+
+		size_t find_first_of_set(const char* cs, size_t cs_len, size_t index = 0U) const noexcept;
 
 		size_t find_last_of(const char c, const size_t index = UINT64_MAX) const noexcept
 		{
@@ -263,16 +291,15 @@ namespace utils
 			return std::string::npos;
 		}
 
+		// Looks before index only and returns position right after the match, unlike the single character version
 		template <std::size_t N>
 		size_t find_last_of(const char (&cs)[N], const size_t index = 0U) const noexcept
 		{
-			for (auto i = size_min(index, length_); i > 0; --i)
-			{
-				if (char_matches(data_[i - 1], cs)) return i;
-			}
-			return std::string::npos;
+			return find_last_of_set(cs, N - 1, index);
 		}
 
+		size_t find_last_of_set(const char* cs, size_t cs_len, size_t index = 0U) const noexcept;
+
 		size_t find_cstrl(const char* c, size_t c_len, size_t index = 0U) const;
 		size_t find(const char* c, size_t index = 0U) const;
 		size_t find(const str_view& c, size_t index = 0U) const;
@@ -340,12 +367,70 @@ namespace utils
 			return ret;
 		}
 
+		// Pieces of split(separator, false, false), found one at a time while iterating instead of collected into a vector
+		class split_iterator
+		{
+		public:
+			split_iterator(const str_view& src, char separator) noexcept
+				: next_(src.data_), end_(src.end()), separator_(separator)
+			{
+				++*this;
+			}
+
+			str_view operator*() const noexcept { return {piece_, 0, piece_size_}; }
+			bool operator==(std::default_sentinel_t) const noexcept { return done_; }
+			bool operator!=(std::default_sentinel_t) const noexcept { return !done_; }
+
+			// Empty string, even without data, yields a single empty piece, same as split()
+			split_iterator& operator++() noexcept
+			{
+				if (last_)
+				{
+					done_ = true;
+					return *this;
+				}
+				const auto found = next_ != end_ ? (const char*)memchr(next_, separator_, size_t(end_ - next_)) : nullptr;
+				piece_ = next_;
+				piece_size_ = size_t((found ? found : end_) - next_);
+				if (found) next_ = found + 1;
+				else last_ = true;
+				return *this;
+			}
+
+		private:
+			const char* piece_{};
+			size_t piece_size_{};
+			const char* next_;
+			const char* end_;
+			char separator_;
+			bool last_{};
+			bool done_{};
+		};
+
+		struct split_range
+		{
+			const str_view* src;
+			char separator;
+			split_iterator begin() const noexcept { return {*src, separator}; }
+			std::default_sentinel_t end() const noexcept { return {}; }
+		};
+
+		split_range pieces(char separator) const noexcept
+		{
+			return {this, separator};
+		}
+
 		std::vector<std::pair<str_view, str_view>> pairs(char separator) const
 		{
 			std::vector<std::pair<str_view, str_view>> result;
-			auto& trick = *(std::vector<str_view>*)&result;
-			split_to(trick, separator, false, false, false, UINT64_MAX);
-			if (trick.size() & 1) trick.pop_back();
+			str_view key;
+			auto has_key = false;
+			for (const auto& p : pieces(separator))
+			{
+				if (has_key) result.emplace_back(key, p);
+				else key = p;
+				has_key = !has_key;
+			}
 			return result;
 		}
 
@@ -435,16 +520,507 @@ namespace utils
 	std::string operator +(std::string l, const str_view& r);
 	std::ostream& operator<<(std::ostream& os, const str_view& self);
 
+	// Conversion between UTF-8 and UTF-16 code units of type C. Sizes are exact, plain ASCII runs are converted 8 or 16 characters
+	// at a time, and invalid sequences and lone surrogates become U+FFFD, same as with WideCharToMultiByte()
+	template<typename C> size_t utf8_size(const C* s, size_t len) noexcept;
+	template<typename C> size_t utf8_write(const C* s, size_t len, char* out) noexcept;
+	template<typename C> size_t utf16_size(const char* s, size_t len) noexcept;
+	template<typename C> size_t utf16_write(const char* s, size_t len, C* out) noexcept;
+
 	std::string utf8_r(const wchar_t* s, size_t len);
 	inline std::string utf8(const wchar_t* s) { return utf8_r(s, wcslen(s)); }
 	inline std::string utf8(const std::wstring& s) { return utf8_r(s.c_str(), s.size()); }
+	std::string utf8(const CefString& s);
+
+	// Converts into given string, reusing its buffer
+	void utf8_assign(std::string& result, const CefString& s);
+
+	// Converts into a buffer owned by current thread, valid until the next call on the same thread. Builders convert
+	// CefString values through it as well, so anything kept across their use needs its own buffer
+	const std::string& utf8_scratch(const CefString& s);
 
 	std::wstring utf16_r(const char* s, size_t len);
 	inline std::wstring utf16(const char* s) { return utf16_r(s, strlen(s)); }
 	inline std::wstring utf16(const std::string& s) { return utf16_r(s.c_str(), s.size()); }
 	inline std::wstring utf16(const str_view& s) { return utf16_r(s.data(), s.size()); }
+
+	// Epoch-based reclamation for rules_snapshot: a reader publishes epoch it started at in a slot of its own, and objects
+	// retired at a later epoch are freed once no slot holds an older one. Reading is a couple of atomic stores and loads,
+	// no locks and no shared counters. Threads past the number of slots share an overflow counter, and while any of them
+	// reads nothing is freed.
+	struct rcu_domain
+	{
+		static constexpr size_t max_readers = 64;
+
+		// Nested sections on the same thread keep the epoch of the outermost one
+		static void enter() noexcept;
+		static void leave() noexcept;
+
+		// Called by writers after publishing a new object: returns epoch to retire the old one with
+		static uint64_t advance() noexcept;
+
+		// True if no reader can still see objects retired at given epoch
+		static bool quiescent(uint64_t retired) noexcept;
+	};
+
+	// Immutable snapshots published by writers and read through rcu_domain: readers never lock, never wait for a writer
+	// and never touch a reference count, only writers are serialized. Replaced snapshots are freed by later updates once
+	// readers are done with them.
+	template<typename T>
+	struct rules_snapshot : noncopyable
+	{
+		// Keeps snapshot alive while in scope, meant for the duration of a single callback
+		struct reader : noncopyable
+		{
+			explicit reader(const std::atomic<const T*>& value) noexcept
+			{
+				rcu_domain::enter();
+				ptr_ = value.load(std::memory_order_seq_cst);
+			}
+
+			~reader() { rcu_domain::leave(); }
+			const T& operator *() const noexcept { return *ptr_; }
+			const T* operator ->() const noexcept { return ptr_; }
+			const T* get() const noexcept { return ptr_; }
+
+		private:
+			const T* ptr_;
+		};
+
+		rules_snapshot() : value_(new T{}) { }
+
+		~rules_snapshot()
+		{
+			delete value_.load();
+			for (const auto& r : retired_) delete r.second;
+		}
+
+		reader current() const noexcept
+		{
+			return reader{value_};
+		}
+
+		// Copies current snapshot, lets callback change the copy and publishes the result
+		template<typename Callback>
+		void update(Callback&& callback)
+		{
+			std::unique_lock lock(update_mutex_);
+			auto next = std::make_unique<T>(*value_.load(std::memory_order_relaxed));
+			callback(*next);
+			const auto previous = value_.exchange(next.release(), std::memory_order_seq_cst);
+			retired_.emplace_back(rcu_domain::advance(), previous);
+			for (auto i = retired_.begin(); i != retired_.end();)
+			{
+				if (!rcu_domain::quiescent(i->first)) ++i;
+				else
+				{
+					delete i->second;
+					i = retired_.erase(i);
+				}
+			}
+		}
+
+		// Replaced snapshots not freed yet
+		size_t retired() const
+		{
+			std::unique_lock lock(update_mutex_);
+			return retired_.size();
+		}
+
+	private:
+		static_assert(std::atomic<const T*>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free);
+
+		std::atomic<const T*> value_;
+		std::vector<std::pair<uint64_t, const T*>> retired_;
+		mutable std::mutex update_mutex_;
+	};
+}
+
+// Performance counter ticks are the same for all processes, so frontend and backend can compare their timestamps
+int64_t perf_counter_now();
+int64_t perf_counter_frequency();
+
+// Durations in microseconds, in buckets a quarter of an octave wide
+struct latency_histogram
+{
+	std::array<uint32_t, 128> buckets{};
+	uint32_t count{};
+
+	void add(double us);
+	float percentile(float p) const;
+	void reset() { *this = {}; }
+};
+
+// Mapped as `<tab prefix>#` for every named tab. Counters at the end are published every couple of seconds. Once `latencyStats`
+// option is set, frontend can stamp its side of both exchanges and backend publishes latencies in microseconds over the last
+// couple of seconds, overall and per command key.
+struct accsp_wb_stats
+{
+	struct latency
+	{
+		float p50;
+		float p95;
+		float p99;
+		uint32_t count;
+	};
+
+	// Written by frontend: when commands with given sequence number were published (used for commands without a stamp record
+	// in front of them), and when it read a response batch
+	uint64_t fe_commands_time;
+	uint32_t fe_commands_seq;
+	uint32_t fe_response_seq;
+	uint64_t fe_response_time;
+
+	// Written by backend: when response batch with given sequence number was published, and sequence number of the last stamp
+	// record it has handled commands of
+	uint64_t be_frequency;
+	uint64_t be_response_time;
+	uint32_t be_response_seq;
+	uint32_t be_stats_seq;
+	uint32_t be_commands_seq;
+	uint32_t _pad;
+
+	latency commands_dispatch;
+	latency commands_handling;
+	latency response_queue;
+	latency response_delivery;
+	std::array<latency, 128> commands_dispatch_by_key;
+	std::array<latency, 128> commands_handling_by_key;
+	std::array<latency, 128> response_by_key;
+
+	uint64_t commands_coalesced;
+	uint64_t pool_hits;
+	uint64_t pool_misses;
+	uint64_t responses_dropped;
+	uint64_t verdict_cache_hits;
+	uint64_t verdict_cache_misses;
+
+	// Process-wide, shared by all tabs
+	uint64_t pattern_cache_hits;
+	uint64_t pattern_cache_misses;
+	uint64_t pattern_cache_entries;
+	uint64_t pattern_compile_time_us;
+};
+
+// Record frontend can put in front of commands in either exchange while latency stats are on: commands after it, up to the next
+// stamp, were written at given time (perf_counter_now() ticks) as part of given sequence. Not passed to command handlers.
+#define ACCSP_STAMP_KEY '\3'
+
+struct accsp_command_stamp
+{
+	int64_t time;
+	uint32_t seq;
+	uint32_t _pad;
+};
+
+// Record of a `[key:1][size:2][payload]` frame, as used by accsp_wb_entry::commands and accsp_wb_entry::response
+struct accsp_frame_record
+{
+	char key;
+	uint16_t size;
+	uint32_t offset;
+};
+
+// Validates a whole frame in a single pass before anything reads from it, and then gives out records and their payloads without copying
+struct accsp_frame_index
+{
+	const char* base{};
+	std::vector<accsp_frame_record> records;
+
+	// Returns false and leaves index empty if count does not match data or any record crosses the end of data
+	bool parse(const char* data, size_t data_size, uint32_t count);
+	utils::str_view payload(const accsp_frame_record& record) const { return {base, record.offset, record.size}; }
+	auto begin() const { return records.begin(); }
+	auto end() const { return records.end(); }
+};
+
+// Options set with `set_option` command
+enum class accsp_option : char
+{
+	unknown,
+	ignore_certificate_errors,
+	track_form_data,
+	redirect_navigation,
+	redirect_nonstandard_schemes,
+	collect_resource_urls,
+	keep_suspended_texture,
+	scale_factor,
+	invalidate_view,
+	latency_stats,
+	binary_events,
+	renderer_injection,
+};
+
+inline accsp_option accsp_find_option(const utils::str_view& name)
+{
+	// Length narrows names down to one candidate, confirmed with a single comparison. The exception are names sharing
+	// a length (12: latencyStats, binaryEvents), compared one after another. New names clashing in length go to that chain.
+	switch (name.size())
+	{
+		case 11: return name.equals("scaleFactor") ? accsp_option::scale_factor : accsp_option::unknown;
+		case 12: return name.equals("latencyStats") ? accsp_option::latency_stats
+			: name.equals("binaryEvents") ? accsp_option::binary_events : accsp_option::unknown;
+		case 13: return name.equals("trackFormData") ? accsp_option::track_form_data : accsp_option::unknown;
+		case 14: return name.equals("invalidateView") ? accsp_option::invalidate_view : accsp_option::unknown;
+		case 17: return name.equals("rendererInjection") ? accsp_option::renderer_injection : accsp_option::unknown;
+		case 18: return name.equals("redirectNavigation") ? accsp_option::redirect_navigation : accsp_option::unknown;
+		case 19: return name.equals("collectResourceURLs") ? accsp_option::collect_resource_urls : accsp_option::unknown;
+		case 20: return name.equals("keepSuspendedTexture") ? accsp_option::keep_suspended_texture : accsp_option::unknown;
+		case 23: return name.equals("ignoreCertificateErrors") ? accsp_option::ignore_certificate_errors : accsp_option::unknown;
+		case 26: return name.equals("redirectNonStandardSchemes") ? accsp_option::redirect_nonstandard_schemes : accsp_option::unknown;
+		default: return accsp_option::unknown;
+	}
+}
+
+// Splits `set_option` payload into name and value and calls handler(option, name, value), with unknown names passed as
+// accsp_option::unknown. Handler is expected to switch over option.
+template<typename Handler>
+void accsp_dispatch_option(const utils::str_view& payload, Handler&& handler)
+{
+	const auto kv = payload.pair('\1');
+	handler(accsp_find_option(kv.first), kv.first, kv.second);
+}
+
+// How a command relates to the ones of the same kind later in the same frame
+enum class accsp_coalescing : char
+{
+	none,
+	latest,
+	latest_per_option,
+	latest_absolute_scroll,
+};
+
+// Marks commands overwritten later in the same frame as dropped and returns their number. Relative scrolls only get dropped
+// if followed by an absolute one, and invalidateView is an action rather than a state, so it always stays. Commands that can
+// not be coalesced, invalidateView included, are barriers: nothing before them is dropped for what comes after, so that
+// their handlers see the state set up to that point. Commands need `key`, `value` and `dropped` fields, options is scratch
+// space kept by caller between frames.
+template<typename Command, typename Classify>
+uint32_t accsp_coalesce_commands(std::vector<Command>& commands, std::vector<utils::str_view>& options, Classify&& coalescing_of)
+{
+	std::array<bool, 256> seen{};
+	auto seen_absolute_scroll = false;
+	auto dropped = 0U;
+	const auto barrier = [&]
+	{
+		seen.fill(false);
+		options.clear();
+		seen_absolute_scroll = false;
+	};
+	options.clear();
+	for (auto i = commands.size(); i > 0; --i)
+	{
+		auto& c = commands[i - 1];
+		auto drop = false;
+		switch (coalescing_of(c.key))
+		{
+			case accsp_coalescing::none:
+			{
+				barrier();
+			}
+			break;
+			case accsp_coalescing::latest:
+			{
+				drop = seen[uint8_t(c.key)];
+				seen[uint8_t(c.key)] = true;
+			}
+			break;
+			case accsp_coalescing::latest_per_option:
+			{
+				const auto name = c.value.pair('\1').first;
+				if (name.equals("invalidateView"))
+				{
+					barrier();
+					break;
+				}
+				drop = std::find(options.begin(), options.end(), name) != options.end();
+				if (!drop) options.push_back(name);
+			}
+			break;
+			case accsp_coalescing::latest_absolute_scroll:
+			{
+				drop = seen_absolute_scroll;
+				if (c.value.starts_with("1\1")) seen_absolute_scroll = true;
+			}
+			break;
+		}
+		c.dropped = drop;
+		if (drop) ++dropped;
+	}
+	return dropped;
 }
 
+// Appends records to a accsp_wb_entry frame, keeping a zero byte after the last payload
+struct accsp_frame_writer
+{
+	char* data;
+	size_t capacity;
+	uint32_t size{};
+	uint32_t count{};
+
+	// Returns where to write payload of given size, or nullptr if it would not fit
+	char* reserve(char key, size_t payload_size);
+};
+
+struct accsp_ring_producer
+{
+	accsp_ring* ring{};
+	uint64_t pending{};
+
+	// Returns where to write payload of given size, or nullptr if consumer has not freed enough space yet
+	char* reserve(char key, size_t payload_size);
+	void publish() const { std::atomic_ref(ring->head).store(pending, std::memory_order_release); }
+	uint64_t position() const { return pending; }
+	uint64_t consumed() const { return std::atomic_ref(ring->tail).load(std::memory_order_acquire); }
+};
+
+struct accsp_ring_consumer
+{
+	accsp_ring* ring{};
+
+	// Payloads stay valid until release() is called with returned position
+	template<typename Callback>
+	uint64_t peek(Callback&& callback) const
+	{
+		const auto head = std::atomic_ref(ring->head).load(std::memory_order_acquire);
+		auto tail = ring->tail;
+		while (tail < head)
+		{
+			const auto pos = tail % ACCSP_RING_SIZE;
+			if (ACCSP_RING_SIZE - pos < 4)
+			{
+				tail += ACCSP_RING_SIZE - pos;
+				continue;
+			}
+			const auto key = ring->data[pos];
+			const auto size = *(const uint16_t*)&ring->data[pos + 1];
+			if (pos + 4ULL + size > ACCSP_RING_SIZE || tail + 4ULL + size > head)
+			{
+				tail = head;
+				break;
+			}
+			if (key != 0)
+			{
+				callback(key, utils::str_view(ring->data, pos + 3, size));
+			}
+			tail += 4ULL + size;
+		}
+		return tail;
+	}
+
+	void release(uint64_t position) const
+	{
+		std::atomic_ref(ring->tail).store(position, std::memory_order_release);
+	}
+
+	// Payloads are only valid during the callback: space is handed back to producer once all available records are processed
+	template<typename Callback>
+	void read(Callback&& callback) const
+	{
+		release(peek(std::forward<Callback>(callback)));
+	}
+};
+
+// Outgoing records waiting for frontend, kept joined and back to back in a single buffer reused between frames. Submitted
+// records are skipped with a read offset, buffer is only compacted once drained or mostly consumed. Overriding keys keep a
+// slot: newer value replaces the old one in place if it fits, otherwise it goes into a hidden record at the end which the slot
+// points to, so the record keeps its place in the order
+struct accsp_response_log
+{
+	struct header
+	{
+		int64_t time;
+		uint32_t size;
+		uint32_t extent;
+		uint32_t forward;
+		char key;
+		bool dead;
+	};
+
+	struct position
+	{
+		size_t offset;
+		uint32_t records;
+	};
+
+	// Returns where to write payload of given size
+	char* append(char key, size_t payload_size, bool overriding, int64_t time);
+
+	// Callback gets header and payload of each live record and returns false to stop, result can be passed to consume()
+	template<typename Callback>
+	position iterate(Callback&& callback) const
+	{
+		position ret{head_, 0U};
+		while (ret.offset < size_)
+		{
+			header h;
+			memcpy(&h, &data_[ret.offset], sizeof h);
+			if (!h.dead)
+			{
+				const auto payload = h.forward ? h.forward + sizeof h : ret.offset + sizeof h;
+				if (!callback(h, utils::str_view(data_.data(), payload, h.size))) break;
+				++ret.records;
+			}
+			ret.offset += sizeof h + h.extent;
+		}
+		return ret;
+	}
+
+	// Drops records before given position
+	void consume(const position& position);
+	bool empty() const { return live_ == 0; }
+	uint32_t count() const { return live_; }
+
+private:
+	size_t push(const header& h);
+	void compact();
+
+	std::vector<char> data_;
+	size_t head_{};
+	size_t size_{};
+	uint32_t live_{};
+	std::vector<std::pair<char, size_t>> slots_;
+};
+
+// Inserts payload into HTML document streamed in chunks of any size: right after `</head>`, after opening `<body>` tag if
+// document has no `</head>`, or at the very end if neither shows up. Tags are matched case-insensitively across chunk
+// boundaries, comments and contents of `<script>` and `<style>` are skipped. Nothing is buffered: input is consumed only
+// as far as output has room, payload is written from where it stopped.
+struct html_injector
+{
+	explicit html_injector(std::shared_ptr<const std::string> payload) : payload_(std::move(payload)) { }
+
+	// Empty input marks the end of document. Returns false if there is input left or payload is not fully written yet,
+	// so it needs to be called again.
+	bool process(const char* in, size_t in_size, size_t& in_read, char* out, size_t out_size, size_t& out_written);
+	bool injected() const { return state_ == state::done; }
+
+private:
+	enum class state : uint8_t
+	{
+		scan,
+		head_close_tail,
+		open_tail,
+		open_quoted,
+		comment,
+		raw_text,
+		inject,
+		done,
+	};
+
+	// Returns number of bytes up to and including the end of insertion point tag, or size if not found yet
+	size_t scan(const char* data, size_t size);
+
+	std::shared_ptr<const std::string> payload_;
+	size_t payload_pos_{};
+	state state_{};
+	uint8_t matched_[5]{};
+	uint8_t open_tag_{};
+	uint8_t close_matched_{};
+	char quote_{};
+	bool any_input_{};
+};
+
 inline bool get_env_value(const wchar_t* key, bool default_value)
 {	
 	wchar_t var_data[32]{};
@@ -463,16 +1039,85 @@ inline std::wstring get_env_value(const wchar_t* key, const wchar_t* default_val
 	return std::wstring(GetEnvironmentVariableW(key, var_data, 256) ? var_data : default_value);
 }
 
+template<typename T>
+constexpr bool is_character_or_bool = std::is_same_v<T, bool> || std::is_same_v<T, char> || std::is_same_v<T, signed char>
+	|| std::is_same_v<T, unsigned char> || std::is_same_v<T, wchar_t> || std::is_same_v<T, char8_t> || std::is_same_v<T, char16_t>
+	|| std::is_same_v<T, char32_t>;
+
+// Field name for lson_builder. String literals are encoded as `key=` or `["key"]=` at compile time, so adding them is a single
+// copy; names only known at runtime have to be wrapped with lson_key::dynamic() and get encoded when added
+struct lson_key
+{
+	char encoded[47]{};
+	uint8_t size{};
+	const char* dynamic_key{};
+
+	constexpr lson_key(std::nullptr_t) noexcept { }
+
+	template <std::size_t N>
+	consteval lson_key(const char (&key)[N])
+	{
+		const auto length = N - 1;
+		auto fitting = length > 0 && is_letter(key[0]);
+		for (auto i = 1ULL; i < length; ++i)
+		{
+			fitting = fitting && (is_letter(key[i]) || (key[i] >= '0' && key[i] <= '9') || key[i] == '_');
+		}
+
+		if (fitting)
+		{
+			for (auto i = 0ULL; i < length; ++i) push(key[i]);
+		}
+		else
+		{
+			push('[');
+			push('"');
+			for (auto i = 0ULL; i < length; ++i)
+			{
+				const auto c = key[i];
+				if (c == 0 || c == '\n' || c == '"' || c == '\\') push('\\');
+				push(c == 0 ? '0' : c == '\n' ? 'n' : c);
+			}
+			push('"');
+			push(']');
+		}
+		push('=');
+	}
+
+	static lson_key dynamic(const char* key) noexcept
+	{
+		lson_key ret{nullptr};
+		ret.dynamic_key = key;
+		return ret;
+	}
+
+private:
+	static constexpr bool is_letter(char c)
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+	}
+
+	constexpr void push(char c)
+	{
+		if (size == sizeof encoded) throw "LSON key is too long";
+		encoded[size++] = c;
+	}
+};
+
+// Offset of the first byte lson_builder has to escape (zero, line break, quote or backslash), or size if there is none
+size_t lson_escape_position(const char* data, size_t size);
+
 struct lson_builder
 {
 	std::string dst{"{"};
+	uint32_t depth{};
 
 	// template<typename T>
 
 	struct field_setter
 	{
 		lson_builder* parent;
-		const char* key;
+		lson_key key;
 
 		template<typename T>
 		field_setter& operator =(const T& value)
@@ -482,7 +1127,7 @@ struct lson_builder
 		}
 	};
 
-	field_setter operator[](const char* key)
+	field_setter operator[](const lson_key& key)
 	{
 		return {this, key};
 	}
@@ -492,6 +1137,12 @@ struct lson_builder
 		return dst.size() <= 1;
 	}
 
+	// Values are separated by commas unless they open a table
+	void separate()
+	{
+		if (dst.back() != '{') dst.push_back(',');
+	}
+
 	static bool fitting_key(const char* key, size_t len)
 	{
 		if (len == 0 || !isalpha(key[0])) return false;
@@ -502,6 +1153,18 @@ struct lson_builder
 		return true;
 	}
 
+	void add_key(const lson_key& key)
+	{
+		if (key.size > 0)
+		{
+			dst.append(key.encoded, key.size);
+		}
+		else if (key.dynamic_key)
+		{
+			add_key(key.dynamic_key);
+		}
+	}
+
 	void add_key(const char* key)
 	{		
 		if (key)
@@ -526,86 +1189,110 @@ struct lson_builder
 
 	void add_string(const char* data, size_t size)
 	{
-		dst.reserve(size + 2);
+		dst.reserve(dst.size() + size + 2);
 		dst.push_back('"');
-		for (auto i = 0U; i < size; ++i)
+		for (auto i = 0ULL; i < size;)
 		{
-			auto c = data[i];
-			if (c == 0)
-			{
-				dst.push_back('\\');
-				dst.push_back('0');
-			}
-			else if (c == '\n')
-			{
-				dst.push_back('\\');
-				dst.push_back('n');
-			}
-			else
-			{
-				if (c == '"' || c == '\\')
-				{
-					dst.push_back('\\');
-				}
-				dst.push_back(c);
-			}
+			const auto next = i + lson_escape_position(&data[i], size - i);
+			dst.append(&data[i], next - i);
+			if (next == size) break;
+			const auto c = data[next];
+			dst.push_back('\\');
+			dst.push_back(c == 0 ? '0' : c == '\n' ? 'n' : c);
+			i = next + 1;
 		}
 		dst.push_back('"');
 	}
 
-	lson_builder& add_raw(const char* key, const std::string& child)
+	lson_builder& add_raw(const lson_key& key, const std::string& child)
 	{
-		if (dst.size() > 1) dst.push_back(',');
+		separate();
 		add_key(key);
 		dst += child;
 		return *this;
 	}
 
-	lson_builder& add(const char* key, const lson_builder& child)
+	// Floats get the shortest form that reads back to the same value
+	template<typename T>
+	void add_number(T src)
+	{
+		char buffer[32];
+		const auto r = std::to_chars(buffer, buffer + sizeof buffer, src);
+		dst.append(buffer, r.ptr);
+	}
+
+	// Copies the whole child, prefer begin() and end() to write nested tables in place
+	lson_builder& add(const lson_key& key, const lson_builder& child)
 	{
-		if (dst.size() > 1) dst.push_back(',');
+		separate();
 		add_key(key);
 		dst += child.dst;
 		dst.push_back('}');
 		return *this;
 	}
 
-	/*template<typename Callback>
-	void child(const char* key, Callback&& callback)
+	// Opens a nested table in the same buffer, values added until matching end() go into it
+	lson_builder& begin(const lson_key& key)
+	{
+		separate();
+		add_key(key);
+		dst.push_back('{');
+		++depth;
+		return *this;
+	}
+
+	// Unmatched call is a bug in the caller, release builds leave the table as it is
+	lson_builder& end()
+	{
+		assert(depth > 0 && "lson_builder::end() without begin()");
+		if (depth > 0)
+		{
+			dst.push_back('}');
+			--depth;
+		}
+		return *this;
+	}
+
+	template<typename Callback>
+	lson_builder& child(const lson_key& key, Callback&& callback)
 	{
-		lson_builder c;
-		callback(c);
-		add_raw(key, c.finalize());
-	}*/
+		begin(key);
+		callback(*this);
+		return end();
+	}
 
 	template<typename T>
-		requires(std::is_arithmetic_v<T> && !std::_Is_character_or_bool<T>::value)
-	lson_builder& add(const char* key, T src)
+		requires(std::is_arithmetic_v<T> && !is_character_or_bool<T>)
+	lson_builder& add(const lson_key& key, T src)
 	{
-		add_raw(key, std::to_string(src));
+		separate();
+		add_key(key);
+		add_number(src);
 		return *this;
 	}
 
 	template<typename T>
-		requires(std::is_arithmetic_v<T> && !std::_Is_character_or_bool<T>::value)
-	lson_builder& add_opt(const char* key, T src)
+		requires(std::is_arithmetic_v<T> && !is_character_or_bool<T>)
+	lson_builder& add_opt(const lson_key& key, T src)
 	{
 		if (src != T{})
 		{
-			add_raw(key, std::to_string(src));
+			add(key, src);
 		}
 		return *this;
 	}
 
 	template<typename T>
 		requires(std::is_enum_v<T>)
-	lson_builder& add(const char* key, T src)
+	lson_builder& add(const lson_key& key, T src)
 	{
-		add_raw(key, std::to_string(std::underlying_type_t<T>(src)));
+		separate();
+		add_key(key);
+		add_number(std::underlying_type_t<T>(src));
 		return *this;
 	}
 	
-	lson_builder& add(const char* key, const cef_time_t& src)
+	lson_builder& add(const lson_key& key, const cef_time_t& src)
 	{
 		time_t time;
 		cef_time_to_timet(&src, &time);
@@ -613,48 +1300,54 @@ struct lson_builder
 		return *this;
 	}
 	
-	lson_builder& add(const char* key, bool src)
+	lson_builder& add(const lson_key& key, bool src)
 	{
-		add_raw(key, src ? "true" : "false");
+		separate();
+		add_key(key);
+		dst += src ? "true" : "false";
 		return *this;
 	}
 
-	lson_builder& add(const char* key, const char* src)
+	lson_builder& add(const lson_key& key, const char* src)
 	{
 		if (!src) return *this;
 		add(key, std::string(src));
 		return *this;
 	}
 
-	lson_builder& add_opt(const char* key, const std::string& src)
+	lson_builder& add_opt(const lson_key& key, const std::string& src)
 	{
 		if (src.empty()) return *this;
 		add(key, src);
 		return *this;
 	}
 
-	lson_builder& add(const char* key, const std::string& src)
+	lson_builder& add(const lson_key& key, const std::string& src)
 	{
-		if (dst.size() > 1) dst.push_back(',');
+		separate();
 		add_key(key);
 		add_string(src.data(), src.size());
 		return *this;
 	}
 
-	lson_builder& add(const char* key, const utils::str_view& src)
+	lson_builder& add(const lson_key& key, const utils::str_view& src)
 	{
-		if (dst.size() > 1) dst.push_back(',');
+		separate();
 		add_key(key);
 		add_string(src.data(), src.size());
 		return *this;
 	}
 
-	lson_builder& add(const char* key, const CefString& src)
+	lson_builder& add(const lson_key& key, const CefString& src)
 	{
-		return add(key, src.ToString());
+		const auto& converted = utils::utf8_scratch(src);
+		separate();
+		add_key(key);
+		add_string(converted.data(), converted.size());
+		return *this;
 	}
 
-	lson_builder& add(const char* key, const cef_string_t& src)
+	lson_builder& add(const lson_key& key, const cef_string_t& src)
 	{
 		if (!src.length || !src.str)
 		{
@@ -668,24 +1361,23 @@ struct lson_builder
 	}
 
 	template<typename T>
-	lson_builder& add(const char* key, const std::vector<T>& src)
+	lson_builder& add(const lson_key& key, const std::vector<T>& src)
 	{
-		lson_builder child;
-		for (auto i : src)
+		begin(key);
+		for (const auto& i : src)
 		{
-			child.add(nullptr, i);
+			add(nullptr, i);
 		}
-		add(key, child);
-		return *this;
+		return end();
 	}
 
-	lson_builder& add_opt(const char* key, const CefString& src)
+	lson_builder& add_opt(const lson_key& key, const CefString& src)
 	{
 		if (src.empty()) return *this;
-		return add(key, src.ToString());
+		return add(key, src);
 	}
 
-	lson_builder& add_opt(const char* key, const cef_string_t& src)
+	lson_builder& add_opt(const lson_key& key, const cef_string_t& src)
 	{
 		if (src.length == 0 || !src.str) return *this;
 		return add(key, src);
@@ -693,11 +1385,109 @@ struct lson_builder
 
 	std::string finalize()
 	{
+		while (depth > 0) end();
 		dst.push_back('}');
 		return std::move(dst);
 	}
 };
 
+// Compact encoding of frequent events, sent instead of LSON once frontend sets `binaryEvents` option to a supported version.
+// Payload is accsp_binary_header, then `fixed_size` bytes of event struct, then `strings` strings each stored as [size:2][bytes].
+// Frontend skips fixed fields it does not know by `fixed_size`, so new fields can be appended to the structs later.
+#define ACCSP_BINARY_VERSION 1
+
+enum class accsp_binary_schema : uint8_t
+{
+	load_state = 1,
+	found_result = 2,
+	context_menu = 3,
+};
+
+struct accsp_binary_header
+{
+	uint8_t version;
+	accsp_binary_schema schema;
+	uint8_t fixed_size;
+	uint8_t strings;
+};
+
+// Used for both load_start and load_end
+struct accsp_binary_load_state
+{
+	int32_t flags;
+	int32_t status;
+	uint8_t secure;
+	uint8_t post;
+	uint8_t _pad[2]{};
+};
+
+struct accsp_binary_found_result
+{
+	int32_t identifier;
+	int32_t index;
+	int32_t count;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	uint8_t final_update;
+	uint8_t _pad[3]{};
+};
+
+// Followed by strings: originURL, sourceURL, linkURL, unfilteredLinkURL, selectedText, titleText (empty if missing)
+struct accsp_binary_context_menu
+{
+	int32_t x;
+	int32_t y;
+	uint8_t editable;
+	uint8_t _pad[3]{};
+};
+
+static_assert(sizeof(accsp_binary_header) == 4 && sizeof(accsp_binary_load_state) == 12 
+	&& sizeof(accsp_binary_found_result) == 32 && sizeof(accsp_binary_context_menu) == 12);
+
+struct binary_builder
+{
+	std::string dst;
+
+	template<typename T>
+	binary_builder(accsp_binary_schema schema, const T& fixed)
+	{
+		static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= UINT8_MAX);
+		const accsp_binary_header header{ACCSP_BINARY_VERSION, schema, uint8_t(sizeof(T)), 0};
+		dst.resize(sizeof header + sizeof(T));
+		memcpy(&dst[0], &header, sizeof header);
+		memcpy(&dst[sizeof header], &fixed, sizeof(T));
+	}
+
+	// Strings longer than 64 KB are cut
+	binary_builder& add(const char* data, size_t size)
+	{
+		const auto length = uint16_t(std::min(size, size_t(UINT16_MAX)));
+		const auto p = dst.size();
+		dst.resize(p + 2 + length);
+		memcpy(&dst[p], &length, 2);
+		memcpy(&dst[p + 2], data, length);
+		++dst[offsetof(accsp_binary_header, strings)];
+		return *this;
+	}
+
+	binary_builder& add(const std::string& src)
+	{
+		return add(src.data(), src.size());
+	}
+
+	binary_builder& add(const CefString& src)
+	{
+		return add(utils::utf8_scratch(src));
+	}
+
+	std::string finalize()
+	{
+		return std::move(dst);
+	}
+};
+
 struct accsp_mapped : noncopyable
 {
 	HANDLE entry_handle{};
@@ -725,6 +1515,30 @@ struct accsp_mapped_typed : accsp_mapped
 	T* operator ->() const { return entry; }
 };
 
+// Per-tab set of persistently mapped blocks for messages too large for a frame. Blocks come in power-of-two size classes, so once
+// a message is read, its block can carry the next one of a similar size without creating and mapping a new kernel object.
+struct accsp_mapped_pool : noncopyable
+{
+	struct block
+	{
+		int key{};
+		std::unique_ptr<accsp_mapped> mapping;
+	};
+
+	uint64_t hits{};
+	uint64_t misses{};
+
+	// Mapped as `<prefix>_<key>`, with at least size bytes
+	block acquire(const std::wstring& prefix, size_t size);
+	void release(block&& item);
+	size_t pooled_size() const { return pooled_size_; }
+
+private:
+	std::vector<block> free_;
+	size_t pooled_size_{};
+	uint32_t next_key_{};
+};
+
 template <typename... Args>
 std::string strformat(const char* format, Args&& ...args)
 {
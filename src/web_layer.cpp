@@ -4,8 +4,6 @@
 #include <functional>
 #include <iostream>
 #include <mutex>
-#include <random>
-#include <regex>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -17,6 +15,7 @@
 #include <include/cef_request_context_handler.h>
 
 #include "composition.h"
+#include "pattern.h"
 #include "util.h"
 
 struct WebView;
@@ -176,9 +175,51 @@ struct DevToolsClient : CefClient
 #define PMSG_FORM_DATA "csp-form-data"
 #define PMSG_FILL_FORM "csp-fill-form"
 #define PMSG_KILL "csp-msg-kill"
+#define PMSG_INJECTION "csp-injection"
 
 #define FLAGS cef_v8_propertyattribute_t(V8_PROPERTY_ATTRIBUTE_DONTENUM | V8_PROPERTY_ATTRIBUTE_DONTDELETE | V8_PROPERTY_ATTRIBUTE_READONLY)
 
+static utils::pattern create_regex(const utils::str_view& value)
+{
+	try
+	{
+		return utils::pattern::compile(value);
+	}
+	catch (std::exception& e)
+	{
+		std::cout << "Incorrect regex: " << value.str() << ", " << e.what() << std::endl;
+		return utils::pattern::compile(utils::str_view{"^___never_{1024}shouldneverhappen__$"});
+	}
+}
+
+using injection_entries = utils::injection_payloads::entries;
+
+// Tables are `pattern\2payload` pairs separated by `\1`, parsed the same way in browser and renderer processes
+static injection_entries parse_injection_css(const utils::str_view& table)
+{
+	injection_entries ret;
+	for (const auto& i : table.pairs('\1'))
+	{
+		ret.emplace_back(create_regex(i.first), i.second.str());
+		for (auto& c : ret.back().second)
+		{
+			if (c == '<' && _strnicmp(&c, "</style", 7) == 0) c = '?';
+		}
+	}
+	return ret;
+}
+
+static injection_entries parse_injection_js(const utils::str_view& table)
+{
+	injection_entries ret;
+	for (const auto& i : table.pairs('\1'))
+	{
+		if (i.second.find("</script>") != std::string::npos) continue;
+		ret.emplace_back(create_regex(i.first), i.second.str());
+	}
+	return ret;
+}
+
 struct ExchangeHandler : CefV8Handler
 {
 	ExchangeHandler(const CefRefPtr<CefBrowser>& browser, const CefRefPtr<CefV8Context>& context) : browser_(browser), context_(context)
@@ -336,6 +377,85 @@ struct WebApp : CefApp, CefBrowserProcessHandler, CefRenderProcessHandler
 		{
 			exchange_handler_ = new ExchangeHandler(browser, context);
 		}
+
+		// Tables from extra info are the ones browser was created with: processes started after they changed ask for current
+		// ones, which apply from the next context on
+		if (injection_requested_.insert(browser->GetIdentifier()).second)
+		{
+			frame->SendProcessMessage(PID_BROWSER, CefProcessMessage::Create(PMSG_INJECTION));
+		}
+		if (const auto f = injections_.find(browser->GetIdentifier()); f != injections_.end())
+		{
+			inject(f->second, frame, context);
+		}
+	}
+
+	// Renderer injection: same tables as response filter uses, matched against frame URL once its context is created
+	struct renderer_injection
+	{
+		std::string color_scheme;
+		injection_entries css;
+		injection_entries js;
+	};
+
+	std::unordered_map<int, renderer_injection> injections_;
+	std::unordered_set<int> injection_requested_;
+
+	void set_injection(CefRefPtr<CefBrowser> browser, const CefString& color_scheme, const CefString& css, const CefString& js)
+	{
+		renderer_injection i{utils::utf8(color_scheme),
+			parse_injection_css(utils::str_view::from_str(utils::utf8(css))), parse_injection_js(utils::str_view::from_str(utils::utf8(js)))};
+		if (i.color_scheme.empty() && i.css.empty() && i.js.empty())
+		{
+			injections_.erase(browser->GetIdentifier());
+		}
+		else
+		{
+			injections_[browser->GetIdentifier()] = std::move(i);
+		}
+	}
+
+	static void inject(const renderer_injection& injection, const CefRefPtr<CefFrame>& frame, const CefRefPtr<CefV8Context>& context)
+	{
+		const auto url = utils::utf8(frame->GetURL());
+		const auto url_view = utils::str_view::from_str(url);
+		std::string html = injection.color_scheme;
+		auto has_css = false;
+		for (const auto& i : injection.css)
+		{
+			if (!i.first.search(url_view)) continue;
+			if (!has_css) html += "<style>";
+			html += i.second;
+			has_css = true;
+		}
+		if (has_css) html += "</style>";
+
+		std::string code;
+		if (!html.empty())
+		{
+			// Document might not have any elements yet, in which case it waits for the root one to show up
+			const auto html_value = CefValue::Create();
+			html_value->SetString(html);
+			code = "(function(h){function a(){var e=document.head||document.documentElement;if(!e)return false;e.insertAdjacentHTML('beforeend',h);return true}"
+				"if(!a()){var o=new MutationObserver(function(){if(a())o.disconnect()});o.observe(document,{childList:true})}})(";
+			code += utils::utf8(CefWriteJSON(html_value, JSON_WRITER_DEFAULT));
+			code += ");";
+		}
+		for (const auto& i : injection.js)
+		{
+			if (!i.first.search(url_view)) continue;
+			code += i.second;
+			code.push_back(';');
+		}
+		if (!code.empty())
+		{
+			CefRefPtr<CefV8Value> ret;
+			CefRefPtr<CefV8Exception> exception;
+			if (!context->Eval(code, frame->GetURL(), 0, ret, exception) && exception)
+			{
+				log_message("Injection failed: %s:%d", frame->GetURL().ToString().c_str(), exception->GetLineNumber());
+			}
+		}
 	}
 
 	void OnUncaughtException(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefV8Context> context, CefRefPtr<CefV8Exception> exception,
@@ -344,8 +464,20 @@ struct WebApp : CefApp, CefBrowserProcessHandler, CefRenderProcessHandler
 		log_message("OnUncaughtException: %s", exception->GetScriptResourceName().ToString().c_str());
 	}
 
-	void OnBrowserCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefDictionaryValue> extra_info) override { }
-	void OnBrowserDestroyed(CefRefPtr<CefBrowser> browser) override { exchange_handler_ = nullptr; }
+	void OnBrowserCreated(CefRefPtr<CefBrowser> browser, CefRefPtr<CefDictionaryValue> extra_info) override
+	{
+		if (extra_info && extra_info->HasKey("injectionCSS"))
+		{
+			set_injection(browser, extra_info->GetString("injectionColorScheme"), extra_info->GetString("injectionCSS"), extra_info->GetString("injectionJS"));
+		}
+	}
+
+	void OnBrowserDestroyed(CefRefPtr<CefBrowser> browser) override
+	{
+		exchange_handler_ = nullptr;
+		injections_.erase(browser->GetIdentifier());
+		injection_requested_.erase(browser->GetIdentifier());
+	}
 
 	bool OnProcessMessageReceived(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefProcessId source_process,
 		CefRefPtr<CefProcessMessage> message) override
@@ -354,6 +486,15 @@ struct WebApp : CefApp, CefBrowserProcessHandler, CefRenderProcessHandler
 		{
 			std::quick_exit(1);
 		}
+		if (message->GetName() == PMSG_INJECTION)
+		{
+			const auto args = message->GetArgumentList();
+			if (args->GetSize() == 3)
+			{
+				set_injection(browser, args->GetString(0), args->GetString(1), args->GetString(2));
+			}
+			return true;
+		}
 		if (message->GetName() == PMSG_RECEIVE_IN)
 		{
 			const auto args = message->GetArgumentList();
@@ -646,19 +787,23 @@ public:
 		close();
 	}
 
+	accsp_frame_index commands_index;
+
 	template<typename Callback>
 	bool iterate_commands(Callback&& callback)
 	{
 		auto entry = mmf->entry;
 		if (entry->commands_set == 0) return false;
-		auto p = entry->commands;
-		for (auto _ = entry->commands_set; _ > 0; --_)
+		if (commands_index.parse(entry->commands, ACCSP_FRAME_SIZE, entry->commands_set))
+		{
+			for (const auto& r : commands_index)
+			{
+				callback(command_be(r.key), commands_index.payload(r));
+			}
+		}
+		else
 		{
-			auto k = p[0];
-			auto s = *(uint16_t*)&p[1];
-			p += 3;
-			callback(command_be(k), utils::str_view(p, 0, s));
-			p += s;
+			std::cout << "Damaged commands frame, dropped: " << entry->commands_set << " records" << std::endl;
 		}
 		__faststorefence();
 		return true;
@@ -954,15 +1099,15 @@ public:
 				ret->set_response(500, "text/plain", "", "Damaged exchange");
 			}
 		}));
-		data.push_back(request->GetURL().ToString());
-		data.push_back(request->GetMethod().ToString());
+		data.push_back(utils::utf8(request->GetURL()));
+		data.push_back(utils::utf8(request->GetMethod()));
 		{
 			lson_builder headers;
 			CefRequest::HeaderMap map;
 			request->GetHeaderMap(map);
 			for (auto& p : map)
 			{
-				headers.add(p.first.ToString().c_str(), p.second);
+				headers.add(lson_key::dynamic(p.first.ToString().c_str()), p.second);
 			}
 			data.push_back(headers.finalize());
 		}
@@ -1060,6 +1205,43 @@ public:
 			|| k == command_fe::audio;
 	}
 
+	// Outgoing records go through separate lanes, so replies and dialogs never wait behind page telemetry
+	enum class response_lane
+	{
+		interactive,
+		state,
+		telemetry,
+		count
+	};
+
+	static response_lane lane_of(command_fe k)
+	{
+		switch (k)
+		{
+			case command_fe::reply:
+			case command_fe::open_url:
+			case command_fe::popup:
+			case command_fe::jsdialog_dialog:
+			case command_fe::download:
+			case command_fe::context_menu:
+			case command_fe::file_dialog:
+			case command_fe::auth_credentials:
+			case command_fe::custom_scheme_browse:
+			case command_fe::csp_scheme_request:
+			case command_fe::virtual_keyboard_request: return response_lane::interactive;
+			case command_fe::url_monitor:
+			case command_fe::download_update: return response_lane::telemetry;
+			default: return response_lane::state;
+		}
+	}
+
+	// Bytes each lane can submit per frame, so that with ring exchange there is always space left for next frame replies
+	constexpr static std::array<size_t, size_t(response_lane::count)> response_lane_budget{SIZE_MAX, 64 * 1024, 16 * 1024};
+
+	// Once telemetry backlog gets this long, only every eighth URL is kept, and after the second limit new ones are dropped
+	constexpr static uint32_t telemetry_sample_from = 1024;
+	constexpr static uint32_t telemetry_drop_from = 4096;
+
 	enum class command_be : char
 	{
 		large_command = '\2',
@@ -1105,6 +1287,16 @@ public:
 	bool RunContextMenu(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefContextMenuParams> params, CefRefPtr<CefMenuModel> model,
 		CefRefPtr<CefRunContextMenuCallback> callback) override
 	{
+		if (binary_events)
+		{
+			set_response(command_fe::context_menu, binary_builder(accsp_binary_schema::context_menu, 
+				accsp_binary_context_menu{params->GetXCoord(), params->GetYCoord(), params->IsEditable()})
+				.add(params->GetFrameUrl()).add(params->GetSourceUrl()).add(params->GetLinkUrl()).add(params->GetUnfilteredLinkUrl())
+				.add(params->GetSelectionText()).add(params->GetTitleText())
+				.finalize());
+			return true;
+		}
+
 		lson_builder b;
 		b.add("originURL", params->GetFrameUrl());
 		b.add_opt("sourceURL", params->GetSourceUrl());
@@ -1183,10 +1375,10 @@ public:
 	bool OnBeforeBrowse(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefRequest> request,
 		bool user_gesture, bool is_redirect) override
 	{
-		if (!redirect_nonstandard_schemes_filter._Empty())
+		const auto r = current_rules();
+		if (!r->redirect_nonstandard_schemes_filter.empty())
 		{
-			std::unique_lock lock(redirect_nonstandard_schemes_mutex);
-			if (test_regex(request->GetURL().ToString(), redirect_nonstandard_schemes_filter))
+			if (test_regex(utils::utf8_scratch(request->GetURL()), r->redirect_nonstandard_schemes_filter))
 			{
 				if (frame->IsMain())
 				{
@@ -1242,20 +1434,23 @@ public:
 
 		log_message("Got form data: %s", url.c_str());
 		auto str = data.ToString();
-		auto pieces = utils::str_view::from_str(str).split('\n', false, false);
+		const auto lines = utils::str_view::from_str(str);
 		lson_builder b;
-		for (auto p : pieces)
+		b.add("actionURL", url).add("originURL", original_url).begin("form");
+		auto inputs = 0U;
+		for (const auto p : lines.pieces('\n'))
 		{
 			auto v = p.split('\r', false, false);
 			if (v.size() == 4 && v[0] == url)
 			{
-				b.add(v[2].str().c_str(), lson_builder{}.add("type", v[1]).add("value", v[3]));
+				b.begin(lson_key::dynamic(v[2].str().c_str())).add("type", v[1]).add("value", v[3]).end();
+				++inputs;
 				log_message("Form input: URL=%s, type=%s, name=%s, value=%s", v[0].str().c_str(), v[1].str().c_str(), v[2].str().c_str(), v[3].str().c_str());
 			}
 		}
-		if (!b.empty())
+		if (inputs > 0)
 		{
-			auto finalized = lson_builder{}.add("actionURL", url).add("originURL", original_url).add("form", b).finalize();
+			auto finalized = b.finalize();
 
 			std::unique_lock lock(track_form_mutex);		
 			if (track_form_data_state == 2)
@@ -1362,6 +1557,11 @@ public:
 			process_form_data(message->GetArgumentList()->GetString(0));
 			return true;
 		}
+		if (message->GetName() == PMSG_INJECTION)
+		{
+			send_injection_rules(frame);
+			return true;
+		}
 		return false;
 	}
 
@@ -1481,6 +1681,7 @@ public:
 			}
 
 			own_zoom_phase = UINT32_MAX;
+			send_injection_rules();
 		}
 	}
 
@@ -1531,18 +1732,16 @@ public:
 		b["targetURL"] = target_url;
 		b["targetFrameName"] = target_frame_name;
 		b["targetDisposition"] = encode_wodisp(target_disposition);
-		{
-			lson_builder f;
-			if (popup_features.widthSet) f["width"] = popup_features.width;
-			if (popup_features.heightSet) f["height"] = popup_features.height;
-			if (popup_features.xSet) f["x"] = popup_features.x;
-			if (popup_features.ySet) f["y"] = popup_features.y;
-			f["menuBarVisible"] = popup_features.menuBarVisible;
-			f["statusBarVisible"] = popup_features.statusBarVisible;
-			f["toolBarVisible"] = popup_features.toolBarVisible;
-			f["scrollbarsVisible"] = popup_features.scrollbarsVisible;
-			b["features"] = f;
-		}
+		b.begin("features");
+		if (popup_features.widthSet) b["width"] = popup_features.width;
+		if (popup_features.heightSet) b["height"] = popup_features.height;
+		if (popup_features.xSet) b["x"] = popup_features.x;
+		if (popup_features.ySet) b["y"] = popup_features.y;
+		b["menuBarVisible"] = popup_features.menuBarVisible;
+		b["statusBarVisible"] = popup_features.statusBarVisible;
+		b["toolBarVisible"] = popup_features.toolBarVisible;
+		b["scrollbarsVisible"] = popup_features.scrollbarsVisible;
+		b.end();
 		set_response(command_fe::popup, b.finalize());
 		return true;
 	}
@@ -1554,7 +1753,7 @@ public:
 
 	void update_url(const CefString& url)
 	{
-		auto str = url.ToString();
+		auto str = utils::utf8(url);
 		if (str != last_url)
 		{
 			set_response(command_fe::url, str);
@@ -1562,6 +1761,25 @@ public:
 		}
 	}
 
+	std::string load_state_data(const CefRefPtr<CefBrowser>& browser) const
+	{
+		const auto entry = browser->GetHost()->GetVisibleNavigationEntry();
+		const auto ssl = entry->GetSSLStatus();
+		const auto secure = ssl && ssl->IsSecureConnection() && ssl->GetCertStatus() == 0;
+		if (binary_events)
+		{
+			return binary_builder(accsp_binary_schema::load_state, accsp_binary_load_state{
+				int32_t(entry->GetTransitionType()), entry->GetHttpStatusCode(), secure, entry->HasPostData()}).finalize();
+		}
+
+		lson_builder b;
+		b.add("secure", secure);
+		b.add("post", entry->HasPostData());
+		b.add("flags", entry->GetTransitionType());
+		b.add("status", entry->GetHttpStatusCode());
+		return b.finalize();
+	}
+
 	void OnLoadStart(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, TransitionType transition_type) override
 	{
 		if (had_error)
@@ -1572,20 +1790,7 @@ public:
 		{
 			update_url(frame->GetURL());
 
-			const auto entry = browser->GetHost()->GetVisibleNavigationEntry();
-			lson_builder b;
-			if (const auto ssl = entry->GetSSLStatus())
-			{
-				b.add("secure", ssl->IsSecureConnection() && ssl->GetCertStatus() == 0);
-			}
-			else
-			{
-				b.add("secure", false);
-			}
-			b.add("post", entry->HasPostData());
-			b.add("flags", entry->GetTransitionType());
-			b.add("status", entry->GetHttpStatusCode());
-			set_response(command_fe::load_start, b.finalize());
+			set_response(command_fe::load_start, load_state_data(browser));
 		}
 	}
 
@@ -1636,20 +1841,7 @@ public:
 				}
 			}
 
-			const auto entry = browser->GetHost()->GetVisibleNavigationEntry();
-			lson_builder b;
-			if (const auto ssl = entry->GetSSLStatus())
-			{
-				b.add("secure", ssl->IsSecureConnection() && ssl->GetCertStatus() == 0);
-			}
-			else
-			{
-				b.add("secure", false);
-			}
-			b.add("post", entry->HasPostData());
-			b.add("flags", entry->GetTransitionType());
-			b.add("status", entry->GetHttpStatusCode());
-			set_response(command_fe::load_end, b.finalize());
+			set_response(command_fe::load_end, load_state_data(browser));
 		}
 	}
 
@@ -1660,15 +1852,119 @@ public:
 	}
 
 	bool loaded_resources_monitor{};
-	bool loaded_resources_filter{};
-	bool use_custom_headers{};
 	bool redirect_navigation{};
+	uint32_t binary_events{};
 	bool keep_suspended_texture{};
 	bool had_error{};
-	std::mutex resources_filter_mutex;
-	std::mutex custom_headers_mutex;
-	std::regex resources_filter;
-	std::vector<std::pair<std::regex, std::vector<std::pair<CefString, CefString>>>> custom_headers;
+
+	// Everything request handlers on IO and UI threads match URLs against. Generations are per cache, so that changing
+	// certificate or redirect filters, color scheme or injection mode does not throw away verdicts nobody changed.
+	struct url_rules
+	{
+		uint32_t verdicts_generation{};
+		uint32_t payloads_generation{};
+		bool loaded_resources_filter{};
+		utils::pattern resources_filter;
+		std::vector<std::pair<utils::pattern, std::vector<std::pair<CefString, CefString>>>> custom_headers;
+		utils::pattern_set custom_headers_patterns;
+		injection_entries injection_entries_css;
+		injection_entries injection_entries_js;
+		utils::pattern_set injection_patterns_css;
+		utils::pattern_set injection_patterns_js;
+		std::string color_scheme_active;
+
+		// With renderer injection, source tables go to renderer processes and responses are left alone
+		bool renderer_injection{};
+		std::string injection_table_css;
+		std::string injection_table_js;
+		utils::pattern redirect_nonstandard_schemes_filter;
+		utils::pattern ignore_certificate_errors_filter;
+
+		bool use_custom_headers() const { return !custom_headers.empty(); }
+		bool use_injection() const { return !injection_entries_css.empty() || !injection_entries_js.empty() || !color_scheme_active.empty(); }
+	};
+
+	utils::rules_snapshot<url_rules> rules;
+
+	// What an update changes: filter, header and injection patterns tag cached verdicts, injection entries and color
+	// scheme tag memoized payloads
+	enum rules_change : uint8_t
+	{
+		rules_other = 0,
+		rules_patterns = 1,
+		rules_payloads = 2,
+	};
+
+	utils::rules_snapshot<url_rules>::reader current_rules() const
+	{
+		return rules.current();
+	}
+
+	template<typename Callback>
+	void update_rules(uint8_t change, Callback&& callback)
+	{
+		rules.update([&](url_rules& r)
+		{
+			callback(r);
+			if (change & rules_patterns) ++r.verdicts_generation;
+			if (change & rules_payloads) ++r.payloads_generation;
+		});
+	}
+
+	std::atomic<bool> renderer_injection_sent{};
+
+	// Injection tables for renderer processes of a browser about to be created. Tables changed before browser shows up
+	// are sent again from OnAfterCreated(), renderer processes started later ask for current ones themselves.
+	CefRefPtr<CefDictionaryValue> injection_extra_info()
+	{
+		const auto r = current_rules();
+		if (!r->renderer_injection) return nullptr;
+		renderer_injection_sent = true;
+		auto ret = CefDictionaryValue::Create();
+		ret->SetString("injectionColorScheme", r->color_scheme_active);
+		ret->SetString("injectionCSS", r->injection_table_css);
+		ret->SetString("injectionJS", r->injection_table_js);
+		return ret;
+	}
+
+	// Current injection tables, or empty ones once renderer injection is switched off
+	static CefRefPtr<CefProcessMessage> injection_message(const url_rules& r)
+	{
+		auto message = CefProcessMessage::Create(PMSG_INJECTION);
+		const auto args = message->GetArgumentList();
+		args->SetString(0, r.renderer_injection ? r.color_scheme_active : std::string());
+		args->SetString(1, r.renderer_injection ? r.injection_table_css : std::string());
+		args->SetString(2, r.renderer_injection ? r.injection_table_js : std::string());
+		return message;
+	}
+
+	// Sends injection tables to renderer processes of every frame. Without browser yet nothing is sent and nothing is marked
+	// as sent: OnAfterCreated() calls it again.
+	void send_injection_rules()
+	{
+		const auto browser = safe_browser();
+		const auto r = current_rules();
+		if (!browser || (!r->renderer_injection && !renderer_injection_sent)) return;
+		renderer_injection_sent = r->renderer_injection;
+
+		std::vector<int64> frames;
+		browser->GetFrameIdentifiers(frames);
+		for (auto f : frames)
+		{
+			if (auto frame = browser->GetFrame(f))
+			{
+				frame->SendProcessMessage(PID_RENDERER, injection_message(*r));
+			}
+		}
+	}
+
+	// Reply to renderer process asking for tables on its first V8 context
+	void send_injection_rules(const CefRefPtr<CefFrame>& frame)
+	{
+		const auto r = current_rules();
+		if (!r->renderer_injection && !renderer_injection_sent) return;
+		frame->SendProcessMessage(PID_RENDERER, injection_message(*r));
+	}
 
 	void OnScrollOffsetChanged(CefRefPtr<CefBrowser> browser, double x, double y) override
 	{
@@ -1676,42 +1972,85 @@ public:
 		mmf->entry->scroll_y = float(y);
 	}
 
-	static bool test_regex(const std::string& s, const std::regex& r)
+	utils::url_verdict_cache verdict_cache;
+
+	// Rules of a set matching URL, taken from verdict cache if possible. Sets of over 64 rules are not cached.
+	void match_cached(const utils::url_verdict_cache::key& key, utils::url_verdict::part part, const utils::pattern_set& set, const std::string& url,
+		utils::url_verdict& verdict, utils::pattern_set::mask& matched)
+	{
+		auto& mask = part == utils::url_verdict::headers ? verdict.headers_mask : part == utils::url_verdict::css ? verdict.css_mask : verdict.js_mask;
+		if (verdict_cache.lookup(key, part, verdict))
+		{
+			matched.assign(1, mask);
+			return;
+		}
+		set.search(utils::str_view::from_str(url), matched);
+		if (matched.size() == 1)
+		{
+			mask = matched[0];
+			verdict_cache.store(key, part, verdict);
+		}
+	}
+
+	static bool test_regex(const std::string& s, const utils::pattern& r)
+	{
+		return r.search(utils::str_view::from_str(s));
+	}
+
+	template<typename T>
+	static utils::pattern_set create_pattern_set(const std::vector<std::pair<utils::pattern, T>>& entries)
 	{
-		return r._Empty() || std::regex_search(s, r);
+		std::vector<utils::pattern> patterns;
+		patterns.reserve(entries.size());
+		for (const auto& i : entries)
+		{
+			patterns.push_back(i.first);
+		}
+		return utils::pattern_set{std::move(patterns)};
 	}
 
 	ReturnValue OnBeforeResourceLoad(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefRequest> request, CefRefPtr<CefCallback> callback) override
 	{
-		if (loaded_resources_filter)
+		// Converted once into a buffer of IO thread, only used until this call returns. Not utf8_scratch(): builders write
+		// into that one, and URL has to survive until the end
+		thread_local std::string url;
+		utils::utf8_assign(url, request->GetURL());
+		const auto r = current_rules();
+		const utils::url_verdict_cache::key key{r->loaded_resources_filter || r->use_custom_headers() ? hash_code_raw(url.data(), url.size()) : 0ULL, r->verdicts_generation};
+		utils::url_verdict verdict;
+		if (r->loaded_resources_filter)
 		{
-			std::unique_lock lock(resources_filter_mutex);
-			if (test_regex(request->GetURL().ToString(), resources_filter))
+			if (!verdict_cache.lookup(key, utils::url_verdict::filter, verdict))
+			{
+				verdict.blocked = test_regex(url, r->resources_filter);
+				verdict_cache.store(key, utils::url_verdict::filter, verdict);
+			}
+			if (verdict.blocked)
 			{
 				if (loaded_resources_monitor)
 				{
-					set_response(command_fe::url_monitor, request->GetURL().ToString() + '\1' + '1');
+					set_response(command_fe::url_monitor, url + '\1' + '1');
 				}
 				return RV_CANCEL;
 			}
 			if (loaded_resources_monitor)
 			{
-				set_response(command_fe::url_monitor, request->GetURL());
+				set_response(command_fe::url_monitor, url);
 			}
 		}
 		else if (loaded_resources_monitor)
 		{
-			set_response(command_fe::url_monitor, request->GetURL());
+			set_response(command_fe::url_monitor, url);
 		}
-		if (use_custom_headers)
+		if (r->use_custom_headers())
 		{
-			std::unique_lock lock(custom_headers_mutex);
-			const auto url = request->GetURL().ToString();
-			for (auto& i : custom_headers)
+			thread_local utils::pattern_set::mask matched;
+			match_cached(key, utils::url_verdict::headers, r->custom_headers_patterns, url, verdict, matched);
+			for (auto i = 0U; i < r->custom_headers.size(); ++i)
 			{
-				if (test_regex(url, i.first))
+				if (utils::pattern_set::test(matched, i))
 				{
-					for (auto& p : i.second)
+					for (auto& p : r->custom_headers[i].second)
 					{
 						request->SetHeaderByName(p.first, p.second, true);
 					}
@@ -1727,232 +2066,118 @@ public:
 		return this;
 	}
 
-	bool use_injection{};
-	std::mutex injection_mutex;
-	std::vector<std::pair<std::regex, std::string>> injection_entries_css;
-	std::vector<std::pair<std::regex, std::string>> injection_entries_js;
 
 	struct TargettedResourceFilter : CefResponseFilter
 	{
-		std::string injection_data;
-		std::string injection_combined;
-		uint64_t injection_combined_pos{};
+		html_injector injector;
 
-		TargettedResourceFilter(std::string data) : injection_data(std::move(data)) {}
+		TargettedResourceFilter(std::shared_ptr<const std::string> data) : injector(std::move(data)) {}
 		bool InitFilter() override { return true; }
 
 		FilterStatus Filter(void* data_in, size_t data_in_size, size_t& data_in_read,
 			void* data_out, size_t data_out_size, size_t& data_out_written) override
 		{
-			if (data_in_size == 0)
-			{
-				if (injection_combined_pos > 0)
-				{
-					data_in_read = 0;
-					const auto left = injection_combined.size() - injection_combined_pos;
-					if (left <= data_out_size)
-					{
-						memcpy(data_out, injection_combined.data() + injection_combined_pos, left);
-						data_out_written = left;
-						injection_combined_pos = 0;
-						return RESPONSE_FILTER_DONE;
-					}
-
-					memcpy(data_out, injection_combined.data() + injection_combined_pos, data_out_size);
-					injection_combined_pos += data_out_size;
-					data_out_written = data_out_size;
-					return RESPONSE_FILTER_NEED_MORE_DATA;
-				}
-				data_in_read = 0;
-				data_out_written = 0;
-				return RESPONSE_FILTER_DONE;
-			}
-
-			const auto s = utils::str_view((const char*)data_in, 0, data_in_size);
-			data_in_read = data_in_size;
-
-			const auto f = s.find("</head>");
-			if (f == std::string::npos)
-			{
-				const auto size = std::min(data_in_size, data_out_size);
-				memcpy(data_out, data_in, size);
-				data_in_read = size;
-				data_out_written = size;
-			}
-			else
-			{
-				auto new_size = data_in_size + injection_data.size();
-				if (new_size <= data_out_size)
-				{
-					memcpy(data_out, data_in, f);
-					memcpy((void*)((const char*)data_out + f), injection_data.data(), injection_data.size());
-					memcpy((void*)((const char*)data_out + f + injection_data.size()), s.data() + f, data_in_size - f);
-					data_out_written = new_size;
-				}
-				else
-				{
-					if (f <= data_out_size)
-					{
-						memcpy(data_out, data_in, f);
-						injection_combined.resize(new_size - f);
-						memcpy(injection_combined.data(), injection_data.data(), injection_data.size());
-						memcpy(injection_combined.data() + injection_data.size(), s.data() + f, data_in_size - f);
-						memcpy((void*)((const char*)data_out + f), injection_combined.data(), data_out_size - f);
-						injection_combined_pos = data_out_size - f;
-					}
-					else
-					{
-						injection_combined.resize(new_size);
-						memcpy(injection_combined.data(), data_in, f);
-						memcpy(injection_combined.data() + f, injection_data.data(), injection_data.size());
-						memcpy(injection_combined.data() + f + injection_data.size(), s.data() + f, data_in_size - f);
-						memcpy(data_out, injection_combined.data(), data_out_size);
-						injection_combined_pos = data_out_size;
-					}
-					data_out_written = data_out_size;
-					return RESPONSE_FILTER_NEED_MORE_DATA;
-				}
-			}
-
-			return RESPONSE_FILTER_DONE;
+			return injector.process((const char*)data_in, data_in_size, data_in_read, (char*)data_out, data_out_size, data_out_written)
+				? RESPONSE_FILTER_DONE : RESPONSE_FILTER_NEED_MORE_DATA;
 		}
 
 	private:
 		IMPLEMENT_REFCOUNTING(TargettedResourceFilter);
 	};
 
-	constexpr static size_t injection_css_prefix = std::char_traits<char>::length("<style>");
-	constexpr static size_t injection_js_prefix = std::char_traits<char>::length("<script>");
-	std::string injection_collected_css{"<style>"};
-	std::string injection_collected_js{"<script>"};
+	// Assembled payloads of recent rule combinations, shared by all filters injecting the same thing
+	utils::injection_payloads injection_payloads;
 
 	CefRefPtr<CefResponseFilter> GetResourceResponseFilter(CefRefPtr<CefBrowser> browser, CefRefPtr<CefFrame> frame, CefRefPtr<CefRequest> request,
 		CefRefPtr<CefResponse> response) override
 	{
-		if (use_injection && response->GetMimeType() == "text/html")
+		const auto r = current_rules();
+		if (!r->renderer_injection && r->use_injection() && response->GetMimeType() == "text/html")
 		{
-			const auto url = request->GetURL().ToString();
+			const auto url = utils::utf8(request->GetURL());
 			if (!utils::str_view::from_str(url).ends_with_ci(".js"))
 			{
-				std::unique_lock lock(injection_mutex);
-				injection_collected_css.resize(injection_css_prefix);
-				injection_collected_js.resize(injection_js_prefix);
-				for (auto& i : injection_entries_css)
-				{
-					if (test_regex(url, i.first))
-					{
-						injection_collected_css += i.second;
-					}
-				}
-				for (auto& i : injection_entries_js)
-				{
-					if (test_regex(url, i.first))
-					{
-						injection_collected_js += i.second;
-						injection_collected_js.push_back(';');
-					}
-				}
-				if (!color_scheme_active.empty() || injection_collected_css.size() > injection_css_prefix || injection_collected_js.size() > injection_js_prefix)
+				thread_local utils::pattern_set::mask matched_css;
+				thread_local utils::pattern_set::mask matched_js;
+				const utils::url_verdict_cache::key key{hash_code_raw(url.data(), url.size()), r->verdicts_generation};
+				utils::url_verdict verdict;
+				match_cached(key, utils::url_verdict::css, r->injection_patterns_css, url, verdict, matched_css);
+				match_cached(key, utils::url_verdict::js, r->injection_patterns_js, url, verdict, matched_js);
+				if (auto payload = injection_payloads.get(r->payloads_generation, r->color_scheme_active,
+					r->injection_entries_css, matched_css, r->injection_entries_js, matched_js))
 				{
-					std::string result;
-					result.reserve(color_scheme_active.size() + injection_collected_css.size() + injection_collected_js.size() 
-						+ injection_css_prefix + injection_js_prefix + 2);
-					result = color_scheme_active;
-					result += injection_collected_css;
-					result += "</style>";
-					result += injection_collected_js;
-					result += "</script>";
-					return new TargettedResourceFilter(std::move(result));
+					return new TargettedResourceFilter(std::move(payload));
 				}
 			}
 		}
 		return nullptr;
 	}
 	
-	std::mutex redirect_nonstandard_schemes_mutex;
-	std::regex redirect_nonstandard_schemes_filter;
-
 	bool button_ctrl{};
 	bool button_shift{};
 	bool button_alt{};
 
 	std::string initial_url = "about:blank";
 	
-	std::mutex ignore_certificate_errors_mutex;
-	std::regex ignore_certificate_errors_filter;
-
 	bool verify_full_access(const char* reason)
 	{
 		return has_full_access_;
 	}
 
-	static std::regex create_regex(const utils::str_view& value)
-	{
-		try
-		{
-			return value.empty() ? std::regex{} : std::regex{value.str(), std::regex_constants::icase | std::regex_constants::optimize | std::regex_constants::nosubs};
-		}
-		catch (std::exception& e)
-		{
-			std::cout << "Incorrect regex: " << value.str() << ", " << e.what() << std::endl;
-			return std::regex{"^___never_{1024}shouldneverhappen__$"};
-		}
-	}
-
-	bool configure_control(command_be key, const utils::str_view& value)
+	void set_option(accsp_option option, const utils::str_view& name, const utils::str_view& value)
 	{
-		if (key == command_be::navigate)
-		{
-			initial_url = value.str();
-		}
-		else if (key == command_be::set_option)
+		switch (option)
 		{
-			const auto kv = value.pair('\1');
-			if (kv.first == "ignoreCertificateErrors")
+			case accsp_option::ignore_certificate_errors:
 			{
-				std::unique_lock lock(ignore_certificate_errors_mutex);
-				ignore_certificate_errors_filter = create_regex(kv.second);
+				update_rules(rules_other, [&](url_rules& r) { r.ignore_certificate_errors_filter = create_regex(value); });
 			}
-			else if (kv.first == "trackFormData")
+			break;
+			case accsp_option::track_form_data:
 			{
 				if (verify_full_access("Track form data"))
 				{
-					track_form_data = kv.second == "1";
+					track_form_data = value == "1";
 				}
 			}
-			else if (kv.first == "redirectNavigation")
+			break;
+			case accsp_option::redirect_navigation:
 			{
-				redirect_navigation = kv.second == "1";
+				redirect_navigation = value == "1";
 			}
-			else if (kv.first == "redirectNonStandardSchemes")
+			break;
+			case accsp_option::redirect_nonstandard_schemes:
 			{
 				if (verify_full_access("Redirect non-standard schemes"))
 				{
-					std::unique_lock lock(redirect_nonstandard_schemes_mutex);
-					redirect_nonstandard_schemes_filter = create_regex(kv.second);
+					update_rules(rules_other, [&](url_rules& r) { r.redirect_nonstandard_schemes_filter = create_regex(value); });
 				}
 			}
-			else if (kv.first == "collectResourceURLs")
+			break;
+			case accsp_option::collect_resource_urls:
 			{
 				if (verify_full_access("Collect URLs"))
 				{
-					loaded_resources_monitor = kv.second == "1";
+					loaded_resources_monitor = value == "1";
 				}
 			}
-			else if (kv.first == "keepSuspendedTexture")
+			break;
+			case accsp_option::keep_suspended_texture:
 			{
-				keep_suspended_texture = kv.second == "1";
+				keep_suspended_texture = value == "1";
 			}
-			else if (kv.first == "scaleFactor")
+			break;
+			case accsp_option::scale_factor:
 			{
-				scale_factor = kv.second.as(1.f);
+				scale_factor = value.as(1.f);
 				if (const auto browser = safe_browser())
 				{
 					browser->GetHost()->NotifyScreenInfoChanged();
 					browser->GetHost()->WasResized();
 				}
 			}
-			else if (kv.first == "invalidateView")
+			break;
+			case accsp_option::invalidate_view:
 			{
 				const auto x = width_, y = height_;
 				resize(x + 1, y);
@@ -1961,73 +2186,108 @@ public:
 					resize(x, y);
 				}), 20);
 			}
-			else
+			break;
+			case accsp_option::latency_stats:
 			{
-				std::cout << "Unknown option: " << kv.first.str();
+				latency_stats_requested = value == "1";
 			}
-		}
-		else if (key == command_be::filter_resource_urls)
-		{
-			loaded_resources_filter = false;
-			if (!value.empty())
+			break;
+			case accsp_option::binary_events:
+			{
+				binary_events = std::min(value.as(0U), uint32_t(ACCSP_BINARY_VERSION));
+			}
+			break;
+			case accsp_option::renderer_injection:
+			{
+				update_rules(rules_other, [&](url_rules& r) { r.renderer_injection = value == "1"; });
+				send_injection_rules();
+			}
+			break;
+			default:
 			{
-				std::unique_lock lock(resources_filter_mutex);
-				resources_filter = create_regex(value);
-				loaded_resources_filter = true;
+				std::cout << "Unknown option: " << name.str();
 			}
+			break;
 		}
-		else if (key == command_be::set_headers)
+	}
+
+	bool configure_control(command_be key, const utils::str_view& value)
+	{
+		switch (key)
 		{
-			if (verify_full_access("Set headers"))
+			case command_be::navigate:
+			{
+				initial_url = value.str();
+			}
+			break;
+			case command_be::set_option:
+			{
+				accsp_dispatch_option(value, [this](accsp_option option, const utils::str_view& name, const utils::str_view& v)
+				{
+					set_option(option, name, v);
+				});
+			}
+			break;
+			case command_be::filter_resource_urls:
+			{
+				update_rules(rules_patterns, [&](url_rules& r)
+				{
+					r.loaded_resources_filter = !value.empty();
+					r.resources_filter = r.loaded_resources_filter ? create_regex(value) : utils::pattern{};
+				});
+			}
+			break;
+			case command_be::set_headers:
 			{
-				const auto table = value.pairs('\1');
-				std::unique_lock lock(custom_headers_mutex);
-				custom_headers.clear();
-				for (const auto& p : table)
+				if (verify_full_access("Set headers"))
 				{
-					std::vector<std::pair<CefString, CefString>> headers;
-					for (const auto& i : p.second.pairs('\2'))
+					const auto table = value.pairs('\1');
+					update_rules(rules_patterns, [&](url_rules& r)
 					{
-						headers.emplace_back(i.first, i.second);
-					}
-					custom_headers.emplace_back(create_regex(p.first), std::move(headers));
+						r.custom_headers.clear();
+						for (const auto& p : table)
+						{
+							std::vector<std::pair<CefString, CefString>> headers;
+							for (const auto& i : p.second.pairs('\2'))
+							{
+								headers.emplace_back(i.first, i.second);
+							}
+							r.custom_headers.emplace_back(create_regex(p.first), std::move(headers));
+						}
+						r.custom_headers_patterns = create_pattern_set(r.custom_headers);
+					});
 				}
-				use_custom_headers = !custom_headers.empty();
 			}
-		}
-		else if (key == command_be::inject_css)
-		{
-			const auto table = value.pairs('\1');
-			std::unique_lock lock(injection_mutex);
-			injection_entries_css.clear();
-			for (const auto& i : table)
+			break;
+			case command_be::inject_css:
 			{
-				injection_entries_css.emplace_back(create_regex(i.first), i.second.str());
-				for (auto& c : injection_entries_css.back().second)
+				update_rules(rules_patterns | rules_payloads, [&](url_rules& r)
 				{
-					if (c == '<' && _strnicmp(&c, "</style", 7) == 0) c = '?';
-				}
+					r.injection_table_css = value.str();
+					r.injection_entries_css = parse_injection_css(value);
+					r.injection_patterns_css = create_pattern_set(r.injection_entries_css);
+				});
+				send_injection_rules();
 			}
-			use_injection = !injection_entries_css.empty() || !injection_entries_js.empty() || !color_scheme_active.empty();
-		}
-		else if (key == command_be::inject_js)
-		{
-			if (verify_full_access("Inject JS"))
+			break;
+			case command_be::inject_js:
 			{
-				const auto table = value.pairs('\1');
-				std::unique_lock lock(injection_mutex);
-				injection_entries_js.clear();
-				for (const auto& i : table)
+				if (verify_full_access("Inject JS"))
 				{
-					if (i.second.find("</script>") != std::string::npos) continue;
-					injection_entries_js.emplace_back(create_regex(i.first), i.second.str());
+					update_rules(rules_patterns | rules_payloads, [&](url_rules& r)
+					{
+						r.injection_table_js = value.str();
+						r.injection_entries_js = parse_injection_js(value);
+						r.injection_patterns_js = create_pattern_set(r.injection_entries_js);
+					});
+					send_injection_rules();
 				}
-				use_injection = !injection_entries_css.empty() || !injection_entries_js.empty() || !color_scheme_active.empty();
 			}
-		}
-		else
-		{
-			return false;
+			break;
+			default:
+			{
+				return false;
+			}
 		}
 		return true;
 	}
@@ -2054,38 +2314,39 @@ public:
 
 	void OnFindResult(CefRefPtr<CefBrowser> browser, int identifier, int count, const CefRect& selection_rect, int active_match_ordinal, bool final_update) override
 	{
+		if (binary_events)
+		{
+			set_response(command_fe::found_result, binary_builder(accsp_binary_schema::found_result, accsp_binary_found_result{
+				identifier, active_match_ordinal, count, selection_rect.x, selection_rect.y, selection_rect.width, selection_rect.height, final_update})
+				.finalize());
+			return;
+		}
+
 		set_response(command_fe::found_result, lson_builder{}
 			.add("identifier", identifier)
 			.add("index", active_match_ordinal)
 			.add("count", count)
-			.add("rect", lson_builder{}
+			.begin("rect")
 				.add("x", selection_rect.x)
 				.add("y", selection_rect.y)
 				.add("width", selection_rect.width)
-				.add("height", selection_rect.height))
+				.add("height", selection_rect.height)
+				.end()
 			.add("final", final_update)
 			.finalize());
 	}
 
-	static lson_builder issuer_data(const CefRefPtr<CefX509CertPrincipal>& i)
+	static void add_issuer_data(lson_builder& b, const lson_key& key, const CefRefPtr<CefX509CertPrincipal>& i)
 	{
-		lson_builder c;
-		c.add("commonName", i->GetCommonName());
-		{
-			lson_builder n;
-			std::vector<CefString> organizations;
-			i->GetOrganizationNames(organizations);
-			for (const auto& o : organizations) n.add(nullptr, o);
-			c.add("organizationNames", n);
-		}
-		{
-			lson_builder n;
-			std::vector<CefString> organizations;
-			i->GetOrganizationUnitNames(organizations);
-			for (const auto& o : organizations) n.add(nullptr, o);
-			c.add("organizationUnitNames", n);
-		}
-		return c;
+		b.begin(key);
+		b.add("commonName", i->GetCommonName());
+		std::vector<CefString> organizations;
+		i->GetOrganizationNames(organizations);
+		b.add("organizationNames", organizations);
+		organizations.clear();
+		i->GetOrganizationUnitNames(organizations);
+		b.add("organizationUnitNames", organizations);
+		b.end();
 	}
 
 	void apply_scroll(bool absolute, int32_t x, int32_t y)
@@ -2174,7 +2435,6 @@ public:
 		browser->Reload();
 	}
 
-	std::string color_scheme_active;
 	uint32_t own_zoom_phase{};
 	bool dark_auto_active{};
 	bool dark_forced_active{};
@@ -2196,6 +2456,11 @@ public:
 	{
 		if (key == command_be::large_command)
 		{
+			if (value.size() < 8)
+			{
+				std::cout << "Damaged large command" << std::endl;
+				return;
+			}
 			const auto file_key = *(uint32_t*)&value[0];
 			const auto data_size = *(uint32_t*)&value[4];
 			if (data_size > 0)
@@ -2220,674 +2485,705 @@ public:
 			return;
 		}
 
-		if (key == command_be::navigate)
+		switch (key)
 		{
-			if (suspended) return;
-			if (value == "back")
-			{
-				browser->GoBack();
-			}
-			else if (value == "forward")
+			case command_be::navigate:
 			{
-				browser->GoForward();
+				if (suspended) return;
+				if (value == "back")
+				{
+					browser->GoBack();
+				}
+				else if (value == "forward")
+				{
+					browser->GoForward();
+				}
+				else if (value.starts_with("back:") || value.starts_with("forward:"))
+				{
+					for (auto i = std::stoull(value.pair(':').second.str()); i > 0; --i)
+					{
+						value[0] == 'b' ? browser->GoBack() : browser->GoForward();
+					}
+				}
+				else if (!value.starts_with_ci("javascript:") || verify_full_access("Navigate to JavaScript URLs"))
+				{
+					browser->GetMainFrame()->LoadURL(value);
+				}
 			}
-			else if (value.starts_with("back:") || value.starts_with("forward:"))
+			break;
+			case command_be::zoom:
 			{
-				for (auto i = std::stoull(value.pair(':').second.str()); i > 0; --i)
+				if (!browser->HasDocument())
 				{
-					value[0] == 'b' ? browser->GoBack() : browser->GoForward();
+					postponed_zoom = value.as(0.f);
+					mmf->entry->zoom_level = postponed_zoom;
+				}
+				else
+				{
+					do_on_ui([browser = CefRefPtr(browser), that = CefRefPtr(this), zoom_value = value.as(0.f)]
+					{
+						browser->GetHost()->SetZoomLevel(zoom_value);
+						that->own_zoom_phase = ++_zoom_phase;
+						that->mmf->entry->zoom_level = zoom_value;
+					}, true);
 				}
 			}
-			else if (!value.starts_with_ci("javascript:") || verify_full_access("Navigate to JavaScript URLs"))
+			break;
+			case command_be::reload:
 			{
-				browser->GetMainFrame()->LoadURL(value);
+				if (suspended) return;
+				if (last_browse_nonget) browser->GetMainFrame()->ExecuteJavaScript("location.reload()", "", 0);
+				else if (value == "nocache") browser->ReloadIgnoreCache();
+				else browser->Reload();
 			}
-		}
-		else if (key == command_be::zoom)
-		{
-			if (!browser->HasDocument())
+			break;
+			case command_be::stop:
 			{
-				postponed_zoom = value.as(0.f);
-				mmf->entry->zoom_level = postponed_zoom;
+				if (suspended) return;
+				browser->StopLoad();
 			}
-			else
+			break;
+			case command_be::download:
 			{
-				do_on_ui([browser = CefRefPtr(browser), that = CefRefPtr(this), zoom_value = value.as(0.f)]
-				{
-					browser->GetHost()->SetZoomLevel(zoom_value);
-					that->own_zoom_phase = ++_zoom_phase;
-					that->mmf->entry->zoom_level = zoom_value;
-				}, true);
+				browser->GetHost()->StartDownload(value);
 			}
-		}
-		else if (key == command_be::reload)
-		{
-			if (suspended) return;
-			if (last_browse_nonget) browser->GetMainFrame()->ExecuteJavaScript("location.reload()", "", 0);
-			else if (value == "nocache") browser->ReloadIgnoreCache();
-			else browser->Reload();
-		}
-		else if (key == command_be::stop)
-		{
-			if (suspended) return;
-			browser->StopLoad();
-		}
-		else if (key == command_be::download)
-		{
-			browser->GetHost()->StartDownload(value);
-		}
-		else if (key == command_be::lifespan)
-		{
-			if (value == "close")
+			break;
+			case command_be::lifespan:
 			{
-				graduate_close_ = true;
-				browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr)->FlushStore(nullptr);
-				browser->GetHost()->CloseBrowser(false); 
+				if (value == "close")
+				{
+					graduate_close_ = true;
+					browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr)->FlushStore(nullptr);
+					browser->GetHost()->CloseBrowser(false); 
+				}
+				else if (value == "suspend" || value == "resume")
+				{
+					suspended = value == "suspend";
+					if (suspended)
+					{
+						browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, CefProcessMessage::Create(PMSG_KILL));
+					}
+					else
+					{
+						close_command_sent_ = false;
+						browser->Reload();
+					}
+				}
 			}
-			else if (value == "suspend" || value == "resume")
+			break;
+			case command_be::command:
+			{
+				if (value == "undo") browser->GetFocusedFrame()->Undo();
+				else if (value == "redo") browser->GetFocusedFrame()->Redo();
+				else if (value == "copy") browser->GetFocusedFrame()->Copy();
+				else if (value == "cut") browser->GetFocusedFrame()->Cut();
+				else if (value == "paste") browser->GetFocusedFrame()->Paste();
+				else if (value == "delete") browser->GetFocusedFrame()->Delete();
+				else if (value == "selectAll") browser->GetFocusedFrame()->SelectAll();
+				else if (value == "print" && verify_full_access("Print")) browser->GetHost()->Print();
+				else if (value == "exitFullscreen") browser->GetMainFrame()->ExecuteJavaScript("document.webkitExitFullscreen()", "", 0);
+			}
+			break;
+			case command_be::input:
 			{
-				suspended = value == "suspend";
-				if (suspended)
+				cef_string_wide_t wide{};
+				cef_string_utf8_to_wide(value.data(), value.size(), &wide);
+
+				for (auto i = 0U; i < wide.length; ++i)
 				{
-					browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, CefProcessMessage::Create(PMSG_KILL));
+					CefKeyEvent e;
+					e.type = KEYEVENT_CHAR;
+					e.native_key_code = 0;
+					e.windows_key_code = wide.str[i];
+					e.modifiers = 0;
+					e.character = 0;
+					e.unmodified_character = 0;
+					e.focus_on_editable_field = true;
+					browser->GetHost()->SendKeyEvent(e);
 				}
-				else
+				if (wide.dtor)
 				{
-					close_command_sent_ = false;
-					browser->Reload();
+					wide.dtor(wide.str);
 				}
 			}
-		}
-		else if (key == command_be::command)
-		{
-			if (value == "undo") browser->GetFocusedFrame()->Undo();
-			else if (value == "redo") browser->GetFocusedFrame()->Redo();
-			else if (value == "copy") browser->GetFocusedFrame()->Copy();
-			else if (value == "cut") browser->GetFocusedFrame()->Cut();
-			else if (value == "paste") browser->GetFocusedFrame()->Paste();
-			else if (value == "delete") browser->GetFocusedFrame()->Delete();
-			else if (value == "selectAll") browser->GetFocusedFrame()->SelectAll();
-			else if (value == "print" && verify_full_access("Print")) browser->GetHost()->Print();
-			else if (value == "exitFullscreen") browser->GetMainFrame()->ExecuteJavaScript("document.webkitExitFullscreen()", "", 0);
-		}
-		else if (key == command_be::input)
-		{
-			cef_string_wide_t wide{};
-			cef_string_utf8_to_wide(value.data(), value.size(), &wide);
-
-			for (auto i = 0U; i < wide.length; ++i)
+			break;
+			case command_be::key_down:
+			case command_be::key_up:
 			{
+				const auto repeated = value[0] == '\1';
 				CefKeyEvent e;
-				e.type = KEYEVENT_CHAR;
-				e.native_key_code = 0;
-				e.windows_key_code = wide.str[i];
-				e.modifiers = 0;
+				e.type = key == command_be::key_down ? KEYEVENT_KEYDOWN : KEYEVENT_KEYUP;
+				e.windows_key_code = repeated ? value.substr(1).as(0) : value.as(0);
+				e.native_key_code = MapVirtualKeyA(e.windows_key_code, MAPVK_VK_TO_VSC);
 				e.character = 0;
 				e.unmodified_character = 0;
-				e.focus_on_editable_field = true;
+				e.is_system_key = false;
+				e.focus_on_editable_field = false;
+				e.modifiers = get_event_flags() | (repeated ? EVENTFLAG_IS_REPEAT : 0);
+				if (e.windows_key_code == VK_CONTROL) button_ctrl = e.type == KEYEVENT_KEYDOWN;
+				if (e.windows_key_code == VK_SHIFT) button_shift = e.type == KEYEVENT_KEYDOWN;
+				if (e.windows_key_code == VK_MENU) button_alt = e.type == KEYEVENT_KEYDOWN;
 				browser->GetHost()->SendKeyEvent(e);
 			}
-			if (wide.dtor)
-			{
-				wide.dtor(wide.str);
-			}
-		}
-		else if (key == command_be::key_down || key == command_be::key_up)
-		{
-			const auto repeated = value[0] == '\1';
-			CefKeyEvent e;
-			e.type = key == command_be::key_down ? KEYEVENT_KEYDOWN : KEYEVENT_KEYUP;
-			e.windows_key_code = repeated ? value.substr(1).as(0) : value.as(0);
-			e.native_key_code = MapVirtualKeyA(e.windows_key_code, MAPVK_VK_TO_VSC);
-			e.character = 0;
-			e.unmodified_character = 0;
-			e.is_system_key = false;
-			e.focus_on_editable_field = false;
-			e.modifiers = get_event_flags() | (repeated ? EVENTFLAG_IS_REPEAT : 0);
-			if (e.windows_key_code == VK_CONTROL) button_ctrl = e.type == KEYEVENT_KEYDOWN;
-			if (e.windows_key_code == VK_SHIFT) button_shift = e.type == KEYEVENT_KEYDOWN;
-			if (e.windows_key_code == VK_MENU) button_alt = e.type == KEYEVENT_KEYDOWN;
-			browser->GetHost()->SendKeyEvent(e);
-		}
-		else if (key == command_be::find)
-		{
-			if (value.size() > 3)
-			{
-				browser->GetHost()->Find(value.substr(3), value[0] == '1', value[1] == '1', value[2] == '1');
-			}
-			else
+			break;
+			case command_be::find:
 			{
-				browser->GetHost()->Find(CefString("\0", 1), true, false, false);
+				if (value.size() > 3)
+				{
+					browser->GetHost()->Find(value.substr(3), value[0] == '1', value[1] == '1', value[2] == '1');
+				}
+				else
+				{
+					browser->GetHost()->Find(CefString("\0", 1), true, false, false);
+				}
 			}
-		}
-		else if (key == command_be::download_image)
-		{
-			struct favicon_callback : CefDownloadImageCallback
+			break;
+			case command_be::download_image:
 			{
-				WebView* parent;
-				std::string key;
+				struct favicon_callback : CefDownloadImageCallback
+				{
+					WebView* parent;
+					std::string key;
 
-				favicon_callback(WebView* parent, const utils::str_view& key) : parent(parent), key(key.str()) {}
+					favicon_callback(WebView* parent, const utils::str_view& key) : parent(parent), key(key.str()) {}
 
-				void OnDownloadImageFinished(const CefString& image_url, int http_status_code, CefRefPtr<CefImage> image) override
-				{
-					if (!image || image->IsEmpty())
+					void OnDownloadImageFinished(const CefString& image_url, int http_status_code, CefRefPtr<CefImage> image) override
 					{
-						parent->set_reply(std::move(key), std::string());
-						return;
-					}
+						if (!image || image->IsEmpty())
+						{
+							parent->set_reply(std::move(key), std::string());
+							return;
+						}
 
-					int w, h;
-					auto b = image->GetAsPNG(1.f, true, w, h);
-					std::string ret;
-					ret.resize(b->GetSize());
-					b->GetData(ret.data(), ret.size(), 0);
-					parent->set_reply(std::move(key), std::move(ret));
-				}
+						int w, h;
+						auto b = image->GetAsPNG(1.f, true, w, h);
+						std::string ret;
+						ret.resize(b->GetSize());
+						b->GetData(ret.data(), ret.size(), 0);
+						parent->set_reply(std::move(key), std::move(ret));
+					}
 
-			private:
-				IMPLEMENT_REFCOUNTING(favicon_callback);
-			};
-			auto p = value.split('\1', false, false); // reply, URL, favicon, max_size
-			browser->GetHost()->DownloadImage(p[1], p[2] == "1", p[3].as(0), false, new favicon_callback(this, p[0]));
-		}
-		else if (key == command_be::mute)
-		{
-			if (!redirect_audio_) browser->GetHost()->SetAudioMuted(value == "1");
-			if (value == "1") base_flags |= 16ULL;
-			else base_flags &= ~16ULL;
-		}
-		else if (key == command_be::scroll)
-		{
-			auto p = value.split('\1', false, false);
-			assert(p.size() == 3);
-			if (p.size() == 3)
+				private:
+					IMPLEMENT_REFCOUNTING(favicon_callback);
+				};
+				auto p = value.split('\1', false, false); // reply, URL, favicon, max_size
+				browser->GetHost()->DownloadImage(p[1], p[2] == "1", p[3].as(0), false, new favicon_callback(this, p[0]));
+			}
+			break;
+			case command_be::mute:
 			{
-				auto absolute = p[0] == "1";
-				auto x = p[1].as(0);
-				auto y = p[2].as(0);
-				if (!last_title.empty() && mmf->entry->loading_progress == 65535)
-				{
-					apply_scroll(absolute, x, y);
-				}
-				else
+				if (!redirect_audio_) browser->GetHost()->SetAudioMuted(value == "1");
+				if (value == "1") base_flags |= 16ULL;
+				else base_flags &= ~16ULL;
+			}
+			break;
+			case command_be::scroll:
+			{
+				auto p = value.split('\1', false, false);
+				assert(p.size() == 3);
+				if (p.size() == 3)
 				{
-					postponed_scroll.absolute = absolute;
-					postponed_scroll.x = x;
-					postponed_scroll.y = y;
+					auto absolute = p[0] == "1";
+					auto x = p[1].as(0);
+					auto y = p[2].as(0);
+					if (!last_title.empty() && mmf->entry->loading_progress == 65535)
+					{
+						apply_scroll(absolute, x, y);
+					}
+					else
+					{
+						postponed_scroll.absolute = absolute;
+						postponed_scroll.x = x;
+						postponed_scroll.y = y;
+					}
 				}
 			}
-		}
-		else if (key == command_be::capture_lost)
-		{
-			browser->GetHost()->SendCaptureLostEvent();
-		}
-		else if (key == command_be::execute)
-		{
-			if (verify_full_access("Execute JavaScript"))
+			break;
+			case command_be::capture_lost:
 			{
-				browser->GetMainFrame()->ExecuteJavaScript(value, "", 0);
+				browser->GetHost()->SendCaptureLostEvent();
 			}
-		}
-		else if (key == command_be::dev_tools_message)
-		{
-			const auto kv = value.pair('\1');
-			for (auto c : kv.first)
+			break;
+			case command_be::execute:
 			{
-				if (c == '"' || c == '\\' || c == '\n' || c == '\r')
+				if (verify_full_access("Execute JavaScript"))
 				{
-					std::cout << "Damaged command: " << kv.first.str() << std::endl;
-					return;
+					browser->GetMainFrame()->ExecuteJavaScript(value, "", 0);
 				}
 			}
-			if (kv.first.starts_with("Emulation.")
-				|| kv.first.starts_with("Overlay.")
-				|| kv.first == "Network.emulateNetworkConditions"
-				|| verify_full_access("Advanced DevTools message"))
+			break;
+			case command_be::dev_tools_message:
 			{
-				std::string packet("{\"id\":0,\"method\":\"");
-				packet += kv.first.str();
-				packet += "\",\"params\":";
-				packet += kv.second.str();
-				packet.push_back('}');
-				do_on_ui([browser = CefRefPtr(browser), str = std::move(packet)]
+				const auto kv = value.pair('\1');
+				for (auto c : kv.first)
 				{
-					browser->GetHost()->SendDevToolsMessage(str.data(), str.size());
-				}, false);
-			}
-		}
-		else if (key == command_be::color_scheme)
-		{
-			if (value == "dark-auto")
-			{
-				if (!dark_auto_active)
+					if (c == '"' || c == '\\' || c == '\n' || c == '\r')
+					{
+						std::cout << "Damaged command: " << kv.first.str() << std::endl;
+						return;
+					}
+				}
+				if (kv.first.starts_with("Emulation.")
+					|| kv.first.starts_with("Overlay.")
+					|| kv.first == "Network.emulateNetworkConditions"
+					|| verify_full_access("Advanced DevTools message"))
 				{
-					do_on_ui([browser = CefRefPtr(browser)]
+					std::string packet("{\"id\":0,\"method\":\"");
+					packet += kv.first.str();
+					packet += "\",\"params\":";
+					packet += kv.second.str();
+					packet.push_back('}');
+					do_on_ui([browser = CefRefPtr(browser), str = std::move(packet)]
 					{
-						const auto c1 = "{\"id\":0,\"method\":\"Emulation.setEmulatedMedia\",\"params\":{\"features\":[{\"name\":\"prefers-color-scheme\",\"value\":\"dark\"}]}}";
-						const auto c2 = "{\"id\":0,\"method\":\"Emulation.setAutoDarkModeOverride\",\"params\":{\"enabled\":true}}";
-						browser->GetHost()->SendDevToolsMessage(c1, strlen(c1));
-						browser->GetHost()->SendDevToolsMessage(c2, strlen(c2));
+						browser->GetHost()->SendDevToolsMessage(str.data(), str.size());
 					}, false);
 				}
-				dark_auto_active = true;
 			}
-			else
+			break;
+			case command_be::color_scheme:
 			{
-				std::string packet("{\"id\":0,\"method\":\"Emulation.setEmulatedMedia\",\"params\":{\"features\":[{\"name\":\"prefers-color-scheme\",\"value\":\"");
-				packet += value == "dark-forced" ? utils::str_view::from_cstr("dark") : value;
-				packet += "\"}]}}";
-				do_on_ui([browser = CefRefPtr(browser), str = std::move(packet), dark_auto_active = dark_auto_active]
+				if (value == "dark-auto")
 				{
-					browser->GetHost()->SendDevToolsMessage(str.data(), str.size());
-					if (dark_auto_active)
+					if (!dark_auto_active)
 					{
-						const auto c2 = "{\"id\":0,\"method\":\"Emulation.setAutoDarkModeOverride\",\"params\":{\"enabled\":false}}";
-						browser->GetHost()->SendDevToolsMessage(c2, strlen(c2));
+						do_on_ui([browser = CefRefPtr(browser)]
+						{
+							const auto c1 = "{\"id\":0,\"method\":\"Emulation.setEmulatedMedia\",\"params\":{\"features\":[{\"name\":\"prefers-color-scheme\",\"value\":\"dark\"}]}}";
+							const auto c2 = "{\"id\":0,\"method\":\"Emulation.setAutoDarkModeOverride\",\"params\":{\"enabled\":true}}";
+							browser->GetHost()->SendDevToolsMessage(c1, strlen(c1));
+							browser->GetHost()->SendDevToolsMessage(c2, strlen(c2));
+						}, false);
 					}
-				}, false);
-				dark_auto_active = false;
-			}
+					dark_auto_active = true;
+				}
+				else
+				{
+					std::string packet("{\"id\":0,\"method\":\"Emulation.setEmulatedMedia\",\"params\":{\"features\":[{\"name\":\"prefers-color-scheme\",\"value\":\"");
+					packet += value == "dark-forced" ? utils::str_view::from_cstr("dark") : value;
+					packet += "\"}]}}";
+					do_on_ui([browser = CefRefPtr(browser), str = std::move(packet), dark_auto_active = dark_auto_active]
+					{
+						browser->GetHost()->SendDevToolsMessage(str.data(), str.size());
+						if (dark_auto_active)
+						{
+							const auto c2 = "{\"id\":0,\"method\":\"Emulation.setAutoDarkModeOverride\",\"params\":{\"enabled\":false}}";
+							browser->GetHost()->SendDevToolsMessage(c2, strlen(c2));
+						}
+					}, false);
+					dark_auto_active = false;
+				}
 
-			std::string injection;
-			if (value == "dark-forced" || dark_forced_active)
-			{
-				injection = value != "dark-forced" ? "" : "<style __data_csp_color_scheme=1>input,label,select,textarea,button,fieldset,legend,datalist,output,option,optgroup{"
-					"color-scheme:dark;}</style><meta __data_csp_color_scheme=1 name=\"color-scheme\" content=\"dark\">";
-				auto injection_js = value != "dark-forced"
-					? "[].forEach.call(document.querySelectorAll('[__data_csp_color_scheme]'), x => x.parentNode.removeChild(x))"
-					: "[].forEach.call(document.querySelectorAll('[__data_csp_color_scheme]'), x => x.parentNode.removeChild(x));"
-						"document.head.insertAdjacentHTML('beforeend','" + injection + "')";
-				std::vector<int64_t> frames;
-				browser->GetFrameIdentifiers(frames);
-				for (auto f : frames)
+				std::string injection;
+				if (value == "dark-forced" || dark_forced_active)
 				{
-					if (auto frame = browser->GetFrame(f))
+					injection = value != "dark-forced" ? "" : "<style __data_csp_color_scheme=1>input,label,select,textarea,button,fieldset,legend,datalist,output,option,optgroup{"
+						"color-scheme:dark;}</style><meta __data_csp_color_scheme=1 name=\"color-scheme\" content=\"dark\">";
+					auto injection_js = value != "dark-forced"
+						? "[].forEach.call(document.querySelectorAll('[__data_csp_color_scheme]'), x => x.parentNode.removeChild(x))"
+						: "[].forEach.call(document.querySelectorAll('[__data_csp_color_scheme]'), x => x.parentNode.removeChild(x));"
+							"document.head.insertAdjacentHTML('beforeend','" + injection + "')";
+					std::vector<int64_t> frames;
+					browser->GetFrameIdentifiers(frames);
+					for (auto f : frames)
 					{
-						frame->ExecuteJavaScript(injection_js, "", 0);
+						if (auto frame = browser->GetFrame(f))
+						{
+							frame->ExecuteJavaScript(injection_js, "", 0);
+						}
 					}
+					dark_forced_active = value == "dark-forced";
 				}
-				dark_forced_active = value == "dark-forced";
-			}
 
+				update_rules(rules_payloads, [&](url_rules& r) { r.color_scheme_active = std::move(injection); });
+				send_injection_rules();
+			}
+			break;
+			case command_be::control_download:
 			{
-				std::unique_lock lock(injection_mutex);
-				color_scheme_active = std::move(injection);
-				use_injection = !injection_entries_css.empty() || !injection_entries_js.empty() || !color_scheme_active.empty();
+				cancel_download(value.pair('\1'));
 			}
-		}
-		else if (key == command_be::control_download)
-		{
-			cancel_download(value.pair('\1'));
-		}
-		else if (key == command_be::awake)
-		{
-			visible_counter = 250;
-			update_visible_state();
-		}
-		else if (key == command_be::fill_form)
-		{			
-			if (verify_full_access("Fill form"))
+			break;
+			case command_be::awake:
 			{
-				auto message = CefProcessMessage::Create(PMSG_FILL_FORM);
-				const auto args = message->GetArgumentList();
-				auto i = 0;
-				for (auto p : value.split('\1', false, false))
+				visible_counter = 250;
+				update_visible_state();
+			}
+			break;
+			case command_be::fill_form:
+			{			
+				if (verify_full_access("Fill form"))
 				{
-					args->SetString(i++, p.str());
+					auto message = CefProcessMessage::Create(PMSG_FILL_FORM);
+					const auto args = message->GetArgumentList();
+					auto i = 0;
+					for (const auto p : value.pieces('\1'))
+					{
+						args->SetString(i++, p.str());
+					}
+					browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, std::move(message));
 				}
-				browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, std::move(message));
 			}
-		}
-		else if (key == command_be::html)
-		{
-			if (verify_full_access("Get HTML"))
+			break;
+			case command_be::html:
 			{
-				browser->GetMainFrame()->GetSource(new string_visitor_with_callback([this, key = value.str()](std::string& data)
+				if (verify_full_access("Get HTML"))
 				{
-					set_reply(key, data);
-				}));
-			}
-			else
-			{
-				set_reply(value.str(), "");
-			}
-		}
-		else if (key == command_be::text)
-		{
-			if (verify_full_access("Get text"))
-			{
-				browser->GetMainFrame()->GetText(new string_visitor_with_callback([this, key = value.str()](std::string& data)
+					browser->GetMainFrame()->GetSource(new string_visitor_with_callback([this, key = value.str()](std::string& data)
+					{
+						set_reply(key, data);
+					}));
+				}
+				else
 				{
-					set_reply(key, data);
-				}));
+					set_reply(value.str(), "");
+				}
 			}
-			else
+			break;
+			case command_be::text:
 			{
-				set_reply(value.str(), "");
+				if (verify_full_access("Get text"))
+				{
+					browser->GetMainFrame()->GetText(new string_visitor_with_callback([this, key = value.str()](std::string& data)
+					{
+						set_reply(key, data);
+					}));
+				}
+				else
+				{
+					set_reply(value.str(), "");
+				}
 			}
-		}
-		else if (key == command_be::write_cookies)
-		{
-			if (verify_full_access("Edit cookies"))
+			break;
+			case command_be::write_cookies:
 			{
-				const auto args = value.split('\1', false, false);
-				const auto cookies = browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr);
-				if (args.size() <= 2)
+				if (verify_full_access("Edit cookies"))
 				{
-					if (args[0] == "@recent")
+					const auto args = value.split('\1', false, false);
+					const auto cookies = browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr);
+					if (args.size() <= 2)
 					{
-						if (args.size() != 2) return;
-						struct recent_cookie_visitor : CefCookieVisitor
+						if (args[0] == "@recent")
 						{
-							time_t time_threshold;
-
-							recent_cookie_visitor(WebView* parent, int max_age)
+							if (args.size() != 2) return;
+							struct recent_cookie_visitor : CefCookieVisitor
 							{
-								time_threshold = time(nullptr) - max_age;
-							}
+								time_t time_threshold;
 
-							bool Visit(const CefCookie& cookie, int count, int total, bool& delete_cookie) override
-							{
-								time_t time_la, time_c;
-								cef_time_to_timet(&cookie.last_access, &time_la);
-								cef_time_to_timet(&cookie.creation, &time_c);
-								delete_cookie = std::max(time_la, time_c) > time_threshold;
-								return true;
-							}
+								recent_cookie_visitor(WebView* parent, int max_age)
+								{
+									time_threshold = time(nullptr) - max_age;
+								}
 
-						private:
-							IMPLEMENT_REFCOUNTING(recent_cookie_visitor);
-						};
-						cookies->VisitAllCookies(new recent_cookie_visitor(this, args[1].as(0)));
+								bool Visit(const CefCookie& cookie, int count, int total, bool& delete_cookie) override
+								{
+									time_t time_la, time_c;
+									cef_time_to_timet(&cookie.last_access, &time_la);
+									cef_time_to_timet(&cookie.creation, &time_c);
+									delete_cookie = std::max(time_la, time_c) > time_threshold;
+									return true;
+								}
+
+							private:
+								IMPLEMENT_REFCOUNTING(recent_cookie_visitor);
+							};
+							cookies->VisitAllCookies(new recent_cookie_visitor(this, args[1].as(0)));
+						}
+						else
+						{
+							cookies->DeleteCookies(args[0], args.size() == 2 ? args[1] : utils::str_view{}, nullptr);
+						}
 					}
 					else
 					{
-						cookies->DeleteCookies(args[0], args.size() == 2 ? args[1] : utils::str_view{}, nullptr);
-					}
-				}
-				else
-				{
-					auto get_cef_time = [](const utils::str_view& v)
-					{
-						cef_time_t ret{};
-						cef_time_from_timet(v.as(0ULL), &ret);
-						return ret;
-					};
-					CefCookie cookie{};
-					cookie.name = args[1];
-					for (auto& p : args[2].pairs('\2'))
-					{
-						if (p.first == "value") cookie.value = p.second;
-						else if (p.first == "domain") cookie.domain = p.second;
-						else if (p.first == "path") cookie.path = p.second;
-						else if (p.first == "secure") cookie.secure = p.second == "1" ? 1 : 0;
-						else if (p.first == "HTTPOnly") cookie.httponly = p.second == "1" ? 1 : 0;
-						else if (p.first == "creationTime") cookie.creation = get_cef_time(p.second);
-						else if (p.first == "lastAccessTime") cookie.last_access = get_cef_time(p.second);
-						else if (p.first == "expirationTime")
+						auto get_cef_time = [](const utils::str_view& v)
+						{
+							cef_time_t ret{};
+							cef_time_from_timet(v.as(0ULL), &ret);
+							return ret;
+						};
+						CefCookie cookie{};
+						cookie.name = args[1];
+						for (auto& p : args[2].pairs('\2'))
 						{
-							cookie.expires = get_cef_time(p.second);
-							cookie.has_expires = 1;
+							if (p.first == "value") cookie.value = p.second;
+							else if (p.first == "domain") cookie.domain = p.second;
+							else if (p.first == "path") cookie.path = p.second;
+							else if (p.first == "secure") cookie.secure = p.second == "1" ? 1 : 0;
+							else if (p.first == "HTTPOnly") cookie.httponly = p.second == "1" ? 1 : 0;
+							else if (p.first == "creationTime") cookie.creation = get_cef_time(p.second);
+							else if (p.first == "lastAccessTime") cookie.last_access = get_cef_time(p.second);
+							else if (p.first == "expirationTime")
+							{
+								cookie.expires = get_cef_time(p.second);
+								cookie.has_expires = 1;
+							}
 						}
+						cookies->SetCookie(args[0], cookie, nullptr);
 					}
-					cookies->SetCookie(args[0], cookie, nullptr);
 				}
 			}
-		}
-		else if (key == command_be::read_cookies)
-		{
-			struct cookie_visitor : CefCookieVisitor
+			break;
+			case command_be::read_cookies:
 			{
-				WebView* parent;
-				std::string key;
-				lson_builder b;
-				uint8_t mode;
-
-				cookie_visitor(WebView* parent, const utils::str_view& key, const utils::str_view& mode_key) : parent(parent), key(key.str())
+				struct cookie_visitor : CefCookieVisitor
 				{
-					if (mode_key == "basic") mode = 1;
-					else if (mode_key == "count") mode = 2;
-					else mode = 0;
-				}
+					WebView* parent;
+					std::string key;
+					lson_builder b;
+					uint8_t mode;
 
-				~cookie_visitor() override
-				{
-					if (key.empty()) return;
-					if (mode == 2)
-					{
-						parent->set_reply(std::move(key), "0");
-					}
-					else
+					cookie_visitor(WebView* parent, const utils::str_view& key, const utils::str_view& mode_key) : parent(parent), key(key.str())
 					{
-						parent->set_reply(std::move(key), b.finalize());
+						if (mode_key == "basic") mode = 1;
+						else if (mode_key == "count") mode = 2;
+						else mode = 0;
 					}
-				}
 
-				bool Visit(const CefCookie& cookie, int count, int total, bool& delete_cookie) override
-				{
-					if (mode == 2)
+					~cookie_visitor() override
 					{
-						parent->set_reply(std::move(key), std::to_string(total));
-						key.clear();
-						return false;
+						if (key.empty()) return;
+						if (mode == 2)
+						{
+							parent->set_reply(std::move(key), "0");
+						}
+						else
+						{
+							parent->set_reply(std::move(key), b.finalize());
+						}
 					}
-					auto c = lson_builder{}
-						.add("name", cookie.name)
-						.add("value", cookie.value);
-					if (mode == 0)
+
+					bool Visit(const CefCookie& cookie, int count, int total, bool& delete_cookie) override
 					{
-						c.add_opt("domain", cookie.domain)
-							.add_opt("path", cookie.path)
-							.add("secure", cookie.secure != 0)
-							.add("HTTPOnly", cookie.httponly != 0)
-							.add("creationTime", cookie.creation)
-							.add("lastAccessTime", cookie.last_access);
-						if (cookie.has_expires != 0)
+						if (mode == 2)
 						{
-							c.add("expirationTime", cookie.expires);
+							parent->set_reply(std::move(key), std::to_string(total));
+							key.clear();
+							return false;
 						}
+						b.begin(nullptr)
+							.add("name", cookie.name)
+							.add("value", cookie.value);
+						if (mode == 0)
+						{
+							b.add_opt("domain", cookie.domain)
+								.add_opt("path", cookie.path)
+								.add("secure", cookie.secure != 0)
+								.add("HTTPOnly", cookie.httponly != 0)
+								.add("creationTime", cookie.creation)
+								.add("lastAccessTime", cookie.last_access);
+							if (cookie.has_expires != 0)
+							{
+								b.add("expirationTime", cookie.expires);
+							}
+						}
+						b.end();
+						return true;
 					}
-					b.add(nullptr, c);
-					return true;
-				}
 
-			private:
-				IMPLEMENT_REFCOUNTING(cookie_visitor);
-			};
-			const auto args = value.split('\1', false, false);
-			const auto cookies = browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr);
-			if (args[1] != "count" && !verify_full_access("Read cookies"))
-			{
-				set_reply(args[0].str(), "{}");
-				return;
-			}
-			if (args[2].empty())
-			{
-				cookies->VisitAllCookies(new cookie_visitor(this, args[0], args[1]));
-			}
-			else
-			{
-				cookies->VisitUrlCookies(args[2], false, new cookie_visitor(this, args[0], args[1]));
+				private:
+					IMPLEMENT_REFCOUNTING(cookie_visitor);
+				};
+				const auto args = value.split('\1', false, false);
+				const auto cookies = browser->GetHost()->GetRequestContext()->GetCookieManager(nullptr);
+				if (args[1] != "count" && !verify_full_access("Read cookies"))
+				{
+					set_reply(args[0].str(), "{}");
+					return;
+				}
+				if (args[2].empty())
+				{
+					cookies->VisitAllCookies(new cookie_visitor(this, args[0], args[1]));
+				}
+				else
+				{
+					cookies->VisitUrlCookies(args[2], false, new cookie_visitor(this, args[0], args[1]));
+				}
 			}
-		}
-		else if (key == command_be::history)
-		{
-			const auto args = value.pair('\1');
-			if (auto f = args.second == "forward"; f || args.second == "back")
+			break;
+			case command_be::history:
 			{
-				struct history_visitor_d : CefNavigationEntryVisitor
+				const auto args = value.pair('\1');
+				if (auto f = args.second == "forward"; f || args.second == "back")
 				{
-					struct entry_holder
+					struct history_visitor_d : CefNavigationEntryVisitor
 					{
-						std::string display_url;
-						std::string title;
-						int http_status_code;
-						cef_transition_type_t transition_type;
-						bool has_post_data;
-						bool current;
-
-						entry_holder(const CefRefPtr<CefNavigationEntry>& e, bool current) : current(current)
+						struct entry_holder
 						{
-							display_url = e->GetDisplayURL();
-							title = e->GetTitle();
-							http_status_code = e->GetHttpStatusCode();
-							transition_type = e->GetTransitionType();
-							has_post_data = e->HasPostData();
-						}
+							std::string display_url;
+							std::string title;
+							int http_status_code;
+							cef_transition_type_t transition_type;
+							bool has_post_data;
+							bool current;
+
+							entry_holder(const CefRefPtr<CefNavigationEntry>& e, bool current) : current(current)
+							{
+								display_url = e->GetDisplayURL();
+								title = e->GetTitle();
+								http_status_code = e->GetHttpStatusCode();
+								transition_type = e->GetTransitionType();
+								has_post_data = e->HasPostData();
+							}
 
-						explicit operator lson_builder() const
-						{
-							lson_builder b;
-							b.add("current", current);
-							b.add("displayURL", display_url);
-							b.add("title", title);
-							b.add("hasPostData", has_post_data);
-							b.add("HTTPCode", http_status_code);
-							b.add("transitionType", transition_type);
-							return b;
-						}
-					};
+							void write(lson_builder& b) const
+							{
+								b.begin(nullptr);
+								b.add("current", current);
+								b.add("displayURL", display_url);
+								b.add("title", title);
+								b.add("hasPostData", has_post_data);
+								b.add("HTTPCode", http_status_code);
+								b.add("transitionType", transition_type);
+								b.end();
+							}
+						};
 
-					WebView* parent;
-					std::string key;
-					std::vector<std::unique_ptr<entry_holder>> entries;
-					bool forward;
-					bool found_current{};
+						WebView* parent;
+						std::string key;
+						std::vector<std::unique_ptr<entry_holder>> entries;
+						bool forward;
+						bool found_current{};
 
-					history_visitor_d(WebView* parent, std::string key, bool forward)
-						: parent(parent), key(std::move(key)), forward(forward) {}
+						history_visitor_d(WebView* parent, std::string key, bool forward)
+							: parent(parent), key(std::move(key)), forward(forward) {}
 
-					~history_visitor_d() override
-					{
-						lson_builder ret;
-						if (forward)
+						~history_visitor_d() override
 						{
-							for (const auto& e : entries)
+							lson_builder ret;
+							if (forward)
 							{
-								ret.add(nullptr, lson_builder(*e));
+								for (const auto& e : entries)
+								{
+									e->write(ret);
+								}
 							}
-						}
-						else
-						{
-							for (auto i = entries.size(), j = 0ULL; i > 0 && j < 10; --i, ++j)
+							else
 							{
-								ret.add(nullptr, lson_builder(*entries[i - 1]));
+								for (auto i = entries.size(), j = 0ULL; i > 0 && j < 10; --i, ++j)
+								{
+									entries[i - 1]->write(ret);
+								}
 							}
+							parent->set_reply(std::move(key), ret.finalize());
 						}
-						parent->set_reply(std::move(key), ret.finalize());
-					}
 
-					bool Visit(CefRefPtr<CefNavigationEntry> entry, bool current, int index, int total) override
-					{
-						if (forward)
+						bool Visit(CefRefPtr<CefNavigationEntry> entry, bool current, int index, int total) override
 						{
-							if (found_current)
+							if (forward)
 							{
-								entries.push_back(std::make_unique<entry_holder>(entry, current));
-								return entries.size() < 10 && index + 1 < total;
+								if (found_current)
+								{
+									entries.push_back(std::make_unique<entry_holder>(entry, current));
+									return entries.size() < 10 && index + 1 < total;
+								}
+								if (current)
+								{
+									found_current = true;
+								}
 							}
-							if (current)
+							else
 							{
-								found_current = true;
+								if (current)
+								{
+									return false;
+								}
+								entries.push_back(std::make_unique<entry_holder>(entry, current));							
 							}
+							return index + 1 < total;
 						}
-						else
+
+					private:
+						IMPLEMENT_REFCOUNTING(history_visitor_d);
+					};
+					browser->GetHost()->GetNavigationEntries(new history_visitor_d(this, args.first.str(), f), false);
+				}
+				else
+				{
+					struct history_visitor_b : CefNavigationEntryVisitor
+					{
+						WebView* parent;
+						std::string key;
+						lson_builder ret;
+
+						history_visitor_b(WebView* parent, std::string key) : parent(parent), key(std::move(key)) {}
+						~history_visitor_b() override { parent->set_reply(std::move(key), ret.finalize()); }
+
+						bool Visit(CefRefPtr<CefNavigationEntry> entry, bool current, int index, int total) override
 						{
-							if (current)
-							{
-								return false;
-							}
-							entries.push_back(std::make_unique<entry_holder>(entry, current));							
+							ret.begin(nullptr);
+							ret.add("current", current);
+							ret.add("displayURL", entry->GetDisplayURL());
+							ret.add("title", entry->GetTitle());
+							ret.add("hasPostData", entry->HasPostData());
+							ret.add("HTTPCode", entry->GetHttpStatusCode());
+							ret.add("transitionType", entry->GetTransitionType());
+							ret.end();
+							return index + 1 < total;
 						}
-						return index + 1 < total;
-					}
 
-				private:
-					IMPLEMENT_REFCOUNTING(history_visitor_d);
-				};
-				browser->GetHost()->GetNavigationEntries(new history_visitor_d(this, args.first.str(), f), false);
+					private:
+						IMPLEMENT_REFCOUNTING(history_visitor_b);
+					};
+					browser->GetHost()->GetNavigationEntries(new history_visitor_b(this, args.first.str()), false);
+				}
 			}
-			else
+			break;
+			case command_be::ssl:
 			{
-				struct history_visitor_b : CefNavigationEntryVisitor
+				do_on_ui([that = CefRefPtr(this), browser = CefRefPtr(browser), key = value.str()]() mutable
 				{
-					WebView* parent;
-					std::string key;
-					lson_builder ret;
-
-					history_visitor_b(WebView* parent, std::string key) : parent(parent), key(std::move(key)) {}
-					~history_visitor_b() override { parent->set_reply(std::move(key), ret.finalize()); }
-
-					bool Visit(CefRefPtr<CefNavigationEntry> entry, bool current, int index, int total) override
+					const auto entry = browser->GetHost()->GetVisibleNavigationEntry();
+					lson_builder b;
+					if (auto ssl = entry->GetSSLStatus())
 					{
-						lson_builder b;
-						b.add("current", current);
-						b.add("displayURL", entry->GetDisplayURL());
-						b.add("title", entry->GetTitle());
-						b.add("hasPostData", entry->HasPostData());
-						b.add("HTTPCode", entry->GetHttpStatusCode());
-						b.add("transitionType", entry->GetTransitionType());
-						ret.add(nullptr, b);
-						return index + 1 < total;
+						b.add("secure", ssl->IsSecureConnection());
+						b.add("faultsMask", (ssl->GetCertStatus()));
+						b.add("SSLVersion", ssl->GetSSLVersion());
+						if (auto cert = ssl->GetX509Certificate())
+						{
+							b.begin("certificate")
+								.begin("validPeriod")
+									.add("creation", cert->GetValidStart().GetTimeT())
+									.add("expiration", cert->GetValidExpiry().GetTimeT())
+									.end();
+							add_issuer_data(b, "issuer", cert->GetIssuer());
+							add_issuer_data(b, "subject", cert->GetSubject());
+							b.add("chainSize", cert->GetIssuerChainSize()).end();
+						}
 					}
-
-				private:
-					IMPLEMENT_REFCOUNTING(history_visitor_b);
-				};
-				browser->GetHost()->GetNavigationEntries(new history_visitor_b(this, args.first.str()), false);
+					that->set_reply(std::move(key), b.finalize());
+				}, true);
 			}
-		}
-		else if (key == command_be::ssl)
-		{
-			do_on_ui([that = CefRefPtr(this), browser = CefRefPtr(browser), key = value.str()]() mutable
+			break;
+			case command_be::send:
+			{
+				auto message = CefProcessMessage::Create(PMSG_RECEIVE_IN);
+				const auto kv = value.split('\1', false, false, 3);
+				const auto args = message->GetArgumentList();
+				args->SetString(0, kv[0]);
+				args->SetString(1, kv[1]);
+				args->SetString(2, kv[2]);
+				browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, std::move(message));
+			}
+			break;
+			case command_be::reply:
 			{
-				const auto entry = browser->GetHost()->GetVisibleNavigationEntry();
-				lson_builder b;
-				if (auto ssl = entry->GetSSLStatus())
+				const auto kv = value.pair('\1');
+				const auto i = std::stoull(kv.first.str());
+				const auto f = awaiting_reply.find(i);
+				if (f != awaiting_reply.end())
 				{
-					b.add("secure", ssl->IsSecureConnection());
-					b.add("faultsMask", (ssl->GetCertStatus()));
-					b.add("SSLVersion", ssl->GetSSLVersion());
-					if (auto cert = ssl->GetX509Certificate())
-					{
-						b.add("certificate", lson_builder{}
-							.add("validPeriod", lson_builder{}
-								.add("creation", cert->GetValidStart().GetTimeT())
-								.add("expiration", cert->GetValidExpiry().GetTimeT()))
-							.add("issuer", issuer_data(cert->GetIssuer()))
-							.add("subject", issuer_data(cert->GetSubject()))
-							.add("chainSize", cert->GetIssuerChainSize()));
-					}
+					auto fn = std::move(f->second);
+					awaiting_reply.erase(f);
+					fn(kv.second);
 				}
-				that->set_reply(std::move(key), b.finalize());
-			}, true);
-		}
-		else if (key == command_be::send)
-		{
-			auto message = CefProcessMessage::Create(PMSG_RECEIVE_IN);
-			const auto kv = value.split('\1', false, false, 3);
-			const auto args = message->GetArgumentList();
-			args->SetString(0, kv[0]);
-			args->SetString(1, kv[1]);
-			args->SetString(2, kv[2]);
-			browser->GetMainFrame()->SendProcessMessage(PID_RENDERER, std::move(message));
-		}
-		else if (key == command_be::reply)
-		{
-			const auto kv = value.pair('\1');
-			const auto i = std::stoull(kv.first.str());
-			const auto f = awaiting_reply.find(i);
-			if (f != awaiting_reply.end())
+			}
+			break;
+			default:
 			{
-				auto fn = std::move(f->second);
-				awaiting_reply.erase(f);
-				fn(kv.second);
+				configure_control(key, value);
 			}
-		}
-		else
-		{
-			configure_control(key, value);
+			break;
 		}
 	}
 
@@ -2903,146 +3199,222 @@ public:
 	std::string last_url;
 
 	std::mutex response_mutex;
-	std::vector<std::pair<command_fe, std::vector<std::string>>> response_data;
-	std::vector<std::unique_ptr<accsp_mapped>> response_large_files;
+	std::array<accsp_response_log, size_t(response_lane::count)> response_lanes;
+	uint32_t telemetry_sampled{};
+	uint64_t responses_dropped{};
+	uint64_t responses_dropped_reported{};
+
+	// Mappings for large responses have to live until frontend has read them: until it clears response_set of the frame
+	// they were published with, or until ring consumer gets past the record pointing to them
+	struct large_response
+	{
+		bool ring;
+		uint64_t release_at; // ring position or frame number
+		accsp_mapped_pool::block block;
+	};
 
-	void set_response(const command_fe key, std::vector<std::string> value)
+	std::vector<large_response> response_large_files;
+	uint64_t response_frames_published{};
+	accsp_mapped_pool response_pool;
+	std::atomic_bool response_times_active;
+
+	// Frame currently being filled with the old single-slot exchange, and bytes each lane has already used for this frame
+	accsp_frame_writer response_frame{};
+	bool response_frame_published = true;
+	std::array<size_t, size_t(response_lane::count)> response_spent{};
+
+	// Records which skipped the log and when they were written (zero if already visible to ring consumer), folded into
+	// latency stats by sync thread
+	std::vector<std::pair<char, int64_t>> response_direct_times;
+
+	// Expects response_mutex to be locked. With nothing queued in front of it, record goes straight into the shared frame
+	// or ring, otherwise (or if frontend still owns the frame) returns nullptr and record has to be queued
+	char* reserve_direct(const response_lane lane, const command_fe key, size_t payload_size)
 	{
-		std::unique_lock lock(response_mutex);
-		if (is_command_overriding(key))
+		if (payload_size > ACCSP_MAX_COMMAND_SIZE || response_spent[size_t(lane)] + 3ULL + payload_size > response_lane_budget[size_t(lane)]
+			|| responses_pending()) return nullptr;
+
+		char* ret;
+		if (channel)
 		{
-			for (auto& i : response_data)
+			ret = channel_response.reserve(char(key), payload_size);
+		}
+		else
+		{
+			const auto entry = mmf->entry;
+			if (entry->response_set != 0) return nullptr;
+			if (response_frame_published)
 			{
-				if (i.first == key)
-				{
-					i.second = std::move(value);
-					return;
-				}
+				response_frame = {entry->response, ACCSP_FRAME_SIZE};
+				response_frame_published = false;
 			}
+			ret = response_frame.reserve(char(key), payload_size);
 		}
-		response_data.emplace_back(key, std::move(value));
+		if (ret) response_spent[size_t(lane)] += 3ULL + payload_size;
+		return ret;
 	}
 
-	void set_response(const command_fe key, std::string value)
+	// Expects response_mutex to be locked, makes directly written records visible to ring consumer
+	void commit_response()
 	{
-		std::unique_lock lock(response_mutex);
-		if (is_command_overriding(key))
+		if (channel) channel_response.publish();
+	}
+
+	// Expects response_mutex to be locked, returns nullptr if record was dropped as excessive telemetry
+	char* append_response(const command_fe key, size_t payload_size)
+	{
+		const auto lane = lane_of(key);
+		// Overriding keys always go through the log: value written directly could not be replaced by a newer one anymore
+		if (!is_command_overriding(key))
 		{
-			for (auto& i : response_data)
+			if (const auto d = reserve_direct(lane, key, payload_size))
 			{
-				if (i.first == key)
-				{
-					i.second.resize(1);
-					i.second[0] = std::move(value);
-					return;
-				}
+				if (response_times_active) response_direct_times.emplace_back(char(key), channel ? 0LL : perf_counter_now());
+				return d;
 			}
 		}
-		response_data.emplace_back(key, std::vector{ std::move(value) });
+
+		auto& log = response_lanes[size_t(lane)];
+		if (key == command_fe::url_monitor && log.count() >= telemetry_sample_from
+			&& (log.count() >= telemetry_drop_from || ++telemetry_sampled % 8 != 0))
+		{
+			++responses_dropped;
+			return nullptr;
+		}
+		return log.append(char(key), payload_size, is_command_overriding(key), response_times_active ? perf_counter_now() : 0LL);
 	}
 
-	static std::mt19937& prng_engine()
+	void set_response(const command_fe key, std::vector<std::string> value)
 	{
-		thread_local static std::random_device rd{};
-		thread_local static std::mt19937 engine{ rd() };
-		return engine;
+		if (value.empty()) return;
+		auto total_size = value.size() - 1;
+		for (const auto& v : value)
+		{
+			total_size += v.size();
+		}
+
+		std::unique_lock lock(response_mutex);
+		auto d = append_response(key, total_size);
+		if (!d) return;
+		for (const auto& v : value)
+		{
+			if (&v != &value[0]) *d++ = '\1';
+			memcpy(d, v.data(), v.size());
+			d += v.size();
+		}
+		commit_response();
 	}
 
-	static int random_until(const int to_exclusive)
+	void set_response(const command_fe key, std::string value)
 	{
-		return std::uniform_int_distribution<>(0, to_exclusive - 1)(prng_engine());
+		std::unique_lock lock(response_mutex);
+		if (const auto d = append_response(key, value.size()))
+		{
+			memcpy(d, value.data(), value.size());
+			commit_response();
+		}
 	}
 
-	uint32_t submit_commands()
+	bool responses_pending() const
 	{
-		auto entry = mmf->entry;
-		auto c = 0U, p = 0U;
-		auto add_entry_v = [&](command_fe k, const std::vector<std::string>& a, uint64_t total_size)
-		{
-			if (p + total_size + 4U > ACCSP_FRAME_SIZE) return false;
-			*(command_fe*)&entry->response[p] = k;
-			*(uint16_t*)&entry->response[p + 1] = uint16_t(total_size);
-			p += 3U;
-			auto second = false;
-			for (const auto& i : a)
-			{
-				if (second) entry->response[p++] = '\1';
-				else second = true;
-				memcpy(&entry->response[p], i.data(), i.size() + 1);
-				p += uint32_t(i.size());
-			}
-			++c;
-			return true;
-		};
+		return std::ranges::any_of(response_lanes, [](const accsp_response_log& l) { return !l.empty(); });
+	}
 
-		auto add_entry_1 = [&](command_fe k, const std::string& v)
+	// Expects response_mutex to be locked
+	void release_large_responses()
+	{
+		const auto frames_read = response_frames_published - (mmf->entry->response_set != 0 && response_frames_published > 0 ? 1 : 0);
+		const auto consumed = channel ? channel_response.consumed() : 0ULL;
+		std::erase_if(response_large_files, [&](large_response& i)
 		{
-			if (p + v.size() + 4U > ACCSP_FRAME_SIZE) return false;
-			*(command_fe*)&entry->response[p] = k;
-			*(uint16_t*)&entry->response[p + 1] = uint16_t(v.size());
-			memcpy(&entry->response[p + 3U], v.data(), v.size() + 1);
-			p += uint32_t(v.size()) + 3U;
-			++c;
+			if (i.release_at > (i.ring ? consumed : frames_read)) return false;
+			response_pool.release(std::move(i.block));
 			return true;
-		};
+		});
+	}
 
-		std::unique_lock lock(response_mutex);
-		std::pair<command_fe, std::vector<std::string>>* cut_from{};
-		response_large_files.clear();
-		for (auto& i : response_data)
+	// Expects response_mutex to be locked
+	void record_direct_latency()
+	{
+		if (response_direct_times.empty()) return;
+		if (latency)
 		{
-			if (i.second.empty()) continue;
-
-			auto total_size = i.second.size() - 1;
-			for (auto& v : i.second)
+			const auto now = perf_counter_now();
+			for (const auto& [key, time] : response_direct_times)
 			{
-				total_size += v.size();
+				const auto us = time ? double(now - time) * 1e6 / double(perf_counter_frequency()) : 0.;
+				latency->response_queue.add(us);
+				latency->response_by_key[uint8_t(key) & 127].add(us);
 			}
+		}
+		response_direct_times.clear();
+	}
 
-			if (total_size > ACCSP_MAX_COMMAND_SIZE)
+	// Expects response_mutex to be locked
+	template<typename Target>
+	void submit_commands(Target& target)
+	{
+		const auto now = latency ? perf_counter_now() : 0LL;
+		auto full = false;
+		for (auto lane = 0ULL; lane < response_lanes.size() && !full; ++lane)
+		{
+			auto& spent = response_spent[lane];
+			const auto submitted = response_lanes[lane].iterate([&](const accsp_response_log::header& h, const utils::str_view& payload)
 			{
-				if (p + 20 > ACCSP_FRAME_SIZE)
+				if (spent >= response_lane_budget[lane]) return false;
+				if (payload.size() > ACCSP_MAX_COMMAND_SIZE)
+				{
+					const auto o = target.reserve(char(command_fe::large_command), 8);
+					if (!o)
+					{
+						full = true;
+						return false;
+					}
+
+					auto block = response_pool.acquire(named_prefix, payload.size() + 2ULL);
+					const auto item = (char*)block.mapping->entry;
+					item[0] = h.key;
+					memcpy(item + 1, payload.data(), payload.size());
+					item[payload.size() + 1] = '\0';
+					*(int*)o = block.key;
+					*(uint32_t*)(o + 4) = uint32_t(2ULL + payload.size());
+					if constexpr (std::is_same_v<Target, accsp_ring_producer>)
+					{
+						response_large_files.push_back({true, target.position(), std::move(block)});
+					}
+					else
+					{
+						response_large_files.push_back({false, response_frames_published + 1, std::move(block)});
+					}
+					spent += 11ULL;
+				}
+				else if (const auto d = target.reserve(h.key, payload.size()))
+				{
+					memcpy(d, payload.data(), payload.size());
+					spent += 3ULL + payload.size();
+				}
+				else
 				{
-					cut_from = &i;
-					break;
+					full = true;
+					return false;
 				}
 
-				const auto key = random_until(INT32_MAX);
-				auto name = named_prefix + L'_' + std::to_wstring(key);
-				auto item = std::make_unique<accsp_mapped>(name, total_size + 2ULL, false);
-				*(command_fe*)item->entry = i.first;
-				auto d = (char*)item->entry + 1;
-				for (const auto& v : i.second)
+				if (latency && h.time)
 				{
-					if (d > (char*)item->entry + 1) *d++ = '\1';
-					memcpy(d, v.data(), v.size() + 1);
-					d += v.size();
+					const auto us = double(now - h.time) * 1e6 / double(perf_counter_frequency());
+					latency->response_queue.add(us);
+					latency->response_by_key[uint8_t(h.key) & 127].add(us);
 				}
-				assert(uint64_t(d - ((char*)item->entry + 1)) == total_size);
-				std::string o;
-				o.resize(8);
-				*(int*)o.data() = key;
-				*(uint32_t*)(o.data() + 4) = uint32_t(2ULL + total_size);
-				add_entry_1(command_fe::large_command, o);
-				response_large_files.emplace_back(std::move(item));
-			}
-			else if (!add_entry_v(i.first, i.second, total_size))
-			{
-				cut_from = &i;
-				break;
-			}
-		}
-		if (cut_from)
-		{
-			const auto new_size = &*response_data.end() - cut_from;
-			memmove(response_data.data(), cut_from, new_size * sizeof(std::pair<command_fe, std::string>));
-			response_data.resize(new_size);
+				return true;
+			});
+			response_lanes[lane].consume(submitted);
 		}
-		else
+
+		if (responses_dropped != responses_dropped_reported)
 		{
-			response_data.clear();
+			log_message("Dropped telemetry responses: %llu (total: %llu)", responses_dropped - responses_dropped_reported, responses_dropped);
+			responses_dropped_reported = responses_dropped;
 		}
-		return c;
 	}
 
 	void set_reply(std::string reply_id, std::string value)
@@ -3063,6 +3435,223 @@ public:
 	bool last_hidden{};
 	uint8_t visible_counter = 250;
 
+	// Commands setting a state where only the last value of a frame matters
+	static accsp_coalescing coalescing_of(command_be key)
+	{
+		switch (key)
+		{
+			case command_be::zoom:
+			case command_be::mute:
+			case command_be::color_scheme:
+			case command_be::awake:
+			case command_be::filter_resource_urls:
+			case command_be::set_headers:
+			case command_be::inject_js:
+			case command_be::inject_css: return accsp_coalescing::latest;
+			case command_be::set_option: return accsp_coalescing::latest_per_option;
+			case command_be::scroll: return accsp_coalescing::latest_absolute_scroll;
+			default: return accsp_coalescing::none;
+		}
+	}
+
+	struct batched_command
+	{
+		command_be key;
+		utils::str_view value;
+		bool dropped;
+		int64_t stamp;
+	};
+
+	std::vector<batched_command> commands_batch;
+	int64_t commands_batch_stamp{};
+	int64_t commands_record_stamp{};
+
+	// Frontend stamp of the whole frame, applied to commands from both exchanges unless they come after a stamp record
+	void begin_commands_frame()
+	{
+		commands_batch_stamp = 0;
+		if (latency && stats_block->entry->fe_commands_seq != latency->last_commands_seq)
+		{
+			latency->last_commands_seq = stats_block->entry->fe_commands_seq;
+			commands_batch_stamp = int64_t(stats_block->entry->fe_commands_time);
+		}
+	}
+
+	void batch_command(command_be key, const utils::str_view& value)
+	{
+		if (key == command_be(ACCSP_STAMP_KEY))
+		{
+			accsp_command_stamp stamp{};
+			memcpy(&stamp, value.data(), std::min(value.size(), sizeof stamp));
+			commands_record_stamp = stamp.time;
+			if (latency) stats_block->entry->be_commands_seq = stamp.seq;
+			return;
+		}
+		commands_batch.push_back({key, value, false, commands_record_stamp ? commands_record_stamp : commands_batch_stamp});
+	}
+	std::vector<utils::str_view> commands_batch_options;
+	uint64_t commands_coalesced{};
+
+	// Drops commands overwritten later in the same frame (see accsp_coalesce_commands()) and runs the rest in their original order
+	void dispatch_commands()
+	{
+		const auto dropped = accsp_coalesce_commands(commands_batch, commands_batch_options, coalescing_of);
+
+		for (const auto& c : commands_batch)
+		{
+			if (c.dropped) continue;
+			if (!latency)
+			{
+				control(c.key, c.value);
+				continue;
+			}
+
+			const auto t0 = perf_counter_now();
+			control(c.key, c.value);
+			const auto t1 = perf_counter_now();
+			const auto us_per_tick = 1e6 / double(perf_counter_frequency());
+			const auto handling = double(t1 - t0) * us_per_tick;
+			latency->commands_handling.add(handling);
+			latency->commands_handling_by_key[uint8_t(c.key) & 127].add(handling);
+			if (c.stamp)
+			{
+				const auto dispatch = double(t0 - c.stamp) * us_per_tick;
+				latency->commands_dispatch.add(dispatch);
+				latency->commands_dispatch_by_key[uint8_t(c.key) & 127].add(dispatch);
+			}
+		}
+		commands_batch.clear();
+		commands_record_stamp = 0;
+
+		if (dropped > 0)
+		{
+			commands_coalesced += dropped;
+			log_message("Coalesced commands: %u (total: %llu)", dropped, commands_coalesced);
+		}
+	}
+
+	struct latency_tracking
+	{
+		latency_histogram commands_dispatch;
+		latency_histogram commands_handling;
+		latency_histogram response_queue;
+		latency_histogram response_delivery;
+		std::array<latency_histogram, 128> commands_dispatch_by_key;
+		std::array<latency_histogram, 128> commands_handling_by_key;
+		std::array<latency_histogram, 128> response_by_key;
+		uint32_t last_commands_seq{};
+		uint32_t last_delivered_seq{};
+	};
+
+	// Stats block is there for every named tab, so that counters are visible without latency tracking
+	std::unique_ptr<accsp_mapped_typed<accsp_wb_stats>> stats_block;
+	bool stats_block_failed{};
+	uint32_t stats_frames{};
+	std::unique_ptr<latency_tracking> latency;
+	bool latency_stats_requested{};
+
+	void update_latency_stats()
+	{
+		if (!stats_block && !stats_block_failed && !named_prefix.empty())
+		{
+			try
+			{
+				stats_block = std::make_unique<accsp_mapped_typed<accsp_wb_stats>>(named_prefix + L"#", false);
+				stats_block->entry->be_frequency = perf_counter_frequency();
+			}
+			catch (std::exception& e)
+			{
+				std::cout << "Failed to create stats block: " << e.what() << std::endl;
+				stats_block_failed = true;
+			}
+		}
+		if (!stats_block) return;
+
+		if (latency_stats_requested != bool(latency))
+		{
+			if (latency_stats_requested) latency = std::make_unique<latency_tracking>();
+			else latency.reset();
+			response_times_active = bool(latency);
+		}
+
+		const auto stats = stats_block->entry;
+		if (latency && stats->fe_response_seq == stats->be_response_seq && stats->fe_response_seq != latency->last_delivered_seq)
+		{
+			latency->last_delivered_seq = stats->fe_response_seq;
+			latency->response_delivery.add(double(int64_t(stats->fe_response_time - stats->be_response_time)) * 1e6 / double(perf_counter_frequency()));
+		}
+
+		if (++stats_frames % 120 != 0) return;
+		if (latency)
+		{
+			auto publish = [](accsp_wb_stats::latency& dst, latency_histogram& src)
+			{
+				dst.p50 = src.percentile(0.5f);
+				dst.p95 = src.percentile(0.95f);
+				dst.p99 = src.percentile(0.99f);
+				dst.count = src.count;
+				src.reset();
+			};
+			publish(stats->commands_dispatch, latency->commands_dispatch);
+			publish(stats->commands_handling, latency->commands_handling);
+			publish(stats->response_queue, latency->response_queue);
+			publish(stats->response_delivery, latency->response_delivery);
+			for (auto i = 0U; i < 128U; ++i)
+			{
+				publish(stats->commands_dispatch_by_key[i], latency->commands_dispatch_by_key[i]);
+				publish(stats->commands_handling_by_key[i], latency->commands_handling_by_key[i]);
+				publish(stats->response_by_key[i], latency->response_by_key[i]);
+			}
+		}
+		stats->commands_coalesced = commands_coalesced;
+		stats->pool_hits = response_pool.hits;
+		stats->pool_misses = response_pool.misses;
+		stats->responses_dropped = responses_dropped;
+		stats->verdict_cache_hits = verdict_cache.hits.load(std::memory_order_relaxed);
+		stats->verdict_cache_misses = verdict_cache.misses.load(std::memory_order_relaxed);
+		const auto patterns = utils::pattern::stats();
+		stats->pattern_cache_hits = patterns.hits;
+		stats->pattern_cache_misses = patterns.misses;
+		stats->pattern_cache_entries = patterns.entries;
+		stats->pattern_compile_time_us = patterns.compile_time_us;
+		__faststorefence();
+		++stats->be_stats_seq;
+	}
+
+	void mark_response_published()
+	{
+		if (!latency) return;
+		const auto stats = stats_block->entry;
+		stats->be_response_time = uint64_t(perf_counter_now());
+		__faststorefence();
+		++stats->be_response_seq;
+	}
+
+	std::unique_ptr<accsp_mapped_typed<accsp_wb_channel>> channel;
+	accsp_ring_consumer channel_commands;
+	accsp_ring_producer channel_response;
+	bool channel_failed{};
+
+	void open_channel()
+	{
+		try
+		{
+			channel = std::make_unique<accsp_mapped_typed<accsp_wb_channel>>(named_prefix + L"~", false);
+			channel_commands.ring = &channel->entry->commands;
+			channel_response.ring = &channel->entry->response;
+			channel_response.pending = channel_response.ring->head;
+			__faststorefence();
+			mmf->entry->be_channel_version = std::min(uint32_t(mmf->entry->fe_channel_version), uint32_t(ACCSP_CHANNEL_VERSION));
+			log_message("Ring channel is ready: v%d", mmf->entry->be_channel_version);
+		}
+		catch (std::exception& e)
+		{
+			std::cout << "Failed to create ring channel: " << e.what() << std::endl;
+			channel.reset();
+			channel_failed = true;
+		}
+	}
+
 	void update_visible_state()
 	{					
 		if (const auto browser = safe_browser())
@@ -3105,15 +3694,36 @@ public:
 			entry->popup_dimensions = popup_active ? popup_area : std::array<float, 4>{};
 		}
 
+		if (!channel && entry->fe_channel_version > 0 && !named_prefix.empty() && !channel_failed)
+		{
+			// Records already written into unpublished frame have to go out that way first
+			std::unique_lock lock(response_mutex);
+			if (response_frame_published || response_frame.count == 0) open_channel();
+		}
+
+		update_latency_stats();
+		begin_commands_frame();
+
 		if (const auto browser = safe_browser(); 
 			browser && iterate_commands([&](command_be k, const utils::str_view& v)
 		{
-			control(k, v);
+			batch_command(k, v);
 		}))
 		{
+			dispatch_commands();
 			entry->commands_set = 0;
 		}
 
+		if (const auto browser = safe_browser(); browser && channel)
+		{
+			const auto consumed = channel_commands.peek([&](char k, const utils::str_view& v)
+			{
+				batch_command(command_be(k), v);
+			});
+			dispatch_commands();
+			channel_commands.release(consumed);
+		}
+
 		if ((entry->fe_flags & 2) != 0 || entry->needs_next_frame > 0)
 		{
 			visible_counter = 250;
@@ -3219,11 +3829,39 @@ public:
 		}
 		entry->be_flags = flags;
 
-		if (entry->response_set == 0 && !response_data.empty())
+		std::unique_lock lock(response_mutex);
+		release_large_responses();
+		record_direct_latency();
+		if (channel)
 		{
-			const auto p = submit_commands();
-			__faststorefence();
-			entry->response_set = p;
+			if (responses_pending())
+			{
+				submit_commands(channel_response);
+				channel_response.publish();
+				mark_response_published();
+			}
+			response_spent = {};
+		}
+		else if (entry->response_set == 0)
+		{
+			if (response_frame_published)
+			{
+				response_frame = {entry->response, ACCSP_FRAME_SIZE};
+				response_frame_published = false;
+			}
+			if (responses_pending())
+			{
+				submit_commands(response_frame);
+			}
+			if (response_frame.count > 0)
+			{
+				__faststorefence();
+				entry->response_set = response_frame.count;
+				response_frame_published = true;
+				++response_frames_published;
+				response_spent = {};
+				mark_response_published();
+			}
 		}
 
 		// base::BindOnce();
@@ -3277,10 +3915,10 @@ public:
 	bool OnCertificateError(CefRefPtr<CefBrowser> browser, cef_errorcode_t cert_error, const CefString& request_url, CefRefPtr<CefSSLInfo> ssl_info,
 		CefRefPtr<CefCallback> callback) override
 	{
-		if (!ignore_certificate_errors_filter._Empty())
+		const auto r = current_rules();
+		if (!r->ignore_certificate_errors_filter.empty())
 		{
-			std::unique_lock lock(ignore_certificate_errors_mutex);
-			if (test_regex(request_url.ToString(), ignore_certificate_errors_filter))
+			if (test_regex(utils::utf8_scratch(request_url), r->ignore_certificate_errors_filter))
 			{
 				callback->Continue();
 				return true;
@@ -3313,7 +3951,7 @@ public:
 		{
 			lson_builder b;
 			b.add("userGesture", user_gesture);
-			b.add("originURL", frame->GetURL().ToString());
+			b.add("originURL", frame->GetURL());
 			b.add("targetURL", target_url);
 			b.add("targetDisposition", encode_wodisp(target_disposition));
 			set_response(command_fe::open_url, b.finalize());
@@ -3324,7 +3962,7 @@ public:
 
 	void OnFaviconURLChange(CefRefPtr<CefBrowser> browser, const std::vector<CefString>& icon_urls) override
 	{
-		auto str = icon_urls.empty() ? std::string() : icon_urls.front().ToString();
+		auto str = icon_urls.empty() ? std::string() : utils::utf8(icon_urls.front());
 		if (str != last_favicon)
 		{
 			set_response(command_fe::favicon, str);
@@ -3336,7 +3974,7 @@ public:
 	{
 		if (frame->IsMain())
 		{
-			auto str = url.ToString();
+			auto str = utils::utf8(url);
 			if (str != last_url)
 			{
 				set_response(command_fe::url, str);
@@ -3347,7 +3985,7 @@ public:
 
 	void OnTitleChange(CefRefPtr<CefBrowser> browser, const CefString& title) override
 	{
-		auto str = title.ToString();
+		auto str = utils::utf8(title);
 		if (str != last_title)
 		{
 			set_response(command_fe::title, str);
@@ -3357,7 +3995,7 @@ public:
 
 	void OnStatusMessage(CefRefPtr<CefBrowser> browser, const CefString& value) override
 	{
-		auto str = value.ToString();
+		auto str = utils::utf8(value);
 		if (str != last_status)
 		{
 			set_response(command_fe::status, str);
@@ -3374,7 +4012,7 @@ public:
 
 	bool OnTooltip(CefRefPtr<CefBrowser> browser, CefString& text) override
 	{
-		auto str = text.ToString();
+		auto str = utils::utf8(text);
 		if (str != last_tooltip)
 		{
 			set_response(command_fe::tooltip, str);
@@ -3517,7 +4155,7 @@ public:
 			else
 			{
 				std::vector<CefString> ret;
-				for (const auto& i : data.split('\1', false, false))
+				for (const auto i : data.pieces('\1'))
 				{
 					ret.push_back(i);
 				}
@@ -3878,7 +4516,7 @@ std::shared_ptr<Layer> create_web_layer(std::shared_ptr<accsp_mapped_typed<accsp
 	{
 		auto ctx(CefRequestContext::CreateContext(context, nullptr));
 		ctx->RegisterSchemeHandlerFactory("ac", "", view);
-		CefBrowserHost::CreateBrowser(window_info, view, view->initial_url, settings, nullptr, std::move(ctx));
+		CefBrowserHost::CreateBrowser(window_info, view, view->initial_url, settings, view->injection_extra_info(), std::move(ctx));
 	}
 	return std::make_shared<WebLayer>(device, view);
 }
@@ -0,0 +1,177 @@
+#include <array>
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Replays frames of commands, as game scripts typically send them, through the dispatch WebView::control used before and
+// the current one. Mock host only counts what it was asked to do, so the difference is in decoding and dispatching alone.
+// This is a model rather than the real dispatcher: WebView needs CEF, so the command switch here mirrors control() and
+// configure_control() with bytes matching command_be. Options go through the same accsp_dispatch_option() as the backend.
+
+struct mock_host
+{
+	std::array<uint64_t, 256> commands{};
+	std::array<uint64_t, 16> options{};
+	uint64_t bytes{};
+
+	void command(char key, const utils::str_view& value)
+	{
+		++commands[uint8_t(key)];
+		bytes += value.size();
+	}
+
+	void option(int index, const utils::str_view& value)
+	{
+		++options[index];
+		bytes += value.size();
+	}
+};
+
+// Order of the if/else chains in control() and configure_control() before switch tables
+static constexpr char chain_control[] = {'N', 'z', 'R', 'S', 'W', 'U', 'C', 'I', '>', '<', 'd', 'n', 'M', 'l', 'A', 'E', 'w', 'm',
+	'r', 'K', 'F', 'H', 'T', 'o', 'c', 'Y', 'L', 'e', '\1'};
+static constexpr char chain_configure[] = {'N', 'i', 'f', 'h', 's', 'j'};
+
+static void dispatch_option_chain(mock_host& host, const utils::str_view& value)
+{
+	const auto kv = value.pair('\1');
+	if (kv.first == "ignoreCertificateErrors") host.option(int(accsp_option::ignore_certificate_errors), kv.second);
+	else if (kv.first == "trackFormData") host.option(int(accsp_option::track_form_data), kv.second);
+	else if (kv.first == "redirectNavigation") host.option(int(accsp_option::redirect_navigation), kv.second);
+	else if (kv.first == "redirectNonStandardSchemes") host.option(int(accsp_option::redirect_nonstandard_schemes), kv.second);
+	else if (kv.first == "collectResourceURLs") host.option(int(accsp_option::collect_resource_urls), kv.second);
+	else if (kv.first == "keepSuspendedTexture") host.option(int(accsp_option::keep_suspended_texture), kv.second);
+	else if (kv.first == "scaleFactor") host.option(int(accsp_option::scale_factor), kv.second);
+	else if (kv.first == "invalidateView") host.option(int(accsp_option::invalidate_view), kv.second);
+	else if (kv.first == "latencyStats") host.option(int(accsp_option::latency_stats), kv.second);
+	else if (kv.first == "binaryEvents") host.option(int(accsp_option::binary_events), kv.second);
+	else if (kv.first == "rendererInjection") host.option(int(accsp_option::renderer_injection), kv.second);
+}
+
+// Comparisons happen one by one at runtime, same as the original chain of `key == command_be::...`
+static TEST_NOINLINE void dispatch_chain(mock_host& host, char key, const utils::str_view& value)
+{
+	for (const auto c : chain_control)
+	{
+		if (c == key)
+		{
+			host.command(key, value);
+			return;
+		}
+	}
+	for (const auto c : chain_configure)
+	{
+		if (c == key)
+		{
+			if (key == 'i') dispatch_option_chain(host, value);
+			else host.command(key, value);
+			return;
+		}
+	}
+}
+
+static TEST_NOINLINE void dispatch_switch(mock_host& host, char key, const utils::str_view& value)
+{
+	switch (key)
+	{
+		case 'i':
+		{
+			accsp_dispatch_option(value, [&](accsp_option option, const utils::str_view&, const utils::str_view& v)
+			{
+				if (option != accsp_option::unknown) host.option(int(option), v);
+			});
+		}
+		break;
+		case 'N': case 'z': case 'R': case 'S': case 'W': case 'U': case 'C': case 'I': case '>': case '<': case 'd': case 'n':
+		case 'M': case 'l': case 'A': case 'E': case 'w': case 'm': case 'r': case 'K': case 'F': case 'H': case 'T': case 'o':
+		case 'c': case 'Y': case 'L': case 'e': case '\1': case 'f': case 'h': case 's': case 'j':
+		{
+			host.command(key, value);
+		}
+		break;
+		default: break;
+	}
+}
+
+struct recorded_frame
+{
+	std::vector<char> data;
+	uint32_t count;
+};
+
+// Mostly input, with scrolls, keys and option updates, and an occasional navigation or script call
+static std::vector<recorded_frame> record_frames(size_t frames)
+{
+	static constexpr const char* options[] = {"scaleFactor\0011.25", "invalidateView\0011", "keepSuspendedTexture\0010",
+		"trackFormData\0011", "collectResourceURLs\0011", "latencyStats\0010", "unknownOption\0011"};
+	std::mt19937 rng(1);
+	std::vector<recorded_frame> ret;
+	for (auto f = 0ULL; f < frames; ++f)
+	{
+		recorded_frame frame{std::vector<char>(ACCSP_FRAME_SIZE), 0};
+		accsp_frame_writer writer{frame.data.data(), frame.data.size()};
+		auto add = [&](char key, const std::string& value) { memcpy(writer.reserve(key, value.size()), value.data(), value.size()); };
+		const auto records = 8 + rng() % 40;
+		for (auto i = 0U; i < records; ++i)
+		{
+			const auto r = rng() % 100;
+			if (r < 45) add('I', "1\001" + std::to_string(rng() % 1920) + "\001" + std::to_string(rng() % 1080));
+			else if (r < 60) add('l', "0\001" + std::to_string(rng() % 200) + "\001-40");
+			else if (r < 70) add(rng() & 1 ? '>' : '<', std::to_string(rng() % 128));
+			else if (r < 80) add('i', options[rng() % std::size(options)]);
+			else if (r < 85) add('z', "0.5");
+			else if (r < 90) add('m', "dark");
+			else if (r < 95) add('e', "onReceive\001{data=1}");
+			else if (r < 98) add('E', "console.log(1)");
+			else add('N', "https://example.com/page/" + std::to_string(rng()));
+		}
+		frame.count = writer.count;
+		ret.push_back(std::move(frame));
+	}
+	return ret;
+}
+
+int main()
+{
+	const auto frames = record_frames(2000);
+	auto commands = 0ULL;
+	for (const auto& f : frames) commands += f.count;
+
+	mock_host chain_host, switch_host;
+	accsp_frame_index index;
+	const auto chain_ms = bench_ms(20, [&]
+	{
+		// Record by record, trusting lengths, as iterate_commands() used to
+		for (const auto& f : frames)
+		{
+			auto p = f.data.data();
+			for (auto i = 0U; i < f.count; ++i)
+			{
+				const auto size = *(const uint16_t*)&p[1];
+				dispatch_chain(chain_host, p[0], utils::str_view(p, 3, size));
+				p += 3 + size;
+			}
+		}
+		return chain_host.bytes;
+	});
+	const auto switch_ms = bench_ms(20, [&]
+	{
+		for (const auto& f : frames)
+		{
+			if (!index.parse(f.data.data(), f.data.size(), f.count)) continue;
+			for (const auto& r : index)
+			{
+				dispatch_switch(switch_host, r.key, index.payload(r));
+			}
+		}
+		return switch_host.bytes;
+	});
+
+	CHECK(chain_host.commands == switch_host.commands);
+	CHECK(chain_host.options == switch_host.options);
+	printf("%llu commands in %zu frames\n", (unsigned long long)commands, frames.size());
+	printf("if/else chains:  %6.1f ns per command\n", chain_ms * 1e6 / double(commands));
+	printf("switch tables:   %6.1f ns per command (including frame validation)\n", switch_ms * 1e6 / double(commands));
+	return finish("dispatch");
+}
@@ -0,0 +1,99 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Encodes load_state, found_result and context_menu payloads the way WebView does it with and without `binaryEvents`,
+// reporting size of each payload and time per encode. Strings come in as CefString, same as from CEF.
+
+struct menu_params
+{
+	CefString frame_url, source_url, link_url, unfiltered_link_url, selection_text, title_text;
+	int x, y;
+	bool editable;
+};
+
+static std::string load_state_lson(int flags, int status, bool secure, bool post)
+{
+	lson_builder b;
+	b.add("secure", secure);
+	b.add("post", post);
+	b.add("flags", flags);
+	b.add("status", status);
+	return b.finalize();
+}
+
+static std::string load_state_binary(int flags, int status, bool secure, bool post)
+{
+	return binary_builder(accsp_binary_schema::load_state, accsp_binary_load_state{flags, status, secure, post}).finalize();
+}
+
+static std::string found_result_lson(int identifier, int count, int x, int y, int w, int h, int index, bool final_update)
+{
+	return lson_builder{}
+		.add("identifier", identifier)
+		.add("index", index)
+		.add("count", count)
+		.begin("rect")
+			.add("x", x)
+			.add("y", y)
+			.add("width", w)
+			.add("height", h)
+			.end()
+		.add("final", final_update)
+		.finalize();
+}
+
+static std::string found_result_binary(int identifier, int count, int x, int y, int w, int h, int index, bool final_update)
+{
+	return binary_builder(accsp_binary_schema::found_result, accsp_binary_found_result{
+		identifier, index, count, x, y, w, h, final_update}).finalize();
+}
+
+static std::string context_menu_lson(const menu_params& p)
+{
+	lson_builder b;
+	b.add("originURu", p.frame_url);
+	b.add_opt("sourceURu", p.source_url);
+	b.add_opt("linkURu", p.link_url);
+	b.add_opt("unfilteredLinkURu", p.unfiltered_link_url);
+	b.add("x", p.x);
+	b.add("y", p.y);
+	b.add_opt("selectedText", p.selection_text);
+	b.add("editable", p.editable);
+	b.add_opt("titleText", p.title_text);
+	return b.finalize();
+}
+
+static std::string context_menu_binary(const menu_params& p)
+{
+	return binary_builder(accsp_binary_schema::context_menu, accsp_binary_context_menu{p.x, p.y, p.editable})
+		.add(p.frame_url).add(p.source_url).add(p.link_url).add(p.unfiltered_link_url).add(p.selection_text).add(p.title_text)
+		.finalize();
+}
+
+template<typename Encode>
+static void measure(const char* name, Encode&& encode)
+{
+	const auto size = encode(0).size();
+	const auto ns = bench_ms(200000, [&, i = 0]() mutable { return encode(i++).size(); }) * 1e6;
+	printf("%-36s %6zu bytes %10.1f ns\n", name, size, ns);
+}
+
+int main()
+{
+	measure("load_state, LSON", [](int i) { return load_state_lson(i & 0xff, 200, true, false); });
+	measure("load_state, binary", [](int i) { return load_state_binary(i & 0xff, 200, true, false); });
+	measure("found_result, LSON", [](int i) { return found_result_lson(i, 42, 120 + i % 7, 640, 58, 18, 7, true); });
+	measure("found_result, binary", [](int i) { return found_result_binary(i, 42, 120 + i % 7, 640, 58, 18, 7, true); });
+
+	const menu_params link{u"https://www.example.com/articles/2024/index.html", u"", u"https://www.example.com/articles/2024/next.html",
+		u"https://www.example.com/articles/2024/next.html", u"", u"Next article", 312, 488, false};
+	const menu_params text{u"https://www.example.com/articles/2024/index.html", u"", u"", u"",
+		u"Some selected text with \"quotes\" and a line\nbreak in it", u"", 312, 488, true};
+	measure("context_menu link, LSON", [&](int) { return context_menu_lson(link); });
+	measure("context_menu link, binary", [&](int) { return context_menu_binary(link); });
+	measure("context_menu selection, LSON", [&](int) { return context_menu_lson(text); });
+	measure("context_menu selection, binary", [&](int) { return context_menu_binary(text); });
+	return 0;
+}
@@ -0,0 +1,43 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Validating and indexing whole frames against decoding records one at a time as they are used
+int main()
+{
+	for (const auto payload_size : {8U, 64U, 1024U})
+	{
+		std::vector<char> frame(ACCSP_FRAME_SIZE);
+		accsp_frame_writer writer{frame.data(), frame.size()};
+		std::string payload(payload_size, 'x');
+		for (char* d; (d = writer.reserve('I', payload.size())) != nullptr;) memcpy(d, payload.data(), payload.size());
+
+		const auto decode_ms = bench_ms(200, [&]
+		{
+			auto sum = 0ULL;
+			auto p = frame.data();
+			for (auto i = 0U; i < writer.count; ++i)
+			{
+				const auto size = *(const uint16_t*)&p[1];
+				sum += uint8_t(p[0]) + utils::str_view(p, 3, size).size();
+				p += 3 + size;
+			}
+			return sum;
+		});
+
+		accsp_frame_index index;
+		const auto index_ms = bench_ms(200, [&]
+		{
+			auto sum = 0ULL;
+			index.parse(frame.data(), frame.size(), writer.count);
+			for (const auto& r : index) sum += uint8_t(r.key) + index.payload(r).size();
+			return sum;
+		});
+
+		printf("%5u B payloads, %5u records per frame:\n", payload_size, writer.count);
+		bench_report("  unchecked decode", decode_ms, double(writer.size));
+		bench_report("  validated index", index_ms, double(writer.size));
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+#include <memory>
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Streaming documents through html_injector in 32 KB chunks, as response filters get them, against collecting the whole
+// document and searching it for `</head>` the way the filter used to. Documents with dense head tags, with large inline
+// scripts and comments the scanner has to skip, and with no insertion point until the end.
+
+static size_t stream(const std::string& doc, const std::shared_ptr<const std::string>& payload)
+{
+	constexpr size_t chunk = 32768;
+	static std::vector<char> out(chunk);
+	html_injector injector(payload);
+	size_t total = 0;
+	for (size_t pos = 0;;)
+	{
+		const auto size = std::min(chunk, doc.size() - pos);
+		size_t read, written;
+		const auto finished = injector.process(doc.data() + pos, size, read, out.data(), out.size(), written);
+		total += written;
+		pos += read;
+		if (finished && size == 0) return total;
+	}
+}
+
+static size_t buffered(const std::string& doc, const std::string& payload)
+{
+	std::string collected;
+	for (size_t pos = 0; pos < doc.size(); pos += 32768) collected.append(doc, pos, 32768);
+	const auto f = collected.find("</head>");
+	if (f == std::string::npos) collected += payload;
+	else collected.insert(f + 7, payload);
+	return collected.size();
+}
+
+static void run(const char* name, const std::string& doc)
+{
+	const auto payload = std::make_shared<const std::string>(4096, 'x');
+	const auto bytes = double(doc.size());
+	const auto calls = std::max(5, int(2e8 / bytes));
+	CHECK(stream(doc, payload) == doc.size() + payload->size());
+	printf("\n%s, %zu bytes\n", name, doc.size());
+	bench_report("buffered, find()", bench_ms(calls, [&] { return buffered(doc, *payload); }), bytes);
+	bench_report("html_injector", bench_ms(calls, [&] { return stream(doc, payload); }), bytes);
+}
+
+int main()
+{
+	std::string doc = "<html><head>";
+	while (doc.size() < 4 << 20) doc += "<meta name=x content=\"a < b\"><link rel=stylesheet href=/a.css>";
+	run("dense head tags", doc + "</head><body></body>");
+
+	doc = "<html><head><script>";
+	while (doc.size() < 4 << 20) doc += "for (var i = 0; i < n; ++i) s += '<div>' + a[i] + '</div>';\n";
+	doc += "</script><!--";
+	while (doc.size() < 8 << 20) doc += " <body> commented out - -- </head> ";
+	run("inline script and comment", doc + "--></head><body></body>");
+
+	doc = "<p>";
+	while (doc.size() < 4 << 20) doc += "Lorem ipsum dolor sit amet, <b>consectetur</b> adipiscing elit.<br>\n";
+	run("no insertion point", doc);
+	return test_failures ? 1 : 0;
+}
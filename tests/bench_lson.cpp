@@ -0,0 +1,46 @@
+#include <vector>
+
+#include "common.h"
+#include "lson_baseline.h"
+#include "util.h"
+
+// Escaping multi-megabyte strings, as with page sources or large form data, with the byte-by-byte loop it replaced and with
+// lson_escape_position(), for text with different amounts of characters needing escapes.
+
+int main()
+{
+	constexpr auto size = 8ULL * 1024 * 1024;
+	std::mt19937 rng(3);
+	for (const auto density : {0U, 4096U, 200U, 40U, 8U})
+	{
+		std::string src(size, ' ');
+		for (auto& c : src)
+		{
+			c = density && rng() % density == 0 ? "\0\n\"\\"[rng() % 4] : char('a' + rng() % 26);
+		}
+
+		std::string dst;
+		const auto baseline = bench_ms(4, [&]
+		{
+			dst.clear();
+			lson_add_string_baseline(dst, src.data(), src.size());
+			return dst.size();
+		});
+		lson_builder b;
+		const auto current = bench_ms(4, [&]
+		{
+			b.dst.clear();
+			b.add_string(src.data(), src.size());
+			return b.dst.size();
+		});
+
+		char label[64];
+		snprintf(label, sizeof label, "8 MB, escape every %u bytes, baseline", density);
+		if (!density) snprintf(label, sizeof label, "8 MB, no escapes, baseline");
+		bench_report(label, baseline, double(size));
+		snprintf(label, sizeof label, "8 MB, escape every %u bytes, current", density);
+		if (!density) snprintf(label, sizeof label, "8 MB, no escapes, current");
+		bench_report(label, current, double(size));
+	}
+	return 0;
+}
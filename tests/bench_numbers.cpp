@@ -0,0 +1,112 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Numeric fields of frequent events formatted the old way, with std::to_string() and add_raw() for every number and boolean,
+// and with lson_builder writing them in place. OnDownloadUpdated sends a fixed binary struct, so its fields (id, flags, 64-bit
+// byte counts and speed) are measured as an LSON table instead, which is where 64-bit integers show up in other events.
+
+struct to_string_builder
+{
+	lson_builder b;
+
+	template<typename T>
+	to_string_builder& add(const lson_key& key, T v) requires(std::is_arithmetic_v<T>)
+	{
+		if constexpr (std::is_same_v<T, bool>) b.add_raw(key, v ? "true" : "false");
+		else b.add_raw(key, std::to_string(v));
+		return *this;
+	}
+
+	template<typename T>
+	to_string_builder& add(const lson_key& key, const T& v) requires(std::is_class_v<T>)
+	{
+		b.add(key, v);
+		return *this;
+	}
+
+	to_string_builder& begin(const lson_key& key)
+	{
+		b.begin(key);
+		return *this;
+	}
+
+	to_string_builder& end()
+	{
+		b.end();
+		return *this;
+	}
+
+	std::string finalize() { return b.finalize(); }
+};
+
+template<typename Builder>
+static std::string found_result(int i)
+{
+	return Builder{}
+		.add("identifier", i)
+		.add("index", 7)
+		.add("count", 42)
+		.begin("rect")
+			.add("x", 120 + i % 7)
+			.add("y", 640)
+			.add("width", 58)
+			.add("height", 18)
+			.end()
+		.add("final", true)
+		.finalize();
+}
+
+template<typename Builder>
+static std::string context_menu(int i)
+{
+	static const CefString url(u"https://www.example.com/articles/2024/index.html");
+	return Builder{}
+		.add("originURL", url)
+		.add("x", 312 + i % 13)
+		.add("y", 488)
+		.add("editable", false)
+		.finalize();
+}
+
+template<typename Builder>
+static std::string download_update(int i)
+{
+	return Builder{}
+		.add("ID", uint32_t(i))
+		.add("flags", 4U)
+		.add("totalBytes", int64_t(734003200))
+		.add("receivedBytes", int64_t(i) * 65536 + 1234567)
+		.add("currentSpeed", int64_t(5242880 + i % 1000))
+		.finalize();
+}
+
+template<typename Builder>
+static std::string zoom_state(int i)
+{
+	return Builder{}
+		.add("zoomLevel", 1.25 + i % 8 * 0.25)
+		.add("scale", 1.5f)
+		.finalize();
+}
+
+template<typename Encode>
+static void measure(const char* name, Encode&& encode)
+{
+	const auto ns = bench_ms(200000, [&, i = 0]() mutable { return encode(i++).size(); }) * 1e6;
+	printf("%-40s %10.1f ns   %s\n", name, ns, encode(1).c_str());
+}
+
+int main()
+{
+	measure("found_result, to_string", found_result<to_string_builder>);
+	measure("found_result, in place", found_result<lson_builder>);
+	measure("context_menu, to_string", context_menu<to_string_builder>);
+	measure("context_menu, in place", context_menu<lson_builder>);
+	measure("download update, to_string", download_update<to_string_builder>);
+	measure("download update, in place", download_update<lson_builder>);
+	measure("floats, to_string", zoom_state<to_string_builder>);
+	measure("floats, in place", zoom_state<lson_builder>);
+	return 0;
+}
@@ -0,0 +1,115 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Frames of responses as a page loading lots of resources produces them: many url_monitor records, a few overriding state
+// updates, and a frontend reading only a part of it each frame, so that backlog piles up. Baseline is the queue of strings
+// responses used to be kept in, with each frame copied out into a frame buffer and the consumed part erased from the front.
+
+static constexpr size_t frame_budget = 16 * 1024;
+static constexpr int frames = 100;
+static constexpr int urls_per_frame = 160;
+
+struct baseline_queue
+{
+	std::vector<std::pair<char, std::vector<std::string>>> data;
+
+	void set(char key, std::string value, bool overriding)
+	{
+		if (overriding)
+		{
+			for (auto& i : data)
+			{
+				if (i.first == key)
+				{
+					i.second.resize(1);
+					i.second[0] = std::move(value);
+					return;
+				}
+			}
+		}
+		data.emplace_back(key, std::vector{std::move(value)});
+	}
+
+	size_t submit(std::vector<char>& frame)
+	{
+		auto p = 0ULL, taken = 0ULL;
+		for (; taken < data.size(); ++taken)
+		{
+			const auto& v = data[taken].second[0];
+			if (p + v.size() + 4 > frame_budget) break;
+			frame[p] = data[taken].first;
+			*(uint16_t*)&frame[p + 1] = uint16_t(v.size());
+			memcpy(&frame[p + 3], v.data(), v.size() + 1);
+			p += v.size() + 3;
+		}
+		data.erase(data.begin(), data.begin() + taken);
+		return p;
+	}
+};
+
+struct log_queue
+{
+	accsp_response_log log;
+
+	void set(char key, const std::string& value, bool overriding)
+	{
+		memcpy(log.append(key, value.size(), overriding, 0), value.data(), value.size());
+	}
+
+	size_t submit(std::vector<char>& frame)
+	{
+		accsp_frame_writer writer{frame.data(), frame_budget};
+		log.consume(log.iterate([&](const accsp_response_log::header& h, const utils::str_view& payload)
+		{
+			const auto d = writer.reserve(h.key, payload.size());
+			if (!d) return false;
+			memcpy(d, payload.data(), payload.size());
+			return true;
+		}));
+		return writer.size;
+	}
+};
+
+template<typename Queue>
+static size_t run(const std::vector<std::string>& urls)
+{
+	Queue queue;
+	std::vector<char> frame(frame_budget + 4);
+	auto ret = 0ULL;
+	auto u = 0ULL;
+	for (auto f = 0; f < frames; ++f)
+	{
+		for (auto i = 0; i < urls_per_frame; ++i)
+		{
+			queue.set('m', urls[u++ % urls.size()], false);
+			if (i % 40 == 0) queue.set('s', "loading\1" + std::to_string(i), true);
+		}
+		queue.set('t', "Page title " + std::to_string(f), true);
+		ret += queue.submit(frame);
+	}
+	while (const auto s = queue.submit(frame)) ret += s;
+	return ret;
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	std::vector<std::string> urls;
+	for (auto i = 0; i < 1024; ++i)
+	{
+		std::string url = "https://cdn.example.com/assets/";
+		for (auto j = 40 + rng() % 80; j > 0; --j) url.push_back(char('a' + rng() % 26));
+		urls.push_back(url + ".js");
+	}
+
+	const auto bytes_baseline = run<baseline_queue>(urls);
+	const auto bytes_log = run<log_queue>(urls);
+	printf("%d frames, %d urls per frame, %.1f KB submitted\n", frames, urls_per_frame, double(bytes_log) / 1024.);
+	if (bytes_baseline != bytes_log) printf("warning: submitted sizes differ: %llu vs %llu\n",
+		(unsigned long long)bytes_baseline, (unsigned long long)bytes_log);
+	bench_report("baseline: vector of strings", bench_ms(5, [&] { return run<baseline_queue>(urls); }), double(bytes_log));
+	bench_report("accsp_response_log", bench_ms(5, [&] { return run<log_queue>(urls); }), double(bytes_log));
+	return 0;
+}
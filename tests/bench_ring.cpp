@@ -0,0 +1,66 @@
+#include <thread>
+
+#include "common.h"
+#include "util.h"
+
+// Round trips through both rings of a shared channel: one thread plays the game sending a command and waiting for reply,
+// other one plays the backend echoing each command back. Both poll, yielding
+// when there is nothing to read, so numbers make sense on machines with few cores too.
+int main()
+{
+	const auto name = L"AcTools.CSP.Bench.Ring." + std::to_wstring(getpid());
+	accsp_mapped_typed<accsp_wb_channel> frontend_block(name, false);
+	accsp_mapped_typed<accsp_wb_channel> backend_block(name, true);
+
+	constexpr auto round_trips = 50000U;
+	for (const auto payload_size : {16U, 256U, 4096U})
+	{
+		std::atomic_bool done{};
+		std::thread backend([&]
+		{
+			accsp_ring_consumer commands{&backend_block->commands};
+			accsp_ring_producer response{&backend_block->response};
+			response.pending = backend_block->response.head;
+			while (!done.load(std::memory_order_relaxed))
+			{
+				auto any = false;
+				commands.read([&](char key, const utils::str_view& payload)
+				{
+					char* d;
+					while (!(d = response.reserve(key, payload.size()))) std::this_thread::yield();
+					memcpy(d, payload.data(), payload.size());
+					response.publish();
+					any = true;
+				});
+				if (!any) std::this_thread::yield();
+			}
+		});
+
+		accsp_ring_producer commands{&frontend_block->commands};
+		commands.pending = frontend_block->commands.head;
+		accsp_ring_consumer response{&frontend_block->response};
+		latency_histogram histogram;
+		std::string payload(payload_size, 'x');
+		const auto t0 = std::chrono::steady_clock::now();
+		for (auto i = 0U; i < round_trips; ++i)
+		{
+			const auto start = perf_counter_now();
+			memcpy(commands.reserve('e', payload.size()), payload.data(), payload.size());
+			commands.publish();
+			for (auto received = false; !received;)
+			{
+				response.read([&](char, const utils::str_view&) { received = true; });
+				if (!received) std::this_thread::yield();
+			}
+			histogram.add(double(perf_counter_now() - start) * 1e6 / double(perf_counter_frequency()));
+		}
+		const auto t1 = std::chrono::steady_clock::now();
+		done = true;
+		backend.join();
+
+		const auto total_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+		printf("payload %5u B: %8.0f round trips/s, p50 %.1f us, p99 %.1f us\n", payload_size, round_trips / total_ms * 1e3,
+			histogram.percentile(0.5f), histogram.percentile(0.99f));
+	}
+	return 0;
+}
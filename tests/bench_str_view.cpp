@@ -0,0 +1,72 @@
+#include <vector>
+
+#include "common.h"
+#include "str_view_baseline.h"
+#include "util.h"
+
+// Each str_view primitive against the loop it replaced, on short URLs as in request filtering and on a long form data blob
+
+static void compare(const char* name, double baseline_ms, double current_ms)
+{
+	printf("%-40s %10.1f ns %10.1f ns %6.1fx\n", name, baseline_ms * 1e6, current_ms * 1e6, baseline_ms / current_ms);
+}
+
+static void run(const char* label, const std::vector<std::string>& inputs)
+{
+	printf("\n%s%-*s   baseline    current\n", label, int(40 - strlen(label)), "");
+	auto n = 0;
+	auto next = [&]() -> const std::string& { return inputs[n++ % inputs.size()]; };
+	auto bytes = 0.;
+	for (const auto& i : inputs) bytes += double(i.size());
+	bytes /= double(inputs.size());
+	const auto calls = std::max(200, int(2e7 / bytes));
+
+	compare("find_first_of(char)",
+		bench_ms(calls, [&] { const auto& s = next(); return baseline::find_first_of(s.data(), s.size(), '?'); }),
+		bench_ms(calls, [&] { return utils::str_view::from_str(next()).find_first_of('?'); }));
+	compare("find_first_of(\"?#\")",
+		bench_ms(calls, [&] { const auto& s = next(); return baseline::find_first_of(s.data(), s.size(), "?#"); }),
+		bench_ms(calls, [&] { return utils::str_view::from_str(next()).find_first_of("?#"); }));
+	compare("find_first_of(std::string, 6 chars)",
+		bench_ms(calls, [&] { const auto& s = next(); static const std::string cs = "?#;!|^"; return baseline::find_first_of(s.data(), s.size(), cs); }),
+		bench_ms(calls, [&] { static const std::string cs = "?#;!|^"; return utils::str_view::from_str(next()).find_first_of(cs); }));
+	compare("find_last_of(\"/\")",
+		bench_ms(calls, [&] { const auto& s = next(); return baseline::find_last_of(s.data(), s.size(), "/", s.size()); }),
+		bench_ms(calls, [&] { const auto& s = next(); return utils::str_view::from_str(s).find_last_of("/", s.size()); }));
+	compare("find(\"tracking\")",
+		bench_ms(calls, [&] { const auto& s = next(); return baseline::find_cstrl(s.data(), s.size(), "tracking", 8); }),
+		bench_ms(calls, [&] { return utils::str_view::from_str(next()).find("tracking"); }));
+	compare("find(\"/analytics/collect?v=\")",
+		bench_ms(calls, [&] { const auto& s = next(); return baseline::find_cstrl(s.data(), s.size(), "/analytics/collect?v=", 21); }),
+		bench_ms(calls, [&] { return utils::str_view::from_str(next()).find("/analytics/collect?v="); }));
+
+	std::vector<std::pair<size_t, size_t>> pieces;
+	compare("split('&') vs pieces('&')",
+		bench_ms(calls, [&] { const auto& s = next(); baseline::split(pieces, s.data(), s.size(), '&'); return pieces.size(); }),
+		bench_ms(calls, [&]
+		{
+			const auto v = utils::str_view::from_str(next());
+			auto ret = 0ULL;
+			for (const auto p : v.pieces('&')) ret += p.size();
+			return ret;
+		}));
+}
+
+int main()
+{
+	std::mt19937 rng(9);
+	std::vector<std::string> urls;
+	for (auto i = 0; i < 256; ++i)
+	{
+		std::string url = "https://www.example" + std::to_string(i % 17) + ".com/static/js/";
+		for (auto j = 10 + rng() % 60; j > 0; --j) url.push_back(char('a' + rng() % 26));
+		url += ".js?v=" + std::to_string(rng()) + "&lang=en&ref=home";
+		urls.push_back(url);
+	}
+	run("URLs, ~100 bytes", urls);
+
+	std::string form;
+	for (auto i = 0; i < 2000; ++i) form += "field" + std::to_string(i) + "=" + std::string(rng() % 40, 'x') + "&";
+	run("form data, ~60 KB", {form});
+	return 0;
+}
@@ -0,0 +1,47 @@
+#include <vector>
+
+#include "common.h"
+#include "utf_reference.h"
+#include "util.h"
+
+// Transcoding URLs, mostly ASCII text and CJK text both ways, with the plain transcoder and with utils, and converting into
+// a new string each time against reusing a buffer as utf8_assign() and utf8_scratch() do
+
+static void run(const char* name, const std::u16string& text)
+{
+	const auto u8 = reference::utf8(text);
+	const auto bytes = double(u8.size());
+	const auto calls = std::max(50, int(2e7 / bytes));
+	printf("\n%s, %zu bytes\n", name, u8.size());
+
+	bench_report("utf-16 to utf-8, plain", bench_ms(calls, [&] { return reference::utf8(text).size(); }), bytes);
+	const CefString cef(text);
+	bench_report("utf-16 to utf-8, utils::utf8()", bench_ms(calls, [&] { return utils::utf8(cef).size(); }), bytes);
+	std::string buffer;
+	bench_report("utf-16 to utf-8, utils::utf8_assign()", bench_ms(calls, [&]
+	{
+		utils::utf8_assign(buffer, cef);
+		return buffer.size();
+	}), bytes);
+	bench_report("utf-8 to utf-16, plain", bench_ms(calls, [&] { return reference::utf16(u8).size(); }), bytes);
+	std::u16string out;
+	bench_report("utf-8 to utf-16, utils", bench_ms(calls, [&]
+	{
+		out.resize(utils::utf16_size<char16_t>(u8.data(), u8.size()));
+		return utils::utf16_write(u8.data(), u8.size(), out.data());
+	}), bytes);
+}
+
+int main()
+{
+	run("URL", u"https://www.example.com/static/js/app.bundle.min.js?v=1718032211&lang=en&ref=home");
+
+	std::u16string text;
+	for (auto i = 0; i < 2000; ++i) text += u"Lorem ipsum dolor sit amet, consectetur adipiscing elit. \x00e9t\x00e9 ";
+	run("mostly ASCII text", text);
+
+	text.clear();
+	for (auto i = 0; i < 4000; ++i) text += u"\x6f22\x5b57\x304b\x306a\x3001\x30ab\x30bf\x30ab\x30ca\x3002 \U0001F600";
+	run("CJK text with emoji", text);
+	return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+
+#ifdef _MSC_VER
+#define TEST_NOINLINE __declspec(noinline)
+#else
+#define TEST_NOINLINE __attribute__((noinline))
+#endif
+
+// Minimal checks for test executables: failures are printed and counted, main() returns finish()
+inline int test_failures = 0;
+
+#define CHECK(x) do { if (!(x)) { ++test_failures; printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); } } while (0)
+
+inline int finish(const char* name)
+{
+	if (test_failures) printf("%s: %d checks failed\n", name, test_failures);
+	else printf("%s: passed\n", name);
+	return test_failures ? 1 : 0;
+}
+
+// Milliseconds per call, best of a few runs, with result folded into sink so that work is not optimized out
+template<typename Callback>
+double bench_ms(int calls, Callback&& callback)
+{
+	static volatile uint64_t sink;
+	auto best = 1e30;
+	for (auto run = 0; run < 5; ++run)
+	{
+		const auto t0 = std::chrono::steady_clock::now();
+		uint64_t s = 0;
+		for (auto i = 0; i < calls; ++i) s += uint64_t(callback());
+		const auto t1 = std::chrono::steady_clock::now();
+		sink = sink + s;
+		best = std::min(best, std::chrono::duration<double, std::milli>(t1 - t0).count() / calls);
+	}
+	return best;
+}
+
+inline void bench_report(const char* name, double ms, double bytes = 0.)
+{
+	if (bytes > 0.) printf("%-48s %10.4f ms %10.1f MB/s\n", name, ms, bytes / (ms * 1e3));
+	else printf("%-48s %10.4f ms\n", name, ms);
+}
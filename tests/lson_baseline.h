@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+// String escaping of lson_builder as it was before lson_escape_position(), for comparison
+inline void lson_add_string_baseline(std::string& dst, const char* data, size_t size)
+{
+	dst.reserve(size + 2);
+	dst.push_back('"');
+	for (auto i = 0U; i < size; ++i)
+	{
+		auto c = data[i];
+		if (c == 0)
+		{
+			dst.push_back('\\');
+			dst.push_back('0');
+		}
+		else if (c == '\n')
+		{
+			dst.push_back('\\');
+			dst.push_back('n');
+		}
+		else
+		{
+			if (c == '"' || c == '\\')
+			{
+				dst.push_back('\\');
+			}
+			dst.push_back(c);
+		}
+	}
+	dst.push_back('"');
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+// Just enough of CEF string types for util.h: UTF-16 storage, conversions through utils transcoding
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+typedef char16_t char16;
+
+struct cef_string_t
+{
+	char16* str;
+	size_t length;
+	void (*dtor)(char16* str);
+};
+
+struct cef_string_utf8_t
+{
+	char* str;
+	size_t length;
+	void (*dtor)(char* str);
+};
+
+namespace utils
+{
+	template<typename C> size_t utf8_size(const C* s, size_t len) noexcept;
+	template<typename C> size_t utf8_write(const C* s, size_t len, char* out) noexcept;
+	template<typename C> size_t utf16_size(const char* s, size_t len) noexcept;
+	template<typename C> size_t utf16_write(const char* s, size_t len, C* out) noexcept;
+}
+
+inline int cef_string_utf8_to_utf16(const char* src, size_t src_len, cef_string_t* output)
+{
+	const auto size = utils::utf16_size<char16_t>(src, src_len);
+	output->str = (char16*)malloc((size + 1) * sizeof(char16));
+	output->length = utils::utf16_write(src, src_len, output->str);
+	output->str[size] = 0;
+	output->dtor = [](char16* str) { free(str); };
+	return 1;
+}
+
+inline int cef_string_utf16_to_utf8(const char16* src, size_t src_len, cef_string_utf8_t* output)
+{
+	const auto size = utils::utf8_size(src, src_len);
+	output->str = (char*)malloc(size + 1);
+	output->length = utils::utf8_write(src, src_len, output->str);
+	output->str[size] = 0;
+	output->dtor = [](char* str) { free(str); };
+	return 1;
+}
+
+class CefString
+{
+public:
+	CefString() = default;
+	CefString(const std::u16string& src) : data_(src) { }
+	CefString(const char16_t* src) : data_(src) { }
+	CefString(const char* src) : CefString(src, strlen(src)) { }
+	CefString(const std::string& src) : CefString(src.data(), src.size()) { }
+
+	CefString(const char* src, size_t length)
+	{
+		data_.resize(utils::utf16_size<char16_t>(src, length));
+		utils::utf16_write(src, length, data_.data());
+	}
+
+	const char16* c_str() const { return data_.c_str(); }
+	size_t length() const { return data_.size(); }
+	size_t size() const { return data_.size(); }
+	bool empty() const { return data_.empty(); }
+
+	std::string ToString() const
+	{
+		std::string ret(utils::utf8_size(data_.data(), data_.size()), '\0');
+		utils::utf8_write(data_.data(), data_.size(), ret.data());
+		return ret;
+	}
+
+private:
+	std::u16string data_;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <ctime>
+
+struct cef_time_t
+{
+	int year;
+	int month;
+	int day_of_week;
+	int day_of_month;
+	int hour;
+	int minute;
+	int second;
+	int millisecond;
+};
+
+inline int cef_time_to_timet(const cef_time_t* cef_time, time_t* time)
+{
+	tm t{};
+	t.tm_year = cef_time->year - 1900;
+	t.tm_mon = cef_time->month - 1;
+	t.tm_mday = cef_time->day_of_month;
+	t.tm_hour = cef_time->hour;
+	t.tm_min = cef_time->minute;
+	t.tm_sec = cef_time->second;
+#ifdef _WIN32
+	*time = _mkgmtime(&t);
+#else
+	*time = timegm(&t);
+#endif
+	return 1;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+// Number parsing used by str_view::as(double) before std::from_chars, copied as it was: digits are accumulated in doubles
+// and scaled by repeated multiplication, so results can be a few ulps off
+namespace baseline
+{
+	inline double pow10(int n)
+	{
+		auto ret = 1.0;
+		auto r = 10.0;
+		if (n < 0)
+		{
+			n = -n;
+			r = 0.1;
+		}
+
+		while (n)
+		{
+			if (n & 1)
+			{
+				ret *= r;
+			}
+			r *= r;
+			n >>= 1;
+		}
+		return ret;
+	}
+
+	inline bool is_digit(char c, int& v)
+	{
+		v = c - '0';
+		return v >= 0 && v <= 9;
+	}
+
+	inline double parse_gen(const char*& c, const char* ce, double d)
+	{
+		if (!c || c == ce)
+		{
+			return d;
+		}
+
+		auto sign = 1;
+		auto int_part = 0.0;
+		auto frac_part = 0.0;
+		auto has_frac = false;
+		auto has_exp = false;
+
+		if (*c == '-')
+		{
+			++c;
+			sign = -1;
+		}
+		else if (*c == '+')
+		{
+			++c;
+		}
+
+		auto s = c;
+		int v;
+		while (true)
+		{
+			auto h = c == ce ? '\0' : *c;
+			if (is_digit(h, v))
+			{
+				int_part = int_part * 10 + v;
+			}
+			else if (h == '.')
+			{
+				has_frac = true;
+				++c;
+				break;
+			}
+			else if (h == 'e' || h == 'E')
+			{
+				has_exp = true;
+				++c;
+				break;
+			}
+			else
+			{
+				return s == c ? d : sign * int_part;
+			}
+			++c;
+		}
+
+		if (has_frac)
+		{
+			auto frac_exp = 0.1;
+			while (true)
+			{
+				auto h = c == ce ? '\0' : *c;
+				if (is_digit(h, v))
+				{
+					frac_part += frac_exp * v;
+					frac_exp *= 0.1;
+				}
+				else if (h == 'e' || h == 'E')
+				{
+					has_exp = true;
+					++c;
+					break;
+				}
+				else
+				{
+					return sign * (int_part + frac_part);
+				}
+				++c;
+			}
+		}
+
+		auto exp_part = 1.0;
+		if (has_exp)
+		{
+			auto exp_sign = 1;
+			auto h = c == ce ? '\0' : *c;
+			if (h == '-')
+			{
+				exp_sign = -1;
+				h = *++c;
+			}
+			else if (h == '+')
+			{
+				h = *++c;
+			}
+
+			auto e = 0;
+			while (is_digit(h, v))
+			{
+				e = e * 10 + v;
+				++c;
+				h = c == ce ? '\0' : *c;
+			}
+
+			exp_part = pow10(exp_sign * e);
+		}
+
+		return sign * (int_part + frac_part) * exp_part;
+	}
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <random>
+#include <string>
+#include <vector>
+
+// Patterns as they show up in resource filters, header and injection rules, plus constructs at the edges of what
+// pattern compiles itself (anchors inside alternations, nested and bounded repeats, classes with escapes) and a few it
+// leaves to std::regex (lookahead, backreferences, \b, POSIX classes)
+inline const std::vector<std::string> pattern_corpus = {
+	"ads?\\.", "^https?://[^/]*doubleclick\\.net", "\\.(png|jpe?g|gif)$", "track(er|ing)", "a{2,3}b", "^$", "x*", "(a|b)*c",
+	"[^a-z]", "\\d{3}", "^ab|cd$", "(?:foo|bar)+baz", "[\\w.-]+@", "a.c", "\\x41", "AbC", "[A-Z]+", "\\s", "(a*)*b",
+	"^(?:a|ab)c$", "google(?:syndication|tagmanager)", "a{0,2}$", "\\/ads\\/", "^___never_{1024}shouldneverhappen__$",
+	"q(?=u)", "(a)\\1", "\\bfoo", "[[:alpha:]]x", "a|", "(|a)b", "[-a]", "[a-]", "[\\d-]", ".*ad.*", "ad.{5,}x", "(x|y){3}z$",
+	"(a|b)*a(a|b){12}", "[ab]*a[ab]{13}c?$", "^https?://([a-z0-9-]+\\.)*example\\.com/", "/(pixel|beacon|collect)\\?",
+	"^[^?]*\\.js(\\?|$)", "utm_(source|medium|campaign)=", "\\.(css|woff2?)(\\?.*)?$", "[?&]ref=[^&]*", "^data:",
+	"^https?://(www\\.)?youtube\\.com/embed/", "\\?.*\\bid=", "a+?b", "(ab){2,}?c", "[\\s\\S]x", "\\D\\W\\S", "[^\\d]z",
+};
+
+// Random strings over an alphabet touching most pattern characters, with pieces of likely matches mixed in
+inline std::string random_subject(std::mt19937& rng, size_t max_size)
+{
+	static const char alphabet[] = "abcxyzABC./:-_@0123456789uq ?&=\nabababab";
+	static const char* pieces[] = {"ads.", "https://x.doubleclick.net", "a.png", "tracking", "aab", "foobarbaz", "A@", "abc", "ab",
+		"cd", "xyzxyzz", "https://www.example.com/", "/collect?", "utm_source=", ".woff2?v=1", "&ref=home", "data:", ".js?"};
+	std::string ret;
+	for (auto n = rng() % (max_size + 1); n > 0; --n) ret.push_back(alphabet[rng() % (sizeof alphabet - 1)]);
+	if (rng() % 3 == 0) ret.insert(rng() % (ret.size() + 1), pieces[rng() % std::size(pieces)]);
+	return ret;
+}
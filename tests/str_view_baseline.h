@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "common.h"
+
+// str_view searching and splitting as it was before SSE2, memchr and Horspool, working on plain pointer and size. Functions
+// which lived in util.cpp are kept out of line, so that a constant needle is not folded into the caller
+namespace baseline
+{
+	inline size_t find_first_of(const char* data, size_t length, char c, size_t index = 0U)
+	{
+		for (auto i = index; i < length; ++i)
+		{
+			if (data[i] == c) return i;
+		}
+		return std::string::npos;
+	}
+
+	inline bool char_matches_str(char c, const std::string& cs)
+	{
+		for (const auto i : cs)
+		{
+			if (i == c) return true;
+		}
+		return false;
+	}
+
+	template <std::size_t N>
+	size_t find_first_of(const char* data, size_t length, const char (&cs)[N], size_t index = 0U)
+	{
+		for (auto i = index; i < length; ++i)
+		{
+			for (auto j = 0U; j < N - 1; ++j)
+			{
+				if (cs[j] == data[i]) return i;
+			}
+		}
+		return std::string::npos;
+	}
+
+	TEST_NOINLINE inline size_t find_first_of(const char* data, size_t length, const std::string& cs, size_t index = 0U)
+	{
+		for (auto i = index; i < length; ++i)
+		{
+			if (char_matches_str(data[i], cs)) return i;
+		}
+		return std::string::npos;
+	}
+
+	inline size_t find_last_of(const char* data, size_t length, const std::string& cs, size_t index = 0U)
+	{
+		for (auto i = std::min(index, length); i > 0; --i)
+		{
+			if (char_matches_str(data[i - 1], cs)) return i;
+		}
+		return std::string::npos;
+	}
+
+	// Without the case of needle ending exactly at the end, which used to return a bool
+	TEST_NOINLINE inline size_t find_cstrl(const char* data, size_t length, const char* c, size_t c_len, size_t index = 0U)
+	{
+		if (index >= length) return std::string::npos;
+		if (index + c_len > length) return std::string::npos;
+		const auto s = std::search(&data[index], data + length, c, c + c_len);
+		return s == data + length ? std::string::npos : s - data;
+	}
+
+	TEST_NOINLINE inline void split(std::vector<std::pair<size_t, size_t>>& result, const char* data, size_t length, char separator)
+	{
+		result.clear();
+		auto index = 0U;
+		while (index <= length)
+		{
+			auto next = find_first_of(data, length, separator, index);
+			if (next == std::string::npos) next = uint32_t(length);
+			result.emplace_back(index, uint32_t(next) - index);
+			index = uint32_t(next) + 1;
+		}
+	}
+}
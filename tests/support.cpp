@@ -0,0 +1,14 @@
+#include <chrono>
+
+#include "util.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash/xxhash.h"
+
+// Defined in main.cpp for the actual build
+std::chrono::high_resolution_clock::time_point time_start = std::chrono::high_resolution_clock::now();
+
+uint64_t hash_code_raw(const void* data, size_t size)
+{
+	return XXH3_64bits(data, size);
+}
@@ -0,0 +1,97 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Coalescing of commands within a frame: only the last value of a state stays, per option for `set_option`, relative
+// scrolls go only if an absolute one follows, invalidateView always stays, and nothing gets dropped across a command
+// that can not be coalesced
+
+enum : char
+{
+	zoom = 1,
+	mute,
+	set_option,
+	scroll,
+	navigate,
+};
+
+struct command
+{
+	char key;
+	utils::str_view value;
+	bool dropped;
+};
+
+static accsp_coalescing coalescing_of(char key)
+{
+	switch (key)
+	{
+		case zoom:
+		case mute: return accsp_coalescing::latest;
+		case set_option: return accsp_coalescing::latest_per_option;
+		case scroll: return accsp_coalescing::latest_absolute_scroll;
+		default: return accsp_coalescing::none;
+	}
+}
+
+static std::vector<utils::str_view> options;
+static uint32_t last_dropped;
+
+// Returns `+` for each command that stays and `-` for each one dropped
+static std::string run(const std::vector<std::pair<char, const char*>>& batch)
+{
+	std::vector<command> commands;
+	for (const auto& [key, value] : batch) commands.push_back({key, utils::str_view::from_cstr(value), true});
+	last_dropped = accsp_coalesce_commands(commands, options, coalescing_of);
+	std::string ret;
+	auto count = 0U;
+	for (const auto& c : commands)
+	{
+		ret += c.dropped ? '-' : '+';
+		if (c.dropped) ++count;
+	}
+	CHECK(count == last_dropped);
+	return ret;
+}
+
+int main()
+{
+	CHECK(run({}) == "");
+	CHECK(last_dropped == 0);
+
+	// Latest state per key
+	CHECK(run({{zoom, "1"}, {mute, "1"}, {zoom, "2"}, {zoom, "3"}, {mute, "0"}}) == "---++");
+	CHECK(last_dropped == 3);
+
+	// Latest value per option, invalidateView every time
+	CHECK(run({{set_option, "scaleFactor\1" "1"}, {set_option, "trackFormData\1" "1"}, {set_option, "scaleFactor\1" "2"},
+		{set_option, "trackFormData\1" "0"}, {set_option, "scaleFactor\1" "3"}}) == "---++");
+	CHECK(last_dropped == 3);
+	CHECK(run({{set_option, "invalidateView\1"}, {set_option, "invalidateView\1"}, {set_option, "invalidateView\1"}}) == "+++");
+	CHECK(last_dropped == 0);
+
+	// Relative scrolls go only before an absolute one, absolute ones are overwritten by any later absolute one
+	CHECK(run({{scroll, "0\1" "10"}, {scroll, "0\1" "20"}}) == "++");
+	CHECK(run({{scroll, "0\1" "10"}, {scroll, "1\1" "100"}, {scroll, "0\1" "20"}, {scroll, "0\1" "30"}}) == "-+++");
+	CHECK(run({{scroll, "1\1" "50"}, {scroll, "0\1" "10"}, {scroll, "1\1" "100"}, {scroll, "0\1" "5"}}) == "--++");
+	CHECK(last_dropped == 2);
+
+	// Commands that can not be coalesced are barriers for all kinds of coalescing
+	CHECK(run({{zoom, "1"}, {navigate, "a"}, {zoom, "2"}}) == "+++");
+	CHECK(run({{zoom, "1"}, {zoom, "2"}, {navigate, "a"}, {zoom, "3"}, {zoom, "4"}}) == "-++-+");
+	CHECK(run({{set_option, "scaleFactor\1" "1"}, {navigate, "a"}, {set_option, "scaleFactor\1" "2"}}) == "+++");
+	CHECK(run({{scroll, "0\1" "10"}, {navigate, "a"}, {scroll, "1\1" "100"}}) == "+++");
+	CHECK(run({{navigate, "a"}, {navigate, "a"}}) == "++");
+
+	// So is invalidateView: options set before it stay for it to see
+	CHECK(run({{set_option, "scaleFactor\1" "1"}, {set_option, "invalidateView\1"}, {set_option, "scaleFactor\1" "2"}}) == "+++");
+	CHECK(run({{zoom, "1"}, {zoom, "2"}, {set_option, "invalidateView\1"}, {zoom, "3"}}) == "-+++");
+	CHECK(last_dropped == 1);
+
+	// Mixed frame, with options scratch space left over from the previous frames
+	CHECK(run({{zoom, "1"}, {scroll, "0\1" "1"}, {set_option, "latencyStats\1" "1"}, {scroll, "1\1" "0"}, {mute, "1"},
+		{set_option, "latencyStats\1" "0"}, {zoom, "2"}, {navigate, "b"}, {mute, "0"}, {scroll, "0\1" "2"}}) == "---+++++++");
+	CHECK(last_dropped == 3);
+	return finish("coalesce");
+}
@@ -0,0 +1,117 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Fuzzing accsp_frame_index::parse() with mutations of a small corpus of frames: every result is compared with a plain
+// bounds-checked walk, and every payload handed out has to stay inside of the frame.
+
+static bool reference_walk(const std::vector<char>& frame, uint32_t count, std::vector<accsp_frame_record>& records)
+{
+	records.clear();
+	size_t p = 0;
+	for (auto i = 0U; i < count; ++i)
+	{
+		if (frame.size() < 3 || p > frame.size() - 3) return false;
+		uint16_t size;
+		memcpy(&size, &frame[p + 1], 2);
+		if (size > frame.size() - p - 3) return false;
+		records.push_back({frame[p], size, uint32_t(p + 3)});
+		p += 3 + size;
+	}
+	return true;
+}
+
+static void check_frame(const std::vector<char>& frame, uint32_t count)
+{
+	static std::vector<accsp_frame_record> expected;
+	accsp_frame_index index;
+	const auto valid = index.parse(frame.data(), frame.size(), count);
+	const auto expected_valid = reference_walk(frame, count, expected);
+	CHECK(valid == expected_valid);
+	if (!valid)
+	{
+		CHECK(index.records.empty());
+		return;
+	}
+	CHECK(index.records.size() == expected.size());
+	for (auto i = 0U; i < index.records.size() && i < expected.size(); ++i)
+	{
+		const auto& r = index.records[i];
+		const auto payload = index.payload(r);
+		CHECK(r.key == expected[i].key && r.size == expected[i].size && r.offset == expected[i].offset);
+		CHECK(payload.data() >= frame.data() && payload.end() <= frame.data() + frame.size());
+	}
+}
+
+static std::vector<char> make_frame(const std::vector<std::pair<char, std::string>>& records, size_t capacity, uint32_t& count)
+{
+	std::vector<char> ret(capacity);
+	accsp_frame_writer writer{ret.data(), ret.size()};
+	for (const auto& [key, value] : records)
+	{
+		if (const auto d = writer.reserve(key, value.size())) memcpy(d, value.data(), value.size());
+	}
+	count = writer.count;
+	return ret;
+}
+
+struct corpus_entry
+{
+	std::vector<char> frame;
+	uint32_t count;
+};
+
+static std::vector<corpus_entry> corpus()
+{
+	std::vector<corpus_entry> ret;
+	auto add = [&](const std::vector<std::pair<char, std::string>>& records, size_t capacity)
+	{
+		corpus_entry e;
+		e.frame = make_frame(records, capacity, e.count);
+		ret.push_back(std::move(e));
+	};
+	add({}, 16);
+	add({{'N', "https://example.com/"}}, 64);
+	add({{'I', "1\0011\0012"}, {'l', "0\0010\001-40"}, {'i', "scaleFactor\0011.5"}}, 64);
+	add({{'e', std::string(1000, 'x')}, {'\2', std::string(8, '\0')}}, 1024);
+	add({{'z', ""}, {'z', ""}, {'z', ""}}, 12);
+	add({{'H', std::string(UINT16_MAX, 'h')}}, ACCSP_FRAME_SIZE);
+
+	std::mt19937 rng(2);
+	std::vector<std::pair<char, std::string>> many;
+	for (auto i = 0; i < 3000; ++i) many.emplace_back(char(rng()), std::string(rng() % 40, char(rng())));
+	add(many, ACCSP_FRAME_SIZE);
+
+	// Damaged ones: count past the records, record running past the end, count larger than the whole frame could hold
+	ret.push_back({ret[2].frame, ret[2].count + 1});
+	ret.push_back({std::vector<char>{'N', char(0xff), char(0xff), 'x'}, 1});
+	ret.push_back({std::vector<char>(10), UINT32_MAX});
+	return ret;
+}
+
+int main()
+{
+	const auto entries = corpus();
+	for (const auto& e : entries) check_frame(e.frame, e.count);
+
+	std::mt19937 rng(3);
+	for (auto i = 0; i < 200000; ++i)
+	{
+		auto e = entries[rng() % entries.size()];
+		const auto mutations = 1 + rng() % 4;
+		for (auto m = 0U; m < mutations; ++m)
+		{
+			switch (rng() % 5)
+			{
+				case 0: if (!e.frame.empty()) e.frame[rng() % e.frame.size()] = char(rng()); break;
+				case 1: if (!e.frame.empty()) e.frame.resize(rng() % e.frame.size()); break;
+				case 2: e.count += rng() % 3; break;
+				case 3: e.count = rng() % 8; break;
+				case 4: e.frame.insert(e.frame.begin() + (e.frame.empty() ? 0 : rng() % e.frame.size()), char(rng())); break;
+			}
+		}
+		check_frame(e.frame, e.count);
+	}
+	return finish("frame");
+}
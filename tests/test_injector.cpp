@@ -0,0 +1,106 @@
+#include <memory>
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Injection points in documents split at every position, fed in chunks of every size into output buffers down to a
+// single byte: tags split across chunks, comments and raw text hiding tags, quoted attributes, no insertion point at all
+
+struct injector_case
+{
+	std::string doc;
+	std::string expected;
+};
+
+static const injector_case cases[] = {
+	{"<html><head><title>x</title></HEAD ><body>hi</body></html>", "<html><head><title>x</title></HEAD >@@@<body>hi</body></html>"},
+	{"<html><BODY class=\"a>b\">hi</body></html>", "<html><BODY class=\"a>b\">@@@hi</body></html>"},
+	{"<html><bodyx><p>text", "<html><bodyx><p>text@@@"},
+	{"<head></header></head><body>", "<head></header></head>@@@<body>"},
+	{"<</head>x</head>", "<</head>@@@x</head>"},
+	{"<body>", "<body>@@@"},
+	{"<body/>x", "<body/>@@@x"},
+	{"", ""},
+	{"<head><script>var s = \"<body>\";</script></head><body>", "<head><script>var s = \"<body>\";</script></head>@@@<body>"},
+	{"<head><script type=\"a>b\">'</head>'</SCRIPT ></head>", "<head><script type=\"a>b\">'</head>'</SCRIPT ></head>@@@"},
+	{"<head><style>a::after{content:'<body>'}</style><body>", "<head><style>a::after{content:'<body>'}</style><body>@@@"},
+	{"<head><!-- <body> </head> --></head>", "<head><!-- <body> </head> --></head>@@@"},
+	{"<!-- a -- b ---><body>", "<!-- a -- b ---><body>@@@"},
+	{"<!--></head>x", "<!--></head>@@@x"},
+	{"<!---></head>x", "<!---></head>@@@x"},
+	{"<!--x-></head>--><body>", "<!--x-></head>--><body>@@@"},
+	{"<scripts><body>", "<scripts><body>@@@"},
+	{"<styles/><script/><body></script><body>", "<styles/><script/><body></script><body>@@@"},
+	{"<html><script>never closed <body>", "<html><script>never closed <body>@@@"},
+	{"<!DOCTYPE html><head></head >", "<!DOCTYPE html><head></head >@@@"},
+	{std::string("<body\0<body>", 12), std::string("<body\0<body>@@@", 15)},
+};
+
+// Feeds document in pieces, ending with an empty call the way CEF marks the end of response
+static std::string run(const std::vector<std::string>& pieces, size_t out_size)
+{
+	html_injector injector(std::make_shared<const std::string>("@@@"));
+	std::string ret;
+	std::vector<char> out(out_size);
+	const auto feed = [&](const std::string& piece)
+	{
+		for (size_t pos = 0, calls = 0; calls < 100000; ++calls)
+		{
+			size_t read, written;
+			const auto finished = injector.process(piece.data() + pos, piece.size() - pos, read, out.data(), out.size(), written);
+			ret.append(out.data(), written);
+			pos += read;
+			if (finished) return;
+		}
+		CHECK(false);
+	};
+	for (const auto& p : pieces) feed(p);
+	feed({});
+	CHECK(injector.injected() || ret.empty());
+	return ret;
+}
+
+static std::vector<std::string> chunks(const std::string& doc, size_t size)
+{
+	std::vector<std::string> ret;
+	for (size_t i = 0; i < doc.size(); i += size) ret.push_back(doc.substr(i, size));
+	return ret;
+}
+
+int main()
+{
+	for (const auto& c : cases)
+	{
+		for (auto split = 0ULL; split <= c.doc.size(); ++split)
+		{
+			const auto out = run({c.doc.substr(0, split), c.doc.substr(split)}, 4096);
+			if (out != c.expected) printf("split %d of \"%s\": \"%s\"\n", int(split), c.doc.c_str(), out.c_str());
+			CHECK(out == c.expected);
+		}
+		for (auto size = 1ULL; size <= c.doc.size() + 1; ++size)
+		{
+			for (auto out_size : {1, 2, 3, 7, 64})
+			{
+				CHECK(run(chunks(c.doc, size), out_size) == c.expected);
+			}
+		}
+	}
+
+	// Only the first insertion point counts
+	CHECK(run({"</head></head><body>"}, 64) == "</head>@@@</head><body>");
+
+	// Injection point past large raw text and comments
+	{
+		std::string doc = "<head><script>";
+		for (auto i = 0; i < 5000; ++i) doc += "if (a<b) s += '<body>' + '--></head>';";
+		doc += "</script><!--";
+		for (auto i = 0; i < 5000; ++i) doc += "- <body> -- </head> ->";
+		doc += "--></head><body>";
+		for (auto size : {1000, 4096, 65536})
+		{
+			CHECK(run(chunks(doc, size), 4096) == doc.substr(0, doc.size() - 6) + "@@@<body>");
+		}
+	}
+	return finish("injector");
+}
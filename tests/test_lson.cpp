@@ -0,0 +1,258 @@
+#include <vector>
+
+#include "common.h"
+#include "lson_baseline.h"
+#include "util.h"
+
+// Escaping of lson_builder strings compared with the byte-by-byte version it replaced: every length around the 16-byte
+// blocks, every escaped character at every position, random strings of different escape density and bytes above 0x7f.
+// Keys encoded at compile time against the same keys encoded at runtime. Nested tables written in place with begin(),
+// end() and child() against copying nested builders and against commas placed by buffer size, as they used to be.
+
+static std::string escaped(const std::string& s)
+{
+	lson_builder b;
+	b.dst.clear();
+	b.add_string(s.data(), s.size());
+	return b.dst;
+}
+
+static std::string escaped_baseline(const std::string& s)
+{
+	std::string ret;
+	lson_add_string_baseline(ret, s.data(), s.size());
+	return ret;
+}
+
+static size_t escape_position_scalar(const std::string& s)
+{
+	for (auto i = 0ULL; i < s.size(); ++i)
+	{
+		const auto c = s[i];
+		if (c == 0 || c == '\n' || c == '"' || c == '\\') return i;
+	}
+	return s.size();
+}
+
+static void check(const std::string& s)
+{
+	CHECK(lson_escape_position(s.data(), s.size()) == escape_position_scalar(s));
+	CHECK(escaped(s) == escaped_baseline(s));
+}
+
+static std::string keyed(const lson_key& key)
+{
+	return lson_builder{}.add(key, 1).finalize();
+}
+
+// Literal goes through consteval constructor, the same text as a pointer through add_key()
+#define CHECK_KEY(literal) CHECK(keyed(lson_key(literal)) == keyed(lson_key::dynamic(literal)))
+
+static void test_keys()
+{
+	CHECK_KEY("a");
+	CHECK_KEY("abc");
+	CHECK_KEY("camelCase_9");
+	CHECK_KEY("Z0");
+	CHECK_KEY("a-b");
+	CHECK_KEY("1x");
+	CHECK_KEY("_a");
+	CHECK_KEY("a b");
+	CHECK_KEY("");
+	CHECK_KEY("a\"b");
+	CHECK_KEY("a\\b");
+	CHECK_KEY("a\nb");
+	CHECK_KEY("\"\\\n");
+	CHECK_KEY("\xc3\xa9");
+
+	// 46 bytes of key and `=` fill encoded buffer, in bare and in quoted form
+	CHECK_KEY("abcdefghijabcdefghijabcdefghijabcdefghijabcdef");
+	CHECK_KEY("a-cdefghijabcdefghijabcdefghijabcdefghijab");
+	CHECK(lson_key("abcdefghijabcdefghijabcdefghijabcdefghijabcdef").size == 47);
+	CHECK(lson_key("a-cdefghijabcdefghijabcdefghijabcdefghijab").size == 47);
+	CHECK(keyed(lson_key("a-b")) == "{[\"a-b\"]=1}");
+}
+
+// Random document: items with or without keys, holding numbers, strings or tables nested a few levels deep
+struct lson_node
+{
+	const char* key{};
+	int number{};
+	std::string text;
+	bool is_text{};
+	bool is_table{};
+	std::vector<lson_node> items;
+};
+
+static lson_node random_table(std::mt19937& rng, int depth)
+{
+	static const char* keys[] = {nullptr, "a", "b2", "x-y", "q\"", "_k"};
+	lson_node ret;
+	ret.is_table = true;
+	for (auto n = rng() % 5; n > 0; --n)
+	{
+		lson_node item;
+		const auto kind = rng() % 4;
+		if (kind == 0 && depth < 4) item = random_table(rng, depth + 1);
+		else if (kind == 1)
+		{
+			item.is_text = true;
+			item.text = std::string(rng() % 4, "{}\"a"[rng() % 4]);
+		}
+		else item.number = int(rng() % 2000) - 1000;
+		item.key = keys[rng() % std::size(keys)];
+		ret.items.push_back(std::move(item));
+	}
+	return ret;
+}
+
+// Builder with `{` and no closing brace, commas by buffer size
+static std::string reference_table(const lson_node& table)
+{
+	std::string ret = "{";
+	for (const auto& i : table.items)
+	{
+		if (ret.size() > 1) ret.push_back(',');
+		lson_builder key;
+		key.dst.clear();
+		key.add_key(i.key);
+		ret += key.dst;
+		if (i.is_table) ret += reference_table(i) + "}";
+		else if (i.is_text) lson_add_string_baseline(ret, i.text.data(), i.text.size());
+		else ret += std::to_string(i.number);
+	}
+	return ret;
+}
+
+static void add_value(lson_builder& b, const lson_node& i)
+{
+	if (i.is_text) b.add(lson_key::dynamic(i.key), i.text);
+	else b.add(lson_key::dynamic(i.key), i.number);
+}
+
+static lson_builder nested_builders(const lson_node& table)
+{
+	lson_builder ret;
+	for (const auto& i : table.items)
+	{
+		if (i.is_table) ret.add(lson_key::dynamic(i.key), nested_builders(i));
+		else add_value(ret, i);
+	}
+	return ret;
+}
+
+// With close_last unset, tables still open at the very end are left for finalize()
+static void streamed(lson_builder& b, const lson_node& table, bool close_last)
+{
+	for (auto n = 0ULL; n < table.items.size(); ++n)
+	{
+		const auto& i = table.items[n];
+		if (!i.is_table) add_value(b, i);
+		else
+		{
+			b.begin(lson_key::dynamic(i.key));
+			const auto last = n + 1 == table.items.size();
+			streamed(b, i, close_last || !last);
+			if (close_last || !last) b.end();
+		}
+	}
+}
+
+static void with_child(lson_builder& b, const lson_node& table)
+{
+	for (const auto& i : table.items)
+	{
+		if (i.is_table) b.child(lson_key::dynamic(i.key), [&](lson_builder& c) { with_child(c, i); });
+		else add_value(b, i);
+	}
+}
+
+static void test_nested()
+{
+	// Fixed cases: empty tables, array items inside a table, three levels, tables left open
+	CHECK(lson_builder{}.begin("a").end().finalize() == "{a={}}");
+	CHECK(lson_builder{}.begin("a").begin("b").begin("c").add("x", 1).end().end().add(nullptr, 2).end().add("y", 3).finalize()
+		== "{a={b={c={x=1}},2},y=3}");
+	CHECK(lson_builder{}.add("x", 1).begin(nullptr).add(nullptr, 1).add(nullptr, 2).end().begin("e").end().finalize()
+		== "{x=1,{1,2},e={}}");
+	CHECK(lson_builder{}.begin("a").begin("b").add("x", 1).finalize() == "{a={b={x=1}}}");
+	CHECK(lson_builder{}.child("a", [](lson_builder& b) { b.child("b", [](lson_builder&) { }); }).finalize() == "{a={b={}}}");
+
+	std::mt19937 rng(12);
+	for (auto round = 0; round < 20000; ++round)
+	{
+		const auto doc = random_table(rng, 0);
+		const auto expected = reference_table(doc) + "}";
+		auto nested = nested_builders(doc);
+		CHECK(nested.finalize() == expected);
+
+		lson_builder a;
+		streamed(a, doc, true);
+		CHECK(a.depth == 0);
+		CHECK(a.finalize() == expected);
+
+		lson_builder b;
+		streamed(b, doc, false);
+		CHECK(b.finalize() == expected);
+
+		lson_builder c;
+		with_child(c, doc);
+		CHECK(c.finalize() == expected);
+		if (test_failures) break;
+	}
+}
+
+int main()
+{
+	for (auto size = 0; size <= 70; ++size)
+	{
+		std::string s(size, 'a');
+		check(s);
+		for (const auto c : {'\0', '\n', '"', '\\'})
+		{
+			for (auto i = 0; i < size; ++i)
+			{
+				auto t = s;
+				t[i] = c;
+				check(t);
+				t[size - 1] = c;
+				check(t);
+			}
+		}
+	}
+
+	// Characters next to escaped ones must pass untouched
+	for (auto c = 1; c < 256; ++c)
+	{
+		check(std::string(33, char(c)));
+	}
+
+	std::mt19937 rng(11);
+	for (auto round = 0; round < 20000; ++round)
+	{
+		const auto density = 1 + rng() % 200;
+		std::string s(rng() % 300, ' ');
+		for (auto& c : s)
+		{
+			c = rng() % density == 0 ? "\0\n\"\\"[rng() % 4] : char(rng() % 2 ? 'a' + rng() % 26 : 0x80 + rng() % 128);
+		}
+		check(s);
+	}
+
+	// Whole builder output still reads as before for keys and values needing escapes
+	lson_builder b;
+	b.add(lson_key::dynamic("a\"b"), std::string("x\ny\\z\0w", 7));
+	b.add("plain", std::string("value"));
+	std::string expected = "{[";
+	lson_add_string_baseline(expected, "a\"b", 3);
+	expected += "]=";
+	lson_add_string_baseline(expected, "x\ny\\z\0w", 7);
+	expected += ",plain=";
+	lson_add_string_baseline(expected, "value", 5);
+	expected += "}";
+	CHECK(b.finalize() == expected);
+
+	test_keys();
+	test_nested();
+	return finish("lson");
+}
@@ -0,0 +1,101 @@
+#include <cmath>
+#include <vector>
+
+#include "common.h"
+#include "parse_baseline.h"
+#include "util.h"
+
+// str_view::as(double) and as(float) against strtod()/strtof(), which they have to match exactly for anything they accept,
+// and against the parser they replaced, which they have to match within its rounding error. Inputs both handle differently
+// on purpose are listed explicitly.
+
+static double as_double(const std::string& s, double d = -999.)
+{
+	return utils::str_view::from_str(s).as(d);
+}
+
+static double parse_baseline(const std::string& s, double d = -999.)
+{
+	auto c = s.data();
+	return baseline::parse_gen(c, s.data() + s.size(), d);
+}
+
+static bool close(double a, double b)
+{
+	return a == b || std::abs(a - b) <= 1e-12 * std::max(std::abs(a), std::abs(b));
+}
+
+static std::string random_number(std::mt19937& rng)
+{
+	std::string ret;
+	if (rng() % 3 == 0) ret.push_back(rng() % 2 ? '-' : '+');
+	for (auto i = rng() % 12; i > 0; --i) ret.push_back(char('0' + rng() % 10));
+	if (rng() % 2)
+	{
+		ret.push_back('.');
+		for (auto i = rng() % 12; i > 0; --i) ret.push_back(char('0' + rng() % 10));
+	}
+	if (ret.find_first_of("0123456789") == std::string::npos) ret.push_back(char('0' + rng() % 10));
+	if (rng() % 3 == 0)
+	{
+		ret.push_back(rng() % 2 ? 'e' : 'E');
+		if (rng() % 2) ret.push_back(rng() % 2 ? '-' : '+');
+		ret += std::to_string(rng() % 40);
+	}
+	if (rng() % 4 == 0) ret += rng() % 2 ? "px" : ",1";
+	return ret;
+}
+
+int main()
+{
+	std::mt19937 rng(13);
+	for (auto round = 0; round < 200000; ++round)
+	{
+		const auto s = random_number(rng);
+		const auto v = as_double(s);
+		CHECK(v == strtod(s.c_str(), nullptr));
+		CHECK(close(v, parse_baseline(s)));
+		const auto f = strtof(s.c_str(), nullptr);
+		if (std::isfinite(f) && (f != 0.f || v == 0.)) CHECK(utils::str_view::from_str(s).as(-999.f) == f);
+		else CHECK(utils::str_view::from_str(s).as(-999.f) == -999.f);
+		if (test_failures > 10)
+		{
+			printf("failed on: %s\n", s.c_str());
+			break;
+		}
+	}
+
+	// Same for everyone
+	for (const auto& s : {"0", "-0", "1", "+1", "-1", ".5", "5.", "-.25", "1e3", "1E3", "1e+3", "1e-3", "1.5e", "2.5px", "3,4", "0.1",
+		"123456789012345678", "9007199254740993", "1e-300"})
+	{
+		CHECK(as_double(s) == strtod(s, nullptr));
+		CHECK(close(as_double(s), parse_baseline(s)));
+	}
+
+	// Not a number: default is returned, as before
+	for (const auto& s : {"", "-", "+", "abc", "px"})
+	{
+		CHECK(as_double(s) == -999.);
+		CHECK(parse_baseline(s) == -999.);
+	}
+
+	// Exact now where the old parser was a few ulps off
+	CHECK(as_double("0.3") == 0.3);
+	CHECK(as_double("1.1e-10") == 1.1e-10);
+	CHECK(as_double("123.456") == 123.456);
+
+	// Intended differences: hex integers in either case, like strtod(), out of range values and words for inf and nan give default,
+	// second sign is not accepted
+	CHECK(as_double("0x1A") == 26. && as_double("0X1a") == 26. && as_double("-0x10") == -16.);
+	CHECK(as_double("0x1A") == strtod("0x1A", nullptr) && as_double("0X1a") == strtod("0X1a", nullptr));
+	CHECK(parse_baseline("0x1A") == 0.);
+	CHECK(as_double("0x") == 0.);
+	CHECK(as_double("1e400") == -999. && std::isinf(parse_baseline("1e400")));
+	CHECK(as_double("inf") == -999. && as_double("nan") == -999. && as_double("-inf") == -999.);
+	CHECK(as_double("+-1") == -999.);
+	CHECK(as_double(".") == -999. && as_double("-.") == -999. && as_double("e5") == -999.);
+	CHECK(parse_baseline(".") == 0. && parse_baseline("e5") == 0.);
+	CHECK(utils::str_view("1e39").as(-1.f) == -1.f);
+	return finish("parse");
+}
@@ -0,0 +1,200 @@
+#include <regex>
+#include <vector>
+
+#include "common.h"
+#include "pattern.h"
+#include "pattern_corpus.h"
+
+// pattern::search() and pattern_set::search() against std::regex_search() with the flags URL rules used before: the corpus
+// of rule patterns and randomly generated ones, on random strings and URL-like ones, with and without icase
+
+static std::regex make_regex(const std::string& p, bool icase)
+{
+	auto flags = std::regex_constants::ECMAScript | std::regex_constants::nosubs;
+	if (icase) flags |= std::regex_constants::icase;
+	return std::regex(p, flags);
+}
+
+static int mismatches = 0;
+
+static void check_pattern(const std::string& p, bool icase, std::mt19937& rng, int subjects)
+{
+	utils::pattern compiled;
+	std::regex reference;
+	auto compiled_error = false, reference_error = false;
+	try { compiled = utils::pattern::compile(utils::str_view::from_str(p), icase); }
+	catch (const std::regex_error&) { compiled_error = true; }
+	try { reference = make_regex(p, icase); }
+	catch (const std::regex_error&) { reference_error = true; }
+	CHECK(compiled_error == reference_error);
+	if (compiled_error || reference_error) return;
+
+	for (auto i = 0; i < subjects; ++i)
+	{
+		const auto s = random_subject(rng, p.size() > 15 ? 40 : 12);
+		const auto expected = std::regex_search(s, reference);
+		if (compiled.search(utils::str_view::from_str(s)) != expected)
+		{
+			if (++mismatches < 10) printf("mismatch: /%s/%s on \"%s\", expected %d\n", p.c_str(), icase ? "i" : "", s.c_str(), expected);
+			CHECK(false);
+			return;
+		}
+	}
+}
+
+// Patterns within the subset pattern compiles itself, so random ones exercise automaton rather than fallback
+static std::string random_pattern(std::mt19937& rng, int depth = 0)
+{
+	static const char* atoms[] = {"a", "b", "c", "x", ".", "\\d", "\\w", "[ab]", "[^a]", "[a-c]", "\\.", "/", "A", "\\s", "[0-9x]"};
+	std::string ret;
+	for (auto n = 1 + rng() % 4; n > 0; --n)
+	{
+		const auto kind = rng() % 10;
+		if (kind < 2 && depth < 2)
+		{
+			ret += kind == 0 ? "(" + random_pattern(rng, depth + 1) + "|" + random_pattern(rng, depth + 1) + ")" : "(?:" + random_pattern(rng, depth + 1) + ")";
+			// Repeated groups of repeats send std::regex backtracking for minutes
+			if (rng() % 4 == 0) ret += "?";
+			continue;
+		}
+		ret += atoms[rng() % std::size(atoms)];
+		switch (rng() % 8)
+		{
+			case 0: ret += "*"; break;
+			case 1: ret += "+"; break;
+			case 2: ret += "?"; break;
+			case 3: ret += "{" + std::to_string(rng() % 3) + "," + std::to_string(2 + rng() % 3) + "}"; break;
+		}
+	}
+	if (depth == 0 && rng() % 4 == 0) ret = "^" + ret;
+	if (depth == 0 && rng() % 4 == 0) ret += "$";
+	return ret;
+}
+
+// Compiled instances are shared while anything holds them, per text and case flag, and counted in stats
+static void test_sharing()
+{
+	const auto compile = [](const char* p, bool icase = true) { return utils::pattern::compile(utils::str_view::from_cstr(p), icase); };
+	auto before = utils::pattern::stats();
+	const auto a = compile("^shared[0-9]+$");
+	auto after = utils::pattern::stats();
+	CHECK(after.misses == before.misses + 1 && after.hits == before.hits);
+	CHECK(after.entries == before.entries + 1);
+
+	before = after;
+	const auto b = compile("^shared[0-9]+$");
+	after = utils::pattern::stats();
+	CHECK(a.same_instance(b));
+	CHECK(after.hits == before.hits + 1 && after.misses == before.misses);
+
+	// Case flag is part of the key
+	before = after;
+	const auto c = compile("^shared[0-9]+$", false);
+	after = utils::pattern::stats();
+	CHECK(!a.same_instance(c));
+	CHECK(after.misses == before.misses + 1);
+	CHECK(a.search(utils::str_view::from_cstr("SHARED1")) && !c.search(utils::str_view::from_cstr("SHARED1")));
+	CHECK(compile("^shared[0-9]+$", false).same_instance(c));
+
+	// Invalid patterns throw every time and leave no entry behind
+	before = utils::pattern::stats();
+	for (auto i = 0; i < 2; ++i)
+	{
+		auto thrown = false;
+		try { compile("shared(["); }
+		catch (const std::regex_error&) { thrown = true; }
+		CHECK(thrown);
+	}
+	after = utils::pattern::stats();
+	CHECK(after.entries == before.entries && after.hits == before.hits && after.misses == before.misses);
+
+	// Once nothing holds an instance, the same text compiles anew
+	{
+		const auto expired = compile("^expiring[a-z]$");
+		CHECK(expired.search(utils::str_view::from_cstr("expiringx")));
+	}
+	before = utils::pattern::stats();
+	const auto recompiled = compile("^expiring[a-z]$");
+	after = utils::pattern::stats();
+	CHECK(after.misses == before.misses + 1 && after.hits == before.hits);
+	CHECK(recompiled.search(utils::str_view::from_cstr("expiringx")));
+	CHECK(compile("^expiring[a-z]$").same_instance(recompiled));
+
+	// Empty pattern is not compiled or counted at all
+	before = utils::pattern::stats();
+	CHECK(compile("").empty());
+	after = utils::pattern::stats();
+	CHECK(after.hits == before.hits && after.misses == before.misses);
+}
+
+int main()
+{
+	test_sharing();
+
+	std::mt19937 rng(19);
+	for (const auto& p : pattern_corpus)
+	{
+		check_pattern(p, true, rng, 4000);
+		check_pattern(p, false, rng, 1000);
+	}
+
+	auto compiled = 0;
+	for (auto i = 0; i < 1500; ++i)
+	{
+		const auto p = random_pattern(rng);
+		check_pattern(p, rng() % 2 == 0, rng, 300);
+		compiled += utils::pattern::compile(utils::str_view::from_str(p)).compiled();
+	}
+	CHECK(compiled == 1500);
+
+	// Things left to std::regex still work through it
+	for (const auto p : {"q(?=u)", "(?!a)b", "\\bfoo", "[[:alpha:]]x"})
+	{
+		CHECK(!utils::pattern::compile(utils::str_view::from_cstr(p)).compiled());
+	}
+
+	// Large alternation is too much work to expand eagerly: compiles quickly and is simulated instead, with the same results
+	{
+		std::string p;
+		for (auto i = 0; i < 400; ++i) p += (i ? "|" : "") + std::string("w") + std::to_string(i) + ".*[a-z]{2}x" + std::to_string(i % 10) + "y";
+		const auto t0 = std::chrono::steady_clock::now();
+		const auto big = utils::pattern::compile(utils::str_view::from_str(p));
+		const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+		CHECK(big.compiled());
+		CHECK(ms < 2000.);
+		const auto reference = make_regex(p, true);
+		for (auto i = 0; i < 300; ++i)
+		{
+			std::string s = "https://example.com/w" + std::to_string(rng() % 500) + "/" + random_subject(rng, 20) + "x" + std::to_string(rng() % 10) + "y";
+			CHECK(big.search(utils::str_view::from_str(s)) == std::regex_search(s, reference));
+		}
+	}
+
+	// Set gives the same answers as each pattern alone, including empty pattern and patterns without literals
+	{
+		std::vector<std::string> texts(pattern_corpus.begin(), pattern_corpus.end());
+		texts.push_back("");
+		for (auto i = 0; i < 70; ++i) texts.push_back("k" + std::to_string(i) + "z");
+		std::vector<utils::pattern> patterns;
+		for (const auto& p : texts)
+		{
+			try { patterns.push_back(utils::pattern::compile(utils::str_view::from_str(p))); }
+			catch (const std::regex_error&) {}
+		}
+		const utils::pattern_set set{patterns};
+		CHECK(set.size() == patterns.size());
+		utils::pattern_set::mask m;
+		for (auto i = 0; i < 20000; ++i)
+		{
+			auto s = random_subject(rng, 30);
+			if (i % 4 == 0) s += "K" + std::to_string(rng() % 80) + "Z";
+			set.search(utils::str_view::from_str(s), m);
+			for (auto j = 0ULL; j < patterns.size(); ++j)
+			{
+				CHECK(utils::pattern_set::test(m, j) == patterns[j].search(utils::str_view::from_str(s)));
+			}
+			if (test_failures > 10) break;
+		}
+	}
+	return finish("pattern");
+}
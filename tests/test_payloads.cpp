@@ -0,0 +1,134 @@
+#include <vector>
+
+#include "common.h"
+#include "pattern.h"
+
+// Injection payloads against the way backend used to assemble them, color scheme followed by both tags always, with empty
+// tags removed. Repeated combinations share a buffer until rules generation changes, masks over 64 rules are not memoized.
+
+using entries = utils::injection_payloads::entries;
+
+static entries make_entries(const char* prefix, size_t count)
+{
+	entries ret;
+	for (auto i = 0U; i < count; ++i)
+	{
+		ret.emplace_back(utils::pattern::compile(utils::str_view::from_str("/p" + std::to_string(i) + "/")), prefix + std::to_string(i));
+	}
+	return ret;
+}
+
+static std::string reference(const std::string& color_scheme, const entries& css, const utils::pattern_set::mask& css_matched,
+	const entries& js, const utils::pattern_set::mask& js_matched)
+{
+	std::string collected_css = "<style>", collected_js = "<script>";
+	for (auto i = 0U; i < css.size(); ++i)
+	{
+		if (utils::pattern_set::test(css_matched, i)) collected_css += css[i].second;
+	}
+	for (auto i = 0U; i < js.size(); ++i)
+	{
+		if (!utils::pattern_set::test(js_matched, i)) continue;
+		collected_js += js[i].second;
+		collected_js.push_back(';');
+	}
+	auto ret = color_scheme + collected_css + "</style>" + collected_js + "</script>";
+	for (const auto& empty : {"<style></style>", "<script></script>"})
+	{
+		if (const auto f = ret.find(empty, color_scheme.size()); f != std::string::npos) ret.erase(f, strlen(empty));
+	}
+	return ret;
+}
+
+static utils::pattern_set::mask random_mask(std::mt19937& rng, size_t count)
+{
+	utils::pattern_set::mask ret((count + 63) / 64);
+	for (auto i = 0U; i < count; ++i)
+	{
+		if (rng() % 3 == 0) ret[i >> 6] |= 1ULL << (i & 63);
+	}
+	return ret;
+}
+
+static void test_reference()
+{
+	std::mt19937 rng(1);
+	for (auto iteration = 0; iteration < 2000; ++iteration)
+	{
+		const auto css = make_entries("c", rng() % 100);
+		const auto js = make_entries("j", rng() % 100);
+		const std::string color_scheme = rng() % 2 ? "<meta name=color-scheme content=dark>" : "";
+		const auto css_matched = random_mask(rng, css.size());
+		const auto js_matched = random_mask(rng, js.size());
+		CHECK(utils::injection_payloads::assemble(color_scheme, css, css_matched, js, js_matched)
+			== reference(color_scheme, css, css_matched, js, js_matched));
+
+		utils::injection_payloads payloads;
+		const auto payload = payloads.get(uint32_t(iteration), color_scheme, css, css_matched, js, js_matched);
+		const auto expected = reference(color_scheme, css, css_matched, js, js_matched);
+		if (expected.empty()) CHECK(!payload);
+		else CHECK(payload && *payload == expected);
+	}
+}
+
+static void test_memo()
+{
+	utils::injection_payloads payloads;
+	auto css = make_entries("c", 10);
+	const auto js = make_entries("j", 10);
+	const utils::pattern_set::mask css_matched{0b101}, js_matched{0b10}, none{0};
+
+	// Nothing matched and no color scheme: nothing to inject, empty masks count as nothing matched as well
+	CHECK(!payloads.get(1, "", css, none, js, none));
+	CHECK(!payloads.get(1, "", css, {}, js, {}));
+
+	const auto a = payloads.get(1, "", css, css_matched, js, js_matched);
+	CHECK(a && *a == "<style>c0c2</style><script>j1;</script>");
+	CHECK(payloads.get(1, "", css, css_matched, js, js_matched) == a);
+	const auto b = payloads.get(1, "", css, css_matched, js, none);
+	CHECK(b && *b == "<style>c0c2</style>");
+	CHECK(payloads.get(1, "", css, css_matched, js, js_matched) == a);
+	CHECK(payloads.get(1, "", css, css_matched, js, none) == b);
+
+	// Bumped generation means rules changed, payload is assembled again from new rules
+	css[0].second = "C0";
+	const auto c = payloads.get(2, "", css, css_matched, js, js_matched);
+	CHECK(c != a);
+	CHECK(*c == "<style>C0c2</style><script>j1;</script>");
+	CHECK(*a == "<style>c0c2</style><script>j1;</script>");
+	CHECK(payloads.get(2, "", css, css_matched, js, js_matched) == c);
+
+	// Eight slots: combinations pushed out by newer ones are assembled again
+	for (auto i = 1U; i <= 8; ++i) CHECK(payloads.get(2, "", css, {i}, js, none));
+	const auto d = payloads.get(2, "", css, css_matched, js, js_matched);
+	CHECK(d != c);
+	CHECK(*d == *c);
+}
+
+static void test_large_sets()
+{
+	utils::injection_payloads payloads;
+	const auto css = make_entries("c", 100);
+	const auto js = make_entries("j", 10);
+	const utils::pattern_set::mask css_matched{1, 1ULL << 35}, js_matched{1};
+	const auto a = payloads.get(1, "", css, css_matched, js, js_matched);
+	const auto b = payloads.get(1, "", css, css_matched, js, js_matched);
+	CHECK(a && b && a != b);
+	CHECK(*a == "<style>c0c99</style><script>j0;</script>");
+	CHECK(*a == *b);
+
+	// Same for JS set over 64 rules, even with CSS set small enough
+	const auto large_js = make_entries("j", 65);
+	const utils::pattern_set::mask css_small{1}, js_large{0, 1};
+	const auto e = payloads.get(1, "", css, css_small, large_js, js_large);
+	CHECK(e && *e == "<style>c0</style><script>j64;</script>");
+	CHECK(payloads.get(1, "", css, css_small, large_js, js_large) != e);
+}
+
+int main()
+{
+	test_reference();
+	test_memo();
+	test_large_sets();
+	return finish("payloads");
+}
@@ -0,0 +1,122 @@
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Size classes of large message blocks, reuse of released ones and limits on what stays mapped: free blocks take up to 64 MB
+// altogether with the oldest ones going first, blocks over 32 MB are not kept at all
+
+static const auto prefix = L"AcTools.CSP.Test.Pool." + std::to_wstring(getpid());
+
+static void test_size_classes()
+{
+	accsp_mapped_pool pool;
+	for (const auto& [size, capacity] : std::vector<std::pair<size_t, size_t>>{
+		{0, 64 << 10}, {1, 64 << 10}, {64 << 10, 64 << 10}, {(64 << 10) + 1, 128 << 10}, {200000, 256 << 10}, {1 << 20, 1 << 20}})
+	{
+		const auto b = pool.acquire(prefix, size);
+		CHECK(b.mapping->size == capacity);
+		CHECK(b.mapping->entry != nullptr);
+	}
+	CHECK(pool.hits == 0);
+	CHECK(pool.misses == 6);
+}
+
+static void test_reuse()
+{
+	accsp_mapped_pool pool;
+	auto a = pool.acquire(prefix, 100000);
+	const auto key = a.key;
+	const auto entry = a.mapping->entry;
+	((char*)entry)[0] = 'x';
+	pool.release(std::move(a));
+	CHECK(pool.pooled_size() == 128 << 10);
+
+	// Any size of the same class takes the released block, mapped where it was and under the same name
+	auto b = pool.acquire(prefix, (64 << 10) + 1);
+	CHECK(b.key == key);
+	CHECK(b.mapping->entry == entry);
+	CHECK(((char*)b.mapping->entry)[0] == 'x');
+	CHECK(pool.pooled_size() == 0);
+	CHECK(pool.hits == 1);
+	CHECK(pool.misses == 1);
+
+	// Other class is a miss with a new key, released block stays for later
+	pool.release(std::move(b));
+	const auto c = pool.acquire(prefix, 1);
+	CHECK(c.key != key);
+	CHECK(c.mapping->size == 64 << 10);
+	CHECK(pool.pooled_size() == 128 << 10);
+	CHECK(pool.hits == 1);
+	CHECK(pool.misses == 2);
+
+	// Remaining block of the class is picked up on the next hit
+	const auto d = pool.acquire(prefix, 128 << 10);
+	CHECK(d.key == key);
+	CHECK(pool.hits == 2);
+}
+
+static void test_limits()
+{
+	accsp_mapped_pool pool;
+
+	// Block over 32 MB is unmapped on release instead of staying in pool
+	auto huge = pool.acquire(prefix, (32 << 20) + 1);
+	CHECK(huge.mapping->size == 64 << 20);
+	pool.release(std::move(huge));
+	CHECK(pool.pooled_size() == 0);
+	auto large = pool.acquire(prefix, 32 << 20);
+	const auto large_key = large.key;
+	pool.release(std::move(large));
+	CHECK(pool.pooled_size() == 32 << 20);
+
+	// Three 16 MB blocks on top of the 32 MB one go past 64 MB, so the oldest block goes first
+	std::vector<accsp_mapped_pool::block> blocks;
+	for (auto i = 0; i < 3; ++i) blocks.push_back(pool.acquire(prefix, 16 << 20));
+	std::vector<int> keys;
+	for (auto& b : blocks)
+	{
+		keys.push_back(b.key);
+		pool.release(std::move(b));
+		CHECK(pool.pooled_size() <= 64 << 20);
+	}
+	CHECK(pool.pooled_size() == 48 << 20);
+
+	const auto misses = pool.misses;
+	const auto hits = pool.hits;
+	auto again = pool.acquire(prefix, 32 << 20);
+	CHECK(again.key != large_key);
+	CHECK(pool.misses == misses + 1);
+	for (auto i = 0; i < 3; ++i)
+	{
+		const auto b = pool.acquire(prefix, 16 << 20);
+		CHECK(b.key == keys[i]);
+	}
+	CHECK(pool.hits == hits + 3);
+	CHECK(pool.pooled_size() == 0);
+
+	// Free blocks of a single class past the limit: only the last 64 MB worth of them stays
+	blocks.clear();
+	for (auto i = 0; i < 6; ++i) blocks.push_back(pool.acquire(prefix, 16 << 20));
+	keys.clear();
+	for (auto& b : blocks)
+	{
+		keys.push_back(b.key);
+		pool.release(std::move(b));
+	}
+	CHECK(pool.pooled_size() == 64 << 20);
+	for (auto i = 2; i < 6; ++i)
+	{
+		const auto b = pool.acquire(prefix, 16 << 20);
+		CHECK(b.key == keys[i]);
+	}
+	CHECK(pool.pooled_size() == 0);
+}
+
+int main()
+{
+	test_size_classes();
+	test_reuse();
+	test_limits();
+	return finish("pool");
+}
@@ -0,0 +1,119 @@
+#include <deque>
+#include <vector>
+
+#include "common.h"
+#include "util.h"
+
+// Random appends and partial submits against a plain queue model: overriding keys replace pending value in place, so
+// order of records seen by frontend has to match the model exactly, whether new value fits into the old slot or not.
+
+struct model_record
+{
+	char key;
+	std::string value;
+};
+
+static bool is_overriding(char key)
+{
+	return key >= 'a' && key <= 'd';
+}
+
+static std::string make_value(std::mt19937& rng, char key)
+{
+	const auto size = rng() % 4 == 0 ? rng() % 2000 : rng() % 40;
+	std::string ret(size, key);
+	for (auto& c : ret) c = char('0' + rng() % 40);
+	return ret;
+}
+
+static void append(accsp_response_log& log, std::deque<model_record>& model, char key, const std::string& value, int64_t time)
+{
+	const auto overriding = is_overriding(key);
+	const auto d = log.append(key, value.size(), overriding, time);
+	memcpy(d, value.data(), value.size());
+	if (overriding)
+	{
+		const auto f = std::ranges::find(model, key, &model_record::key);
+		if (f != model.end())
+		{
+			f->value = value;
+			return;
+		}
+	}
+	model.push_back({key, value});
+}
+
+static void submit(accsp_response_log& log, std::deque<model_record>& model, size_t budget)
+{
+	auto submitted = 0ULL;
+	const auto p = log.iterate([&](const accsp_response_log::header& h, const utils::str_view& payload)
+	{
+		if (submitted == budget) return false;
+		CHECK(submitted < model.size());
+		if (submitted < model.size())
+		{
+			CHECK(h.key == model[submitted].key);
+			CHECK(payload == utils::str_view::from_str(model[submitted].value));
+		}
+		++submitted;
+		return true;
+	});
+	CHECK(p.records == submitted);
+	log.consume(p);
+	model.erase(model.begin(), model.begin() + std::min(size_t(submitted), model.size()));
+	CHECK(log.count() == model.size());
+	CHECK(log.empty() == model.empty());
+}
+
+int main()
+{
+	std::mt19937 rng(7);
+	for (auto round = 0; round < 200; ++round)
+	{
+		accsp_response_log log;
+		std::deque<model_record> model;
+		for (auto step = 0; step < 2000; ++step)
+		{
+			if (rng() % 5 == 0)
+			{
+				submit(log, model, rng() % 3 == 0 ? SIZE_MAX : rng() % 8);
+			}
+			else
+			{
+				const auto key = char('a' + rng() % 8);
+				append(log, model, key, make_value(rng, key), step);
+			}
+		}
+		submit(log, model, SIZE_MAX);
+		CHECK(model.empty());
+	}
+
+	// Overriding value growing past its slot keeps position ahead of records appended after it
+	{
+		accsp_response_log log;
+		std::deque<model_record> model;
+		append(log, model, 'a', "1", 1);
+		append(log, model, 'x', "2", 2);
+		append(log, model, 'a', std::string(100, '3'), 3);
+		append(log, model, 'y', "4", 4);
+		append(log, model, 'a', std::string(300, '5'), 5);
+		append(log, model, 'a', std::string(200, '6'), 6);
+		CHECK(log.count() == 3);
+		submit(log, model, SIZE_MAX);
+	}
+
+	// Backlog which never drains gets compacted on the way, records must survive moving
+	{
+		accsp_response_log log;
+		std::deque<model_record> model;
+		for (auto i = 0; i < 200000; ++i)
+		{
+			append(log, model, 'x', std::string(100, 'x'), i);
+			append(log, model, 'y', std::string(100, 'y'), i);
+			submit(log, model, 1);
+		}
+		CHECK(log.count() == 200000);
+		submit(log, model, SIZE_MAX);
+	}
+	return finish("response_log");
+}
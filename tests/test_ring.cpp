@@ -0,0 +1,91 @@
+#include <thread>
+
+#include "common.h"
+#include "util.h"
+
+// Producer and consumer run in separate threads over separate mappings of the same named block, like the game and the backend do
+static void test_channel()
+{
+	const auto name = L"AcTools.CSP.Test.Ring." + std::to_wstring(getpid());
+	accsp_mapped_typed<accsp_wb_channel> producer_block(name, false);
+	accsp_mapped_typed<accsp_wb_channel> consumer_block(name, true);
+	CHECK(producer_block.entry != consumer_block.entry);
+
+	constexpr auto count = 200000U;
+	std::thread producer_thread([&]
+	{
+		accsp_ring_producer producer{&producer_block->commands};
+		std::mt19937 rng(1);
+		for (auto i = 0U; i < count;)
+		{
+			// Sizes up to the limit make sure records end next to the end of ring and padding gets used
+			const auto size = i % 1000 == 0 ? size_t(UINT16_MAX - 4) : size_t(rng() % 300);
+			const auto d = producer.reserve(char(1 + i % 100), size + 4);
+			if (!d)
+			{
+				producer.publish();
+				std::this_thread::yield();
+				continue;
+			}
+			memcpy(d, &i, 4);
+			memset(d + 4, char('a' + i % 26), size);
+			if (i % 7 == 0) producer.publish();
+			++i;
+		}
+		producer.publish();
+	});
+
+	accsp_ring_consumer consumer{&consumer_block->commands};
+	auto next = 0U;
+	auto bad = 0U;
+	while (next < count)
+	{
+		const auto before = next;
+		consumer.read([&](char key, const utils::str_view& payload)
+		{
+			uint32_t index;
+			memcpy(&index, payload.data(), 4);
+			if (index != next || key != char(1 + next % 100) || payload.data()[payload.size()] != '\0'
+				|| (payload.size() > 4 && payload[payload.size() - 1] != char('a' + next % 26))) ++bad;
+			++next;
+		});
+		if (next == before) std::this_thread::yield();
+	}
+	producer_thread.join();
+	CHECK(bad == 0);
+	CHECK(next == count);
+	CHECK(consumer_block->commands.head == consumer_block->commands.tail);
+}
+
+static void test_limits()
+{
+	auto ring = std::make_unique<accsp_ring>();
+	accsp_ring_producer producer{ring.get()};
+	accsp_ring_consumer consumer{ring.get()};
+	CHECK(producer.reserve('a', UINT16_MAX + 1ULL) == nullptr);
+
+	// Ring is full once the consumer falls a whole buffer behind, and takes records again after consumer catches up
+	auto written = 0U;
+	while (producer.reserve('b', 1000)) ++written;
+	CHECK(written == ACCSP_RING_SIZE / 1004);
+	producer.publish();
+	auto read = 0U;
+	consumer.read([&](char, const utils::str_view&) { ++read; });
+	CHECK(read == written);
+	CHECK(producer.reserve('c', 1000) != nullptr);
+
+	// Single-slot frames terminate payloads the same way
+	char frame[64];
+	accsp_frame_writer writer{frame, sizeof frame};
+	memset(frame, 'x', sizeof frame);
+	const auto d = writer.reserve('k', 5);
+	CHECK(d != nullptr && d[5] == '\0');
+	CHECK(writer.reserve('k', sizeof frame) == nullptr);
+}
+
+int main()
+{
+	test_channel();
+	test_limits();
+	return finish("ring");
+}
@@ -0,0 +1,253 @@
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common.h"
+#include "pattern.h"
+#include "util.h"
+
+// Rules published the way web_layer.cpp does it: writers swap snapshots while readers match URLs through verdict cache.
+// Verdict taken from cache has to agree with the pattern of the snapshot reader holds, and updates of tables verdicts do
+// not depend on must leave cached verdicts alone. Readers keep going while a writer is stuck in the middle of an update,
+// and snapshots are freed only once nobody reads them, including threads past the number of reader slots.
+
+struct test_rules
+{
+	uint32_t verdicts_generation{};
+	uint32_t filter_index{};
+	utils::pattern filter;
+	std::string other;
+};
+
+static utils::rules_snapshot<test_rules> rules;
+
+static void update_filter(uint32_t index)
+{
+	rules.update([&](test_rules& r)
+	{
+		r.filter_index = index;
+		r.filter = utils::pattern::compile(utils::str_view::from_str("/ad" + std::to_string(index % 7) + "/"));
+		++r.verdicts_generation;
+	});
+}
+
+static void update_other(uint32_t index)
+{
+	rules.update([&](test_rules& r) { r.other = std::to_string(index); });
+}
+
+static std::string make_url(uint32_t ad, uint32_t page)
+{
+	return "https://example.com/ad" + std::to_string(ad) + "/p" + std::to_string(page);
+}
+
+static bool blocked(utils::url_verdict_cache& cache, const test_rules& r, const std::string& url)
+{
+	const utils::url_verdict_cache::key key{std::hash<std::string>{}(url), r.verdicts_generation};
+	utils::url_verdict verdict;
+	if (!cache.lookup(key, utils::url_verdict::filter, verdict))
+	{
+		verdict.blocked = r.filter.search(utils::str_view::from_str(url));
+		cache.store(key, utils::url_verdict::filter, verdict);
+	}
+	return verdict.blocked;
+}
+
+static void test_concurrent_updates()
+{
+	utils::url_verdict_cache cache;
+	update_filter(0);
+
+	std::atomic<bool> done{};
+	std::atomic<int> failures{};
+	std::vector<std::thread> readers;
+	for (auto t = 0U; t < 3; ++t)
+	{
+		readers.emplace_back([&, t]
+		{
+			std::mt19937 rng(t);
+			while (!done.load(std::memory_order_relaxed))
+			{
+				const auto r = rules.current();
+				const auto ad = uint32_t(rng() % 7);
+				const auto url = make_url(ad, uint32_t(rng() % 40));
+				if (blocked(cache, *r, url) != (ad == r->filter_index % 7)) failures.fetch_add(1);
+			}
+		});
+	}
+
+	std::vector<std::thread> writers;
+	for (auto t = 0U; t < 2; ++t)
+	{
+		writers.emplace_back([&, t]
+		{
+			for (auto i = 0U; i < 20000; ++i)
+			{
+				if (i % 3 == 0) update_filter(i * 2 + t);
+				else update_other(i);
+			}
+		});
+	}
+	for (auto& w : writers) w.join();
+	done = true;
+	for (auto& r : readers) r.join();
+	CHECK(failures.load() == 0);
+	CHECK(cache.hits.load() > 0);
+}
+
+// Only updates that change filter invalidate verdicts
+static void test_generations()
+{
+	utils::url_verdict_cache cache;
+	update_filter(3);
+	const auto before = rules.current()->verdicts_generation;
+	const auto url = make_url(3, 1);
+	CHECK(blocked(cache, *rules.current(), url));
+
+	update_other(1);
+	CHECK(rules.current()->verdicts_generation == before);
+	const auto hits = cache.hits.load();
+	CHECK(blocked(cache, *rules.current(), url));
+	CHECK(cache.hits.load() == hits + 1);
+
+	update_filter(4);
+	CHECK(rules.current()->verdicts_generation != before);
+	const auto misses = cache.misses.load();
+	CHECK(!blocked(cache, *rules.current(), url));
+	CHECK(cache.misses.load() == misses + 1);
+}
+
+// Snapshot with a flag outliving it, so that a reader can tell if snapshot it holds was freed without touching it
+struct tracked
+{
+	std::shared_ptr<std::atomic<bool>> alive = std::make_shared<std::atomic<bool>>(true);
+	uint32_t value{};
+
+	tracked() = default;
+	tracked(const tracked& other) : value(other.value) { }
+	~tracked() { *alive = false; }
+};
+
+static void test_reclamation()
+{
+	utils::rules_snapshot<tracked> snapshot;
+	std::atomic<bool> done{};
+	std::atomic<int> failures{};
+	std::vector<std::thread> readers;
+	for (auto t = 0; t < 3; ++t)
+	{
+		readers.emplace_back([&]
+		{
+			while (!done.load(std::memory_order_relaxed))
+			{
+				const auto r = snapshot.current();
+				const auto alive = r->alive;
+				const auto value = r->value;
+				{
+					// Nested section keeps the outer one going
+					const auto inner = snapshot.current();
+					if (inner->value < value) failures.fetch_add(1);
+				}
+				std::this_thread::yield();
+				if (!*alive || r->value != value) failures.fetch_add(1);
+			}
+		});
+	}
+	for (auto i = 1U; i <= 20000; ++i)
+	{
+		snapshot.update([&](tracked& r) { r.value = i; });
+	}
+	done = true;
+	for (auto& r : readers) r.join();
+	CHECK(failures.load() == 0);
+
+	// Without readers next update frees everything replaced
+	snapshot.update([&](tracked& r) { ++r.value; });
+	CHECK(snapshot.retired() == 0);
+}
+
+// Readers do not wait for the writer: one is parked inside update callback, holding update mutex, while others read
+static void test_readers_do_not_wait()
+{
+	utils::rules_snapshot<tracked> snapshot;
+	std::mutex mutex;
+	std::condition_variable cv;
+	auto reads = 0;
+	std::thread writer([&]
+	{
+		snapshot.update([&](tracked& r)
+		{
+			std::unique_lock lock(mutex);
+			cv.wait_for(lock, std::chrono::seconds(10), [&] { return reads == 4; });
+			r.value = 1;
+		});
+	});
+	std::vector<std::thread> readers;
+	for (auto t = 0; t < 4; ++t)
+	{
+		readers.emplace_back([&]
+		{
+			for (auto i = 0; i < 10000; ++i) CHECK(snapshot.current()->value == 0);
+			std::unique_lock lock(mutex);
+			++reads;
+			cv.notify_all();
+		});
+	}
+	for (auto& r : readers) r.join();
+	writer.join();
+	CHECK(reads == 4);
+	CHECK(snapshot.current()->value == 1);
+}
+
+// More readers than slots: the ones without a slot hold back freeing until they are done as well
+static void test_overflow_readers()
+{
+	utils::rules_snapshot<tracked> snapshot;
+	constexpr auto count = int(utils::rcu_domain::max_readers) + 16;
+	std::mutex mutex;
+	std::condition_variable cv;
+	auto holding = 0;
+	auto release = false;
+	std::atomic<int> failures{};
+	std::vector<std::thread> readers;
+	for (auto t = 0; t < count; ++t)
+	{
+		readers.emplace_back([&]
+		{
+			const auto r = snapshot.current();
+			const auto alive = r->alive;
+			std::unique_lock lock(mutex);
+			++holding;
+			cv.notify_all();
+			cv.wait(lock, [&] { return release; });
+			if (!*alive) failures.fetch_add(1);
+		});
+	}
+	{
+		std::unique_lock lock(mutex);
+		cv.wait(lock, [&] { return holding == count; });
+	}
+	for (auto i = 0; i < 10; ++i) snapshot.update([&](tracked& r) { ++r.value; });
+	CHECK(snapshot.retired() == 10);
+	{
+		std::unique_lock lock(mutex);
+		release = true;
+		cv.notify_all();
+	}
+	for (auto& r : readers) r.join();
+	CHECK(failures.load() == 0);
+	snapshot.update([&](tracked& r) { ++r.value; });
+	CHECK(snapshot.retired() == 0);
+}
+
+int main()
+{
+	test_concurrent_updates();
+	test_generations();
+	test_reclamation();
+	test_readers_do_not_wait();
+	test_overflow_readers();
+	return finish("rules");
+}
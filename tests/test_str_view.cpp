@@ -0,0 +1,74 @@
+#include <vector>
+
+#include "common.h"
+#include "str_view_baseline.h"
+#include "util.h"
+
+// str_view searching and splitting compared with the loops they replaced, around 16-byte blocks and at every start index
+
+static void check_string(const std::string& s)
+{
+	const auto v = utils::str_view::from_str(s);
+	for (auto index = 0ULL; index <= s.size() + 1; ++index)
+	{
+		CHECK(v.find_first_of('/', index) == baseline::find_first_of(s.data(), s.size(), '/', index));
+		CHECK(v.find_first_of(":/", index) == baseline::find_first_of(s.data(), s.size(), ":/", index));
+		CHECK(v.find_first_of("?#&=", index) == baseline::find_first_of(s.data(), s.size(), "?#&=", index));
+		CHECK(v.find_first_of(std::string("abcxyz:"), index) == baseline::find_first_of(s.data(), s.size(), "abcxyz:", index));
+		CHECK(v.find_last_of("/", index) == baseline::find_last_of(s.data(), s.size(), "/", index));
+		CHECK(v.find_last_of(":/", index) == baseline::find_last_of(s.data(), s.size(), ":/", index));
+		CHECK(v.find_last_of("?#&=", index) == baseline::find_last_of(s.data(), s.size(), "?#&=", index));
+		CHECK(v.find_last_of("abcxyz:", index) == baseline::find_last_of(s.data(), s.size(), "abcxyz:", index));
+		CHECK(v.find_last_of('/', index) == (index == 0 ? std::string::npos : s.find_last_of('/', index - 1)));
+		for (const auto needle : {"/", "//", "a/b", "://", "0123456789abcdef", "0123456789abcdef/"})
+		{
+			CHECK(v.find(needle, index) == baseline::find_cstrl(s.data(), s.size(), needle, strlen(needle), index));
+		}
+	}
+
+	std::vector<std::pair<size_t, size_t>> expected;
+	baseline::split(expected, s.data(), s.size(), '/');
+	auto i = 0ULL;
+	for (const auto p : v.pieces('/'))
+	{
+		CHECK(i < expected.size() && p.data() == s.data() + expected[i].first && p.size() == expected[i].second);
+		++i;
+	}
+	CHECK(i == expected.size());
+}
+
+int main()
+{
+	std::mt19937 rng(5);
+	for (auto round = 0; round < 3000; ++round)
+	{
+		std::string s(rng() % 80, ' ');
+		const auto density = 1 + rng() % 40;
+		for (auto& c : s) c = rng() % density == 0 ? ":/?#&=abc"[rng() % 9] : char('d' + rng() % 20);
+		if (round % 7 == 0 && s.size() > 20) memcpy(&s[s.size() - 17], "0123456789abcdef/", 17);
+		check_string(s);
+	}
+	check_string("");
+	check_string("/");
+	check_string("//");
+
+	// Default index of find_last_of() for sets is zero, as before, so nothing is found without one
+	const auto url = utils::str_view("https://example.com/path/file.js");
+	CHECK(url.find_last_of("/") == std::string::npos);
+	CHECK(url.find_last_of("/", url.size()) == 25);
+	CHECK(url.find_last_of("./", url.size()) == 30);
+
+	// Empty strings yield one empty piece, whether they point anywhere or not
+	for (const auto& e : {utils::str_view(), utils::str_view(nullptr, 0, 0)})
+	{
+		auto count = 0;
+		for (const auto p : e.pieces('\1'))
+		{
+			CHECK(p.empty());
+			++count;
+		}
+		CHECK(count == 1);
+		CHECK(e.pairs('\1').empty());
+	}
+	return finish("str_view");
+}
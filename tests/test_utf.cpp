@@ -0,0 +1,101 @@
+#include <vector>
+
+#include "common.h"
+#include "utf_reference.h"
+#include "util.h"
+
+// UTF-16 to UTF-8 and back against a plain transcoder: ASCII runs around the SIMD block sizes, surrogate pairs split at every
+// position, unpaired surrogates, overlong and truncated sequences, encoded surrogates, random mixes of all of them
+
+static std::string to_utf8(const std::u16string& s)
+{
+	std::string ret(utils::utf8_size(s.data(), s.size()), '\0');
+	CHECK(utils::utf8_write(s.data(), s.size(), ret.data()) == ret.size());
+	return ret;
+}
+
+static std::u16string to_utf16(const std::string& s)
+{
+	std::u16string ret(utils::utf16_size<char16_t>(s.data(), s.size()), u'\0');
+	CHECK(utils::utf16_write(s.data(), s.size(), ret.data()) == ret.size());
+	return ret;
+}
+
+static void check16(const std::u16string& s)
+{
+	const auto expected = reference::utf8(s);
+	CHECK(to_utf8(s) == expected);
+	CHECK(utils::utf8(CefString(s)) == expected);
+	CHECK(utils::utf8_scratch(CefString(s)) == expected);
+}
+
+static void check8(const std::string& s)
+{
+	CHECK(to_utf16(s) == reference::utf16(s));
+}
+
+int main()
+{
+	// Explicit cases
+	CHECK(to_utf8(u"\U0001F600") == "\xF0\x9F\x98\x80");
+	CHECK(to_utf8(u"a\xD800" "b") == "a\xEF\xBF\xBD" "b");
+	CHECK(to_utf8(u"\xDC00\xD800") == "\xEF\xBF\xBD\xEF\xBF\xBD");
+	CHECK(to_utf16("\xF0\x9F\x98\x80") == u"\xD83D\xDE00");
+	CHECK(to_utf16("\xC0\x80") == u"\xFFFD\xFFFD");
+	CHECK(to_utf16("\xED\xA0\x80") == u"\xFFFD\xFFFD\xFFFD");
+	CHECK(to_utf16("\xE2\x82") == u"\xFFFD\xFFFD");
+	CHECK(to_utf16("\xF4\x90\x80\x80") == u"\xFFFD\xFFFD\xFFFD\xFFFD");
+	CHECK(to_utf16("\xE2\x82\xAC") == u"\x20AC");
+
+	// Pairs and broken pairs at every offset around 8- and 16-unit blocks
+	for (auto size = 0; size < 40; ++size)
+	{
+		for (auto at = 0; at <= size; ++at)
+		{
+			std::u16string s(size, u'x');
+			s.insert(at, u"\xD83D\xDE00");
+			check16(s);
+			check8(reference::utf8(s));
+			auto broken = s;
+			broken.erase(at, 1);
+			check16(broken);
+			broken = s;
+			broken.erase(at + 1, 1);
+			check16(broken);
+
+			std::string u8(size, 'x');
+			u8.insert(at, "\xE2\x82");
+			check8(u8);
+			u8.insert(at, "\xF0\x9F\x98\x80\xC3\xA9");
+			check8(u8);
+		}
+	}
+
+	std::mt19937 rng(17);
+	for (auto round = 0; round < 20000; ++round)
+	{
+		std::u16string s(rng() % 100, u' ');
+		for (auto& c : s)
+		{
+			const auto kind = rng() % 10;
+			c = kind < 5 ? char16_t(0x20 + rng() % 0x5f) : kind < 7 ? char16_t(0x80 + rng() % 0x780)
+				: kind < 9 ? char16_t(0xd800 + rng() % 0x800) : char16_t(rng() % 0x10000);
+		}
+		check16(s);
+
+		std::string u(rng() % 100, ' ');
+		for (auto& c : u) c = char(rng() % 3 ? 0x20 + rng() % 0x5f : rng() % 256);
+		check8(u);
+		check8(reference::utf8(s));
+	}
+
+	// A string kept from utf8_assign() survives builders converting other strings through the scratch buffer
+	std::string kept;
+	utils::utf8_assign(kept, CefString(u"https://example.com/\x00e9t\x00e9"));
+	const auto& scratch = utils::utf8_scratch(CefString(u"https://example.com/scratch"));
+	lson_builder{}.add("url", CefString(u"https://example.com/other"));
+	binary_builder(accsp_binary_schema::load_state, accsp_binary_load_state{}).add(CefString(u"x"));
+	CHECK(kept == "https://example.com/\xC3\xA9t\xC3\xA9");
+	CHECK(scratch == "x");
+	return finish("utf");
+}
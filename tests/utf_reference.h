@@ -0,0 +1,70 @@
+#pragma once
+
+#include <string>
+
+// Plain code point by code point transcoding, for comparison: unpaired surrogates and malformed UTF-8 become U+FFFD, one
+// replacement per invalid byte, well-formed ranges checked against the table of the Unicode standard
+namespace reference
+{
+	inline void append_utf8(std::string& out, uint32_t c)
+	{
+		if (c < 0x80) out.push_back(char(c));
+		else if (c < 0x800) out += {char(0xc0 | c >> 6), char(0x80 | (c & 0x3f))};
+		else if (c < 0x10000) out += {char(0xe0 | c >> 12), char(0x80 | (c >> 6 & 0x3f)), char(0x80 | (c & 0x3f))};
+		else out += {char(0xf0 | c >> 18), char(0x80 | (c >> 12 & 0x3f)), char(0x80 | (c >> 6 & 0x3f)), char(0x80 | (c & 0x3f))};
+	}
+
+	inline std::string utf8(const std::u16string& s)
+	{
+		std::string ret;
+		for (auto i = 0ULL; i < s.size(); ++i)
+		{
+			const auto c = uint32_t(s[i]);
+			const auto high = c >= 0xd800 && c <= 0xdbff;
+			const auto next_low = i + 1 < s.size() && s[i + 1] >= 0xdc00 && s[i + 1] <= 0xdfff;
+			if (high && next_low)
+			{
+				append_utf8(ret, 0x10000 + ((c - 0xd800) << 10) + (uint32_t(s[++i]) - 0xdc00));
+			}
+			else
+			{
+				append_utf8(ret, c >= 0xd800 && c <= 0xdfff ? 0xfffd : c);
+			}
+		}
+		return ret;
+	}
+
+	// Length of a well-formed sequence at given position, or 0
+	inline size_t sequence_length(const uint8_t* u, size_t left)
+	{
+		auto in = [&](size_t i, uint8_t lo, uint8_t hi) { return i < left && u[i] >= lo && u[i] <= hi; };
+		if (u[0] <= 0x7f) return 1;
+		if (u[0] >= 0xc2 && u[0] <= 0xdf) return in(1, 0x80, 0xbf) ? 2 : 0;
+		if (u[0] == 0xe0) return in(1, 0xa0, 0xbf) && in(2, 0x80, 0xbf) ? 3 : 0;
+		if ((u[0] >= 0xe1 && u[0] <= 0xec) || u[0] == 0xee || u[0] == 0xef) return in(1, 0x80, 0xbf) && in(2, 0x80, 0xbf) ? 3 : 0;
+		if (u[0] == 0xed) return in(1, 0x80, 0x9f) && in(2, 0x80, 0xbf) ? 3 : 0;
+		if (u[0] == 0xf0) return in(1, 0x90, 0xbf) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+		if (u[0] >= 0xf1 && u[0] <= 0xf3) return in(1, 0x80, 0xbf) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+		if (u[0] == 0xf4) return in(1, 0x80, 0x8f) && in(2, 0x80, 0xbf) && in(3, 0x80, 0xbf) ? 4 : 0;
+		return 0;
+	}
+
+	inline std::u16string utf16(const std::string& s)
+	{
+		std::u16string ret;
+		const auto u = (const uint8_t*)s.data();
+		for (auto i = 0ULL; i < s.size();)
+		{
+			const auto n = sequence_length(&u[i], s.size() - i);
+			uint32_t c = 0xfffd;
+			if (n == 1) c = u[i];
+			else if (n == 2) c = (u[i] & 0x1fU) << 6 | (u[i + 1] & 0x3fU);
+			else if (n == 3) c = (u[i] & 0x0fU) << 12 | (u[i + 1] & 0x3fU) << 6 | (u[i + 2] & 0x3fU);
+			else if (n == 4) c = (u[i] & 0x07U) << 18 | (u[i + 1] & 0x3fU) << 12 | (u[i + 2] & 0x3fU) << 6 | (u[i + 3] & 0x3fU);
+			i += n ? n : 1;
+			if (c >= 0x10000) ret += {char16_t(0xd800 + ((c - 0x10000) >> 10)), char16_t(0xdc00 + ((c - 0x10000) & 0x3ff))};
+			else ret.push_back(char16_t(c));
+		}
+		return ret;
+	}
+}